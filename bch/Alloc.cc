@@ -0,0 +1,100 @@
+/** \file Alloc.cc
+ * Benchmark executable comparing SQLite memory allocators on insert and select workloads.
+ * Usage: sqlite_alloc_bench --allocator=pool|system [benchmark flags]
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+#include "SqliteAlloc.hh"
+#include "SqliteEngine.hh"
+// Std includes
+#include <cstring>
+#include <iostream>
+#include <string>
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+
+using namespace std;
+using namespace MP;
+
+
+static bool s_pool = false;
+
+// Per-thread in-memory database, connections are thread-confined
+static SqliteDb AllocDb()
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  db.exec("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT, v REAL)");
+  return db;
+}
+
+
+static void BM_Insert(benchmark::State& state)
+{
+  SqliteDb db = AllocDb();
+  SqliteStmt stmt = db.stmt("INSERT INTO A(name, v) VALUES (?, ?)");
+  string name;
+  int64_t n = 0;
+  for(auto _ : state) {
+    db.exec("BEGIN");
+    for(int i = 0; i < 100; ++i) {
+      name = "name-" + to_string(n++);
+      stmt.reset();
+      stmt.bindref(1, name);
+      stmt.bind(2, n * 0.5);
+      stmt.step();
+    }
+    db.exec("COMMIT");
+  }
+  state.SetItemsProcessed(state.iterations() * 100);
+}
+BENCHMARK(BM_Insert)->ThreadRange(1, 16)->UseRealTime();
+
+
+static void BM_Select(benchmark::State& state)
+{
+  SqliteDb db = AllocDb();
+  db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<10000) "
+          "INSERT INTO A SELECT i, 'name-'||i, i*0.5 FROM s");
+  int64_t id = 0;
+  for(auto _ : state) {
+    // Fresh statements and sorting exercise SQLite's small allocations
+    SqliteStmt stmt = db.stmt("SELECT name, v FROM A WHERE id BETWEEN ? AND ? ORDER BY name DESC");
+    id = (id + 97) % 9900;
+    stmt.bind(1, id);
+    stmt.bind(2, id + 100);
+    int64_t rows = 0;
+    while(stmt++) rows++;
+    benchmark::DoNotOptimize(rows);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Select)->ThreadRange(1, 16)->UseRealTime();
+
+
+int main(int argc, char** argv)
+{
+  // Take --allocator out before the benchmark library sees the flags
+  int out = 1;
+  for(int i = 1; i < argc; ++i) {
+    if(strncmp(argv[i], "--allocator=", 12) == 0) s_pool = strcmp(argv[i] + 12, "pool") == 0;
+    else argv[out++] = argv[i];
+  }
+  argc = out;
+
+  SqliteEngineConfig cfg;
+  if(s_pool) cfg.memMethods = SqlitePoolAllocator::Methods();
+  if(SqliteEngine::configure(cfg) != SQLITE_OK) return 1;
+  benchmark::AddCustomContext("allocator", s_pool ? "pool" : "system");
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  if(s_pool) cout << SqlitePoolAllocator::Stats().dump();
+  return 0;
+}
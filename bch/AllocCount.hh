@@ -0,0 +1,55 @@
+#ifndef MP_ALLOCCOUNT_HH
+#define MP_ALLOCCOUNT_HH
+#pragma once
+
+/** \file AllocCount.hh
+ * Declarations allocation counting for the sqlite_bench microbenchmarks
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+
+namespace MP {
+
+
+  // Process-wide allocation counts, see AllocCount_b.cc.
+  // News counts the replaced global operator new, SqliteMallocs the xMalloc/xRealloc calls
+  // of SQLite's allocator, which is wrapped before SQLite initializes.
+  uint64_t BenchNews();
+  uint64_t BenchSqliteMallocs();
+
+
+  // Counts allocations from construction on and reports them per iteration
+  class BenchAllocCounter
+  {
+    protected:
+      uint64_t m_news;
+      uint64_t m_sqlite;
+
+    public:
+      BenchAllocCounter() : m_news{BenchNews()}, m_sqlite{BenchSqliteMallocs()} {}
+
+      // Set the new/op and sqlite_malloc/op counters of state
+      void report(benchmark::State& state) const
+      {
+        auto avg = benchmark::Counter::kAvgIterations;
+        state.counters["new/op"] = benchmark::Counter(double(BenchNews() - m_news), avg);
+        state.counters["sqlite_malloc/op"] = benchmark::Counter(double(BenchSqliteMallocs() - m_sqlite), avg);
+      }
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
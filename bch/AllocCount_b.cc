@@ -0,0 +1,79 @@
+
+/** \file AllocCount_b.cc
+ * Allocation counting for the sqlite_bench microbenchmarks.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "AllocCount.hh"
+// Std includes
+#include <atomic>
+#include <cstdlib>
+#include <new>
+// Prj includes
+#include <sqlite3.h>
+
+
+using namespace std;
+using namespace MP;
+
+
+static atomic<uint64_t> s_news{0};
+static atomic<uint64_t> s_sqliteMallocs{0};
+static sqlite3_mem_methods s_sqliteMem;
+
+
+// Global operator new/delete replacements, every other form forwards to these
+void* operator new(size_t n)
+{
+  s_news.fetch_add(1, memory_order_relaxed);
+  if(void* p = malloc(n ? n : 1)) return p;
+  throw bad_alloc();
+}
+
+void* operator new(size_t n, align_val_t al)
+{
+  s_news.fetch_add(1, memory_order_relaxed);
+  size_t a = static_cast<size_t>(al);
+  if(void* p = aligned_alloc(a, (n + a - 1) / a * a)) return p;
+  throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+
+
+static void* CountingMalloc(int n)
+{
+  s_sqliteMallocs.fetch_add(1, memory_order_relaxed);
+  return s_sqliteMem.xMalloc(n);
+}
+
+static void* CountingRealloc(void* p, int n)
+{
+  s_sqliteMallocs.fetch_add(1, memory_order_relaxed);
+  return s_sqliteMem.xRealloc(p, n);
+}
+
+
+// Wrap SQLite's allocator during static initialization, before any connection exists
+static const bool s_wrapped = [] {
+  if(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &s_sqliteMem) != SQLITE_OK) return false;
+  sqlite3_mem_methods m = s_sqliteMem;
+  m.xMalloc = CountingMalloc;
+  m.xRealloc = CountingRealloc;
+  return sqlite3_config(SQLITE_CONFIG_MALLOC, &m) == SQLITE_OK;
+}();
+
+
+namespace MP {
+
+uint64_t BenchNews() { return s_news.load(memory_order_relaxed); }
+uint64_t BenchSqliteMallocs() { return s_sqliteMallocs.load(memory_order_relaxed); }
+
+} // namespace
@@ -0,0 +1,347 @@
+
+/** \file Api_b.cc
+ * Benchmarks for the statement API, each wrapper call against the raw C API.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+// Std includes
+#include <string>
+#include <string_view>
+// Google Benchmark
+#include <benchmark/benchmark.h>
+// Prj includes
+#include "AllocCount.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+// Row read by the column benchmarks
+static constexpr const char* ColumnSql = "SELECT 42, 4200000000, 1.5, 'column text value', x'0102030405060708'";
+
+static SqliteDb ApiDb()
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  db.exec("CREATE TABLE A (id INTEGER PRIMARY KEY, v INTEGER)");
+  return db;
+}
+
+static const string TextValue = "bound text value";
+static const Blob_t BlobValue = {1, 2, 3, 4, 5, 6, 7, 8};
+
+
+// ---- bind() ----
+
+template <typename T>
+static void BM_Bind(benchmark::State& state, T v)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(stmt.bind(1, v));
+  allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_Bind, int32, int32_t{42});
+BENCHMARK_CAPTURE(BM_Bind, int64, int64_t{4200000000});
+BENCHMARK_CAPTURE(BM_Bind, double, 1.5);
+BENCHMARK_CAPTURE(BM_Bind, string_view, std::string_view(TextValue));
+BENCHMARK_CAPTURE(BM_Bind, char_ptr, "bound text value");
+BENCHMARK_CAPTURE(BM_Bind, null, nullptr);
+
+
+template <typename T>
+static void BM_BindRef(benchmark::State& state, const T& v)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(stmt.bindref(1, v));
+  allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_BindRef, string, TextValue);
+BENCHMARK_CAPTURE(BM_BindRef, blob, BlobValue);
+
+
+// Raw counterpart of the bind benchmarks, f binds to the statement handle
+template <typename F>
+static void BM_BindRaw(benchmark::State& state, F f)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  sqlite3_stmt* h = stmt.get();
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(f(h));
+  allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_BindRaw, int32, [](sqlite3_stmt* h) { return sqlite3_bind_int(h, 1, 42); });
+BENCHMARK_CAPTURE(BM_BindRaw, int64, [](sqlite3_stmt* h) { return sqlite3_bind_int64(h, 1, 4200000000); });
+BENCHMARK_CAPTURE(BM_BindRaw, double, [](sqlite3_stmt* h) { return sqlite3_bind_double(h, 1, 1.5); });
+BENCHMARK_CAPTURE(BM_BindRaw, text, [](sqlite3_stmt* h) {
+  return sqlite3_bind_text(h, 1, TextValue.data(), TextValue.size(), SQLITE_STATIC); });
+BENCHMARK_CAPTURE(BM_BindRaw, null, [](sqlite3_stmt* h) { return sqlite3_bind_null(h, 1); });
+BENCHMARK_CAPTURE(BM_BindRaw, blob, [](sqlite3_stmt* h) {
+  return sqlite3_bind_blob(h, 1, BlobValue.data(), BlobValue.size(), SQLITE_STATIC); });
+
+
+// Binds owning their data hold it until reset(), so both sides reset every iteration
+static void BM_BindMoveString(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    stmt.bind(1, string(TextValue));
+    stmt.reset();
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_BindMoveString);
+
+static void BM_BindCopy(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    stmt.bindCopy(1, std::string_view(TextValue));
+    stmt.reset();
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_BindCopy);
+
+static void BM_BindTransientRaw(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1");
+  sqlite3_stmt* h = stmt.get();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    sqlite3_bind_text(h, 1, TextValue.data(), TextValue.size(), SQLITE_TRANSIENT);
+    sqlite3_reset(h);
+    sqlite3_clear_bindings(h);
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_BindTransientRaw);
+
+
+// ---- column() ----
+
+// v selects the column() specialization
+template <typename T>
+static void BM_Column(benchmark::State& state, T v, int col)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt(ColumnSql);
+  stmt.step();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    stmt.column(col, v);
+    benchmark::DoNotOptimize(v);
+  }
+  allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_Column, int32, int32_t{}, 0);
+BENCHMARK_CAPTURE(BM_Column, int64, int64_t{}, 1);
+BENCHMARK_CAPTURE(BM_Column, double, double{}, 2);
+BENCHMARK_CAPTURE(BM_Column, string_view, std::string_view{}, 3);
+BENCHMARK_CAPTURE(BM_Column, string, string{}, 3);
+BENCHMARK_CAPTURE(BM_Column, span, std::span<const uint8_t>{}, 4);
+BENCHMARK_CAPTURE(BM_Column, blob, Blob_t{}, 4);
+
+
+// Column as SqliteValue, dispatching on the column type
+static void BM_ColumnValue(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt(ColumnSql);
+  stmt.step();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    for(int col = 0; col < 5; ++col) {
+      SqliteValue v = stmt.column(col);
+      benchmark::DoNotOptimize(v);
+    }
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_ColumnValue);
+
+
+// Raw counterpart of the column benchmarks, f reads from the statement handle
+template <typename F>
+static void BM_ColumnRaw(benchmark::State& state, F f)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt(ColumnSql);
+  sqlite3_stmt* h = stmt.get();
+  sqlite3_step(h);
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(f(h));
+  allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_ColumnRaw, int32, [](sqlite3_stmt* h) { return sqlite3_column_int(h, 0); });
+BENCHMARK_CAPTURE(BM_ColumnRaw, int64, [](sqlite3_stmt* h) { return sqlite3_column_int64(h, 1); });
+BENCHMARK_CAPTURE(BM_ColumnRaw, double, [](sqlite3_stmt* h) { return sqlite3_column_double(h, 2); });
+BENCHMARK_CAPTURE(BM_ColumnRaw, text, [](sqlite3_stmt* h) {
+  auto p = sqlite3_column_text(h, 3);
+  return std::string_view(reinterpret_cast<const char*>(p), sqlite3_column_bytes(h, 3)); });
+BENCHMARK_CAPTURE(BM_ColumnRaw, blob, [](sqlite3_stmt* h) {
+  auto p = static_cast<const uint8_t*>(sqlite3_column_blob(h, 4));
+  return std::span<const uint8_t>(p, sqlite3_column_bytes(h, 4)); });
+BENCHMARK_CAPTURE(BM_ColumnRaw, type, [](sqlite3_stmt* h) {
+  int t = 0;
+  for(int col = 0; col < 5; ++col) t += sqlite3_column_type(h, col);
+  return t; });
+
+
+// ---- operator<< and operator>> ----
+
+static void BM_Stream(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1, ?2, ?3");
+  int64_t i = 0, a = 0;
+  double b = 0;
+  std::string_view c;
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    stmt << ++i << 1.5 << std::string_view(TextValue);
+    stmt++;
+    stmt >> a >> b >> c;
+    benchmark::DoNotOptimize(c);
+    stmt.reset();
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_Stream);
+
+static void BM_StreamRaw(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT ?1, ?2, ?3");
+  sqlite3_stmt* h = stmt.get();
+  int64_t i = 0;
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    sqlite3_bind_int64(h, 1, ++i);
+    sqlite3_bind_double(h, 2, 1.5);
+    sqlite3_bind_text(h, 3, TextValue.data(), TextValue.size(), SQLITE_STATIC);
+    sqlite3_step(h);
+    benchmark::DoNotOptimize(sqlite3_column_int64(h, 0));
+    benchmark::DoNotOptimize(sqlite3_column_double(h, 1));
+    benchmark::DoNotOptimize(sqlite3_column_text(h, 2));
+    benchmark::DoNotOptimize(sqlite3_column_bytes(h, 2));
+    sqlite3_reset(h);
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_StreamRaw);
+
+
+// ---- step() and reset() of a one row statement ----
+
+static void BM_StepReset(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT 1");
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(stmt.step());
+    benchmark::DoNotOptimize(stmt.reset());
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_StepReset);
+
+static void BM_StepResetRaw(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  SqliteStmt stmt = db.stmt("SELECT 1");
+  sqlite3_stmt* h = stmt.get();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(sqlite3_step(h));
+    benchmark::DoNotOptimize(sqlite3_reset(h));
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_StepResetRaw);
+
+
+// ---- prepare() ----
+
+static constexpr const char* PrepareSql = "SELECT v FROM A WHERE id = ?1";
+
+static void BM_Prepare(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    SqliteStmt stmt;
+    db.prepare(PrepareSql, stmt);
+    benchmark::DoNotOptimize(stmt.get());
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_Prepare);
+
+static void BM_PrepareStmt(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    SqliteStmt stmt = db.stmt(PrepareSql);
+    benchmark::DoNotOptimize(stmt.get());
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_PrepareStmt);
+
+static void BM_PrepareRaw(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  sqlite3* dbh = db.get();
+  BenchAllocCounter allocs;
+  for(auto _ : state) {
+    sqlite3_stmt* h = nullptr;
+    sqlite3_prepare_v3(dbh, PrepareSql, -1, 0, &h, nullptr);
+    benchmark::DoNotOptimize(h);
+    sqlite3_finalize(h);
+  }
+  allocs.report(state);
+}
+BENCHMARK(BM_PrepareRaw);
+
+
+// ---- exec() ----
+
+static constexpr const char* ExecSql = "UPDATE A SET v = v + 1 WHERE id = 1";
+
+static void BM_Exec(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  db.exec("INSERT INTO A VALUES (1, 0)");
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(db.exec(ExecSql));
+  allocs.report(state);
+}
+BENCHMARK(BM_Exec);
+
+static void BM_ExecRaw(benchmark::State& state)
+{
+  SqliteDb db = ApiDb();
+  db.exec("INSERT INTO A VALUES (1, 0)");
+  sqlite3* dbh = db.get();
+  BenchAllocCounter allocs;
+  for(auto _ : state) benchmark::DoNotOptimize(sqlite3_exec(dbh, ExecSql, nullptr, nullptr, nullptr));
+  allocs.report(state);
+}
+BENCHMARK(BM_ExecRaw);
@@ -0,0 +1,91 @@
+
+/** \file Handle_b.cc
+ * Benchmarks for the statement handle ownership.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+// Std includes
+#include <memory>
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+
+using namespace std;
+using namespace MP;
+
+
+// Statement handles are never dereferenced by the handle benchmarks below
+static sqlite3_stmt* const FakeStmt = reinterpret_cast<sqlite3_stmt*>(0x1000);
+
+
+// Previous ownership model: shared_ptr with a custom deleter per statement
+static void BM_StmtHandleShared(benchmark::State& state)
+{
+  for(auto _ : state) {
+    shared_ptr<sqlite3_stmt> h(FakeStmt, [](sqlite3_stmt*) {});
+    benchmark::DoNotOptimize(h.get());
+  }
+}
+BENCHMARK(BM_StmtHandleShared);
+
+// Previous ownership model, statement copied once (e.g. passed around by value)
+static void BM_StmtHandleSharedCopy(benchmark::State& state)
+{
+  for(auto _ : state) {
+    shared_ptr<sqlite3_stmt> h(FakeStmt, [](sqlite3_stmt*) {});
+    shared_ptr<sqlite3_stmt> copy = h;
+    benchmark::DoNotOptimize(copy.get());
+  }
+}
+BENCHMARK(BM_StmtHandleSharedCopy);
+
+// Current ownership model: unique_ptr with SqliteStmtReleaser
+static void BM_StmtHandleUnique(benchmark::State& state)
+{
+  for(auto _ : state) {
+    unique_ptr<sqlite3_stmt, SqliteStmtReleaser> h(FakeStmt, SqliteStmtReleaser{});
+    benchmark::DoNotOptimize(h.get());
+    h.release(); // Do not finalize the fake handle
+  }
+}
+BENCHMARK(BM_StmtHandleUnique);
+
+// Current ownership model, statement moved once
+static void BM_StmtHandleUniqueMove(benchmark::State& state)
+{
+  for(auto _ : state) {
+    unique_ptr<sqlite3_stmt, SqliteStmtReleaser> h(FakeStmt, SqliteStmtReleaser{});
+    unique_ptr<sqlite3_stmt, SqliteStmtReleaser> moved = std::move(h);
+    benchmark::DoNotOptimize(moved.get());
+    moved.release();
+  }
+}
+BENCHMARK(BM_StmtHandleUniqueMove);
+
+
+// Full statement life cycle: prepare, wrap and finalize
+static void BM_SqliteStmtLifecycle(benchmark::State& state)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  for(auto _ : state) {
+    SqliteStmt stmt = db.stmt("SELECT 1");
+    benchmark::DoNotOptimize(stmt.get());
+  }
+}
+BENCHMARK(BM_SqliteStmtLifecycle);
+
+// Full statement life cycle through the statement cache
+static void BM_SqliteStmtLifecycleCached(benchmark::State& state)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  for(auto _ : state) {
+    SqliteStmt stmt = db.cached("SELECT 1");
+    benchmark::DoNotOptimize(stmt.get());
+  }
+}
+BENCHMARK(BM_SqliteStmtLifecycleCached);
@@ -0,0 +1,497 @@
+
+/** \file Olap.cc
+ * Analytical benchmark: generates a deterministic TPC-H-like dataset at a given scale factor
+ * through SqliteBulkInserter, then runs a fixed set of GROUP BY/JOIN queries via SqliteStmt,
+ * reporting per query time, sqlite3_stmt_status counters and peak memory.
+ * Usage: sqlite_olap [--scale=0.1] [--dir=PATH] [--page-size=16384] [--mmap=1073741824]
+ *                    [--cache-size=-262144] [--repeat=3] [--queries=Q1,Q6] [--reuse] [--json=FILE]
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+#include "SqliteBulk.hh"
+#include "SqliteEngine.hh"
+#include "SqliteUtils.hh"
+// Std includes
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+// Posix
+#include <sys/resource.h>
+
+
+using namespace std;
+using namespace std::chrono;
+using namespace MP;
+
+
+struct Options
+{
+  double scale{0.1};
+  filesystem::path dir;
+  int pageSize{16384};
+  int64_t mmapSize{1ll << 30};
+  int cacheSize{-262144};
+  int repeat{3};
+  vector<string> queries; // Empty for all
+  bool reuse{false};      // Keep a database generated earlier with the same scale and page size
+  string json;
+};
+
+
+// ================================= Data generator ================================================
+
+// splitmix64, identical output on every platform unlike the std distributions
+class Rng
+{
+  public:
+    explicit Rng(uint64_t seed) : m_s{seed} {}
+
+    uint64_t next()
+    {
+      uint64_t z = (m_s += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+    int64_t range(int64_t lo, int64_t hi) { return lo + static_cast<int64_t>(next() % static_cast<uint64_t>(hi - lo + 1)); }
+    double money(int64_t lo, int64_t hi) { return range(lo * 100, hi * 100) / 100.0; }
+    template <size_t N>
+    const char* pick(const array<const char*, N>& a) { return a[next() % N]; }
+
+  private:
+    uint64_t m_s;
+};
+
+
+static constexpr array<const char*, 5> Regions = { "AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST" };
+static constexpr array<const char*, 25> Nations = {
+  "ALGERIA", "ARGENTINA", "BRAZIL", "CANADA", "EGYPT", "ETHIOPIA", "FRANCE", "GERMANY", "INDIA",
+  "INDONESIA", "IRAN", "IRAQ", "JAPAN", "JORDAN", "KENYA", "MOROCCO", "MOZAMBIQUE", "PERU", "CHINA",
+  "ROMANIA", "SAUDI ARABIA", "VIETNAM", "RUSSIA", "UNITED KINGDOM", "UNITED STATES" };
+static constexpr int NationRegion[25] = { 0, 1, 1, 1, 4, 0, 3, 3, 2, 2, 4, 4, 2, 4, 0, 0, 0, 1, 2, 3, 4, 2, 3, 3, 1 };
+static constexpr array<const char*, 5> Segments = { "AUTOMOBILE", "BUILDING", "FURNITURE", "HOUSEHOLD", "MACHINERY" };
+static constexpr array<const char*, 5> Priorities = { "1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW" };
+static constexpr array<const char*, 4> Instructs = { "DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN" };
+static constexpr array<const char*, 7> ShipModes = { "REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB" };
+static constexpr array<const char*, 6> Types1 = { "STANDARD", "SMALL", "MEDIUM", "LARGE", "ECONOMY", "PROMO" };
+static constexpr array<const char*, 5> Types2 = { "ANODIZED", "BURNISHED", "PLATED", "POLISHED", "BRUSHED" };
+static constexpr array<const char*, 5> Types3 = { "TIN", "NICKEL", "BRASS", "STEEL", "COPPER" };
+static constexpr array<const char*, 5> Containers1 = { "SM", "LG", "MED", "JUMBO", "WRAP" };
+static constexpr array<const char*, 8> Containers2 = { "CASE", "BOX", "BAG", "JAR", "PKG", "PACK", "CAN", "DRUM" };
+static constexpr array<const char*, 16> Colors = {
+  "almond", "antique", "aquamarine", "azure", "beige", "bisque", "black", "blanched",
+  "blue", "blush", "brown", "burlywood", "chartreuse", "chocolate", "coral", "cornflower" };
+static constexpr array<const char*, 16> Words = {
+  "furiously", "quickly", "carefully", "blithely", "slyly", "final", "regular", "special",
+  "pending", "ironic", "express", "bold", "deposits", "requests", "accounts", "packages" };
+
+
+static string Text(Rng& rng, int minWords, int maxWords)
+{
+  string s;
+  for(int64_t i = 0, n = rng.range(minWords, maxWords); i < n; ++i) {
+    if(i) s += ' ';
+    s += rng.pick(Words);
+  }
+  return s;
+}
+
+
+static string Phone(Rng& rng, int64_t nation)
+{
+  char buf[4 * 20 + 3 + 1]; // Worst case %lld is 20 characters
+  snprintf(buf, sizeof(buf), "%02lld-%03lld-%03lld-%04lld", static_cast<long long>(nation + 10),
+           static_cast<long long>(rng.range(100, 999)), static_cast<long long>(rng.range(100, 999)),
+           static_cast<long long>(rng.range(1000, 9999)));
+  return buf;
+}
+
+
+// Days since 1992-01-01 as YYYY-MM-DD
+static string Date(int64_t day)
+{
+  // Days from civil, H. Hinnant's algorithm
+  int64_t z = day + 8035 + 719468; // 1992-01-01 is day 8035 after 1970-01-01
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int64_t doe = z - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  int64_t d = doy - (153 * mp + 2) / 5 + 1;
+  int64_t m = mp < 10 ? mp + 3 : mp - 9;
+  int64_t y = yoe + era * 400 + (m <= 2);
+  char buf[3 * 20 + 2 + 1]; // Worst case %lld is 20 characters
+  snprintf(buf, sizeof(buf), "%04lld-%02lld-%02lld", static_cast<long long>(y), static_cast<long long>(m), static_cast<long long>(d));
+  return buf;
+}
+
+
+static constexpr int64_t LastOrderDay = 2405 - 151; // 1998-08-02 less the longest shipping window
+static const string CurrentDate = "1995-06-17";     // Splits returned/open line items
+
+
+static double RetailPrice(int64_t partkey)
+{
+  return (90000 + ((partkey / 10) % 20001) + 100 * (partkey % 1000)) / 100.0;
+}
+
+
+static int64_t PartSupplier(int64_t partkey, int64_t i, int64_t suppliers)
+{
+  return (partkey + i * (suppliers / 4 + (partkey - 1) / suppliers)) % suppliers + 1;
+}
+
+
+static const char* Schema = R"(
+CREATE TABLE region (r_regionkey INTEGER PRIMARY KEY, r_name TEXT, r_comment TEXT);
+CREATE TABLE nation (n_nationkey INTEGER PRIMARY KEY, n_name TEXT, n_regionkey INTEGER, n_comment TEXT);
+CREATE TABLE supplier (s_suppkey INTEGER PRIMARY KEY, s_name TEXT, s_address TEXT, s_nationkey INTEGER,
+  s_phone TEXT, s_acctbal REAL, s_comment TEXT);
+CREATE TABLE customer (c_custkey INTEGER PRIMARY KEY, c_name TEXT, c_address TEXT, c_nationkey INTEGER,
+  c_phone TEXT, c_acctbal REAL, c_mktsegment TEXT, c_comment TEXT);
+CREATE TABLE part (p_partkey INTEGER PRIMARY KEY, p_name TEXT, p_mfgr TEXT, p_brand TEXT, p_type TEXT,
+  p_size INTEGER, p_container TEXT, p_retailprice REAL, p_comment TEXT);
+CREATE TABLE partsupp (ps_partkey INTEGER, ps_suppkey INTEGER, ps_availqty INTEGER, ps_supplycost REAL,
+  ps_comment TEXT, PRIMARY KEY (ps_partkey, ps_suppkey)) WITHOUT ROWID;
+CREATE TABLE orders (o_orderkey INTEGER PRIMARY KEY, o_custkey INTEGER, o_orderstatus TEXT, o_totalprice REAL,
+  o_orderdate TEXT, o_orderpriority TEXT, o_clerk TEXT, o_shippriority INTEGER, o_comment TEXT);
+CREATE TABLE lineitem (l_orderkey INTEGER, l_partkey INTEGER, l_suppkey INTEGER, l_linenumber INTEGER,
+  l_quantity REAL, l_extendedprice REAL, l_discount REAL, l_tax REAL, l_returnflag TEXT, l_linestatus TEXT,
+  l_shipdate TEXT, l_commitdate TEXT, l_receiptdate TEXT, l_shipinstruct TEXT, l_shipmode TEXT, l_comment TEXT,
+  PRIMARY KEY (l_orderkey, l_linenumber)) WITHOUT ROWID;
+)";
+
+static const char* Indexes = R"(
+CREATE INDEX orders_custkey ON orders (o_custkey);
+CREATE INDEX orders_orderdate ON orders (o_orderdate);
+CREATE INDEX lineitem_partkey ON lineitem (l_partkey);
+CREATE INDEX customer_nationkey ON customer (c_nationkey);
+CREATE INDEX supplier_nationkey ON supplier (s_nationkey);
+ANALYZE;
+)";
+
+
+static void Generate(SqliteDb& db, double scale)
+{
+  const int64_t suppliers = max<int64_t>(1, llround(10000 * scale));
+  const int64_t customers = max<int64_t>(1, llround(150000 * scale));
+  const int64_t parts = max<int64_t>(1, llround(200000 * scale));
+  const int64_t orders = max<int64_t>(1, llround(1500000 * scale));
+  SqliteBulkOptions bulk;
+  bulk.commitInterval = milliseconds(0); // Commit by rows only, keeps the file identical run to run
+
+  db.exec(Schema);
+  {
+    Rng rng(1);
+    SqliteBulkInserter<int64_t, string, string> region(db, "region", {}, bulk);
+    for(int64_t r = 0; r < 5; ++r) region.insert({r, Regions[r], Text(rng, 4, 10)});
+    SqliteBulkInserter<int64_t, string, int64_t, string> nation(db, "nation", {}, bulk);
+    for(int64_t n = 0; n < 25; ++n) nation.insert({n, Nations[n], NationRegion[n], Text(rng, 4, 10)});
+  }
+  {
+    Rng rng(2);
+    SqliteBulkInserter<int64_t, string, string, int64_t, string, double, string> supplier(db, "supplier", {}, bulk);
+    for(int64_t s = 1; s <= suppliers; ++s) {
+      int64_t nation = rng.range(0, 24);
+      supplier.insert({s, "Supplier#" + to_string(s), Text(rng, 2, 4), nation, Phone(rng, nation),
+                       rng.money(-999, 9999), Text(rng, 5, 12)});
+    }
+  }
+  {
+    Rng rng(3);
+    SqliteBulkInserter<int64_t, string, string, int64_t, string, double, string, string> customer(db, "customer", {}, bulk);
+    for(int64_t c = 1; c <= customers; ++c) {
+      int64_t nation = rng.range(0, 24);
+      customer.insert({c, "Customer#" + to_string(c), Text(rng, 2, 4), nation, Phone(rng, nation),
+                       rng.money(-999, 9999), rng.pick(Segments), Text(rng, 5, 12)});
+    }
+  }
+  // One inserter at a time, each runs its own transactions
+  {
+    Rng rng(4);
+    SqliteBulkInserter<int64_t, string, string, string, string, int64_t, string, double, string> part(db, "part", {}, bulk);
+    for(int64_t p = 1; p <= parts; ++p) {
+      string name;
+      for(int i = 0; i < 5; ++i) name += string(i ? " " : "") + rng.pick(Colors);
+      int64_t m = rng.range(1, 5);
+      string type = string(rng.pick(Types1)) + " " + rng.pick(Types2) + " " + rng.pick(Types3);
+      part.insert({p, name, "Manufacturer#" + to_string(m), "Brand#" + to_string(m * 10 + rng.range(1, 5)),
+                   type, rng.range(1, 50), string(rng.pick(Containers1)) + " " + rng.pick(Containers2),
+                   RetailPrice(p), Text(rng, 1, 4)});
+    }
+  }
+  {
+    Rng rng(5);
+    SqliteBulkInserter<int64_t, int64_t, int64_t, double, string> partsupp(db, "partsupp", {}, bulk);
+    for(int64_t p = 1; p <= parts; ++p) {
+      for(int64_t i = 0; i < 4; ++i) {
+        partsupp.insert({p, PartSupplier(p, i, suppliers), rng.range(1, 9999), rng.money(1, 1000), Text(rng, 8, 16)});
+      }
+    }
+  }
+
+  // Orders depend on their line items, both passes draw the same sequence
+  typedef tuple<int64_t, int64_t, string, double, string, string, string, int64_t, string> Order_t;
+  typedef tuple<int64_t, int64_t, int64_t, int64_t, double, double, double, double, string, string,
+                string, string, string, string, string, string> Line_t;
+  const int64_t clerks = max<int64_t>(1, llround(1000 * scale));
+  auto orderRows = [&](Rng& rng, int64_t o, vector<Line_t>& lines) -> Order_t {
+    int64_t orderDay = rng.range(0, LastOrderDay);
+    double total = 0;
+    int open = 0;
+    lines.clear();
+    for(int64_t l = 1, n = rng.range(1, 7); l <= n; ++l) {
+      int64_t partkey = rng.range(1, parts);
+      double qty = static_cast<double>(rng.range(1, 50));
+      double price = qty * RetailPrice(partkey);
+      double discount = rng.range(0, 10) / 100.0;
+      double tax = rng.range(0, 8) / 100.0;
+      int64_t shipDay = orderDay + rng.range(1, 121);
+      string ship = Date(shipDay);
+      string commit = Date(orderDay + rng.range(30, 90));
+      string receipt = Date(shipDay + rng.range(1, 30));
+      string flag = receipt <= CurrentDate ? (rng.range(0, 1) ? "R" : "A") : "N";
+      string status = ship > CurrentDate ? "O" : "F";
+      open += status == "O";
+      total += price * (1 + tax) * (1 - discount);
+      lines.emplace_back(o, partkey, PartSupplier(partkey, rng.range(0, 3), suppliers), l, qty, price, discount,
+                         tax, flag, status, ship, commit, receipt, rng.pick(Instructs), rng.pick(ShipModes),
+                         Text(rng, 2, 6));
+    }
+    const char* status = open == 0 ? "F" : open == static_cast<int>(lines.size()) ? "O" : "P";
+    return {o, rng.range(1, customers), status, total, Date(orderDay), rng.pick(Priorities),
+            "Clerk#" + to_string(rng.range(1, clerks)), 0, Text(rng, 3, 10)};
+  };
+  vector<Line_t> lines;
+  {
+    Rng rng(6);
+    SqliteBulkInserter<int64_t, int64_t, string, double, string, string, string, int64_t, string> order(db, "orders", {}, bulk);
+    for(int64_t o = 1; o <= orders; ++o) order.insert(orderRows(rng, o, lines));
+  }
+  {
+    Rng rng(6);
+    SqliteBulkInserter<int64_t, int64_t, int64_t, int64_t, double, double, double, double, string, string,
+                       string, string, string, string, string, string> lineitem(db, "lineitem", {}, bulk);
+    for(int64_t o = 1; o <= orders; ++o) {
+      orderRows(rng, o, lines);
+      lineitem.insertRange(lines);
+    }
+  }
+  db.exec(Indexes);
+}
+
+
+// ================================= Queries =======================================================
+
+struct Query
+{
+  const char* name;
+  const char* sql;
+};
+
+// TPC-H queries adapted to SQLite: dates are ISO text, interval arithmetic is precomputed
+static const Query Queries[] = {
+  { "Q1", "SELECT l_returnflag, l_linestatus, sum(l_quantity), sum(l_extendedprice), "
+          "sum(l_extendedprice * (1 - l_discount)), sum(l_extendedprice * (1 - l_discount) * (1 + l_tax)), "
+          "avg(l_quantity), avg(l_extendedprice), avg(l_discount), count(*) "
+          "FROM lineitem WHERE l_shipdate <= '1998-09-02' "
+          "GROUP BY l_returnflag, l_linestatus ORDER BY l_returnflag, l_linestatus" },
+  { "Q3", "SELECT l_orderkey, sum(l_extendedprice * (1 - l_discount)) AS revenue, o_orderdate, o_shippriority "
+          "FROM customer, orders, lineitem "
+          "WHERE c_mktsegment = 'BUILDING' AND c_custkey = o_custkey AND l_orderkey = o_orderkey "
+          "AND o_orderdate < '1995-03-15' AND l_shipdate > '1995-03-15' "
+          "GROUP BY l_orderkey, o_orderdate, o_shippriority ORDER BY revenue DESC, o_orderdate LIMIT 10" },
+  { "Q5", "SELECT n_name, sum(l_extendedprice * (1 - l_discount)) AS revenue "
+          "FROM customer, orders, lineitem, supplier, nation, region "
+          "WHERE c_custkey = o_custkey AND l_orderkey = o_orderkey AND l_suppkey = s_suppkey "
+          "AND c_nationkey = s_nationkey AND s_nationkey = n_nationkey AND n_regionkey = r_regionkey "
+          "AND r_name = 'ASIA' AND o_orderdate >= '1994-01-01' AND o_orderdate < '1995-01-01' "
+          "GROUP BY n_name ORDER BY revenue DESC" },
+  { "Q6", "SELECT sum(l_extendedprice * l_discount) AS revenue FROM lineitem "
+          "WHERE l_shipdate >= '1994-01-01' AND l_shipdate < '1995-01-01' "
+          "AND l_discount BETWEEN 0.05 AND 0.07 AND l_quantity < 24" },
+  { "Q10", "SELECT c_custkey, c_name, sum(l_extendedprice * (1 - l_discount)) AS revenue, c_acctbal, n_name "
+           "FROM customer, orders, lineitem, nation "
+           "WHERE c_custkey = o_custkey AND l_orderkey = o_orderkey AND o_orderdate >= '1993-10-01' "
+           "AND o_orderdate < '1994-01-01' AND l_returnflag = 'R' AND c_nationkey = n_nationkey "
+           "GROUP BY c_custkey, c_name, c_acctbal, n_name ORDER BY revenue DESC LIMIT 20" },
+  { "Q12", "SELECT l_shipmode, "
+           "sum(CASE WHEN o_orderpriority IN ('1-URGENT', '2-HIGH') THEN 1 ELSE 0 END) AS high_line_count, "
+           "sum(CASE WHEN o_orderpriority NOT IN ('1-URGENT', '2-HIGH') THEN 1 ELSE 0 END) AS low_line_count "
+           "FROM orders, lineitem WHERE o_orderkey = l_orderkey AND l_shipmode IN ('MAIL', 'SHIP') "
+           "AND l_commitdate < l_receiptdate AND l_shipdate < l_commitdate "
+           "AND l_receiptdate >= '1994-01-01' AND l_receiptdate < '1995-01-01' "
+           "GROUP BY l_shipmode ORDER BY l_shipmode" },
+  { "Q14", "SELECT 100.0 * sum(CASE WHEN p_type LIKE 'PROMO%' THEN l_extendedprice * (1 - l_discount) ELSE 0 END) "
+           "/ sum(l_extendedprice * (1 - l_discount)) AS promo_revenue FROM lineitem, part "
+           "WHERE l_partkey = p_partkey AND l_shipdate >= '1995-09-01' AND l_shipdate < '1995-10-01'" },
+  { "Q18", "SELECT c_name, c_custkey, o_orderkey, o_orderdate, o_totalprice, sum(l_quantity) "
+           "FROM customer, orders, lineitem "
+           "WHERE o_orderkey IN (SELECT l_orderkey FROM lineitem GROUP BY l_orderkey HAVING sum(l_quantity) > 300) "
+           "AND c_custkey = o_custkey AND o_orderkey = l_orderkey "
+           "GROUP BY c_name, c_custkey, o_orderkey, o_orderdate, o_totalprice "
+           "ORDER BY o_totalprice DESC, o_orderdate LIMIT 100" },
+};
+
+
+struct QueryResult
+{
+  string name;
+  int64_t rows{0};
+  double minMs{0};
+  double medianMs{0};
+  int64_t peakHeap{0}; // sqlite3_memory_highwater() during the query, includes the page cache
+  SqliteStmtProfile profile; // Of one run
+};
+
+
+static QueryResult RunQuery(SqliteDb& db, const Query& q, int repeat)
+{
+  QueryResult res;
+  res.name = q.name;
+  vector<double> ms;
+  for(int r = 0; r < repeat; ++r) {
+    sqlite3_memory_highwater(1);
+    auto t0 = steady_clock::now();
+    SqliteStmt stmt = db.stmt(q.sql);
+    int64_t rows = 0;
+    while(stmt++) {
+      for(int c = 0, n = stmt.columnCount(); c < n; ++c) {
+        SqliteValue v = stmt.column(c);
+        (void)v;
+      }
+      ++rows;
+    }
+    ms.push_back(duration<double, milli>(steady_clock::now() - t0).count());
+    res.rows = rows;
+    res.peakHeap = max(res.peakHeap, static_cast<int64_t>(sqlite3_memory_highwater(0)));
+    res.profile = stmt.profile();
+  }
+  sort(ms.begin(), ms.end());
+  res.minMs = ms.front();
+  res.medianMs = ms[ms.size() / 2];
+  return res;
+}
+
+
+static string Json(const Options& opts, const vector<QueryResult>& results, long maxRssKb)
+{
+  string out = "{\"scale\":" + to_string(opts.scale) + ",\"page_size\":" + to_string(opts.pageSize) +
+               ",\"mmap_size\":" + to_string(opts.mmapSize) + ",\"cache_size\":" + to_string(opts.cacheSize) +
+               ",\"max_rss_kb\":" + to_string(maxRssKb) + ",\"queries\":[";
+  for(size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    const auto& p = r.profile;
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\":\"%s\",\"rows\":%lld,\"min_ms\":%.3f,\"median_ms\":%.3f,\"peak_heap\":%lld,"
+             "\"vm_steps\":%d,\"fullscan_steps\":%d,\"sorts\":%d,\"autoindex\":%d}",
+             i ? "," : "", r.name.c_str(), static_cast<long long>(r.rows), r.minMs, r.medianMs,
+             static_cast<long long>(r.peakHeap), p.vmSteps, p.fullscanSteps, p.sorts, p.autoindexes);
+    out += buf;
+  }
+  return out + "]}";
+}
+
+
+static bool Parse(int argc, char** argv, Options& opts)
+{
+  opts.dir = filesystem::temp_directory_path();
+  for(int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    if(strcmp(a, "--reuse") == 0) { opts.reuse = true; continue; }
+    const char* v = strchr(a, '=');
+    if(strncmp(a, "--", 2) != 0 || !v) return false;
+    string name(a + 2, v++);
+    if(name == "scale") opts.scale = atof(v);
+    else if(name == "dir") opts.dir = v;
+    else if(name == "page-size") opts.pageSize = atoi(v);
+    else if(name == "mmap") opts.mmapSize = atoll(v);
+    else if(name == "cache-size") opts.cacheSize = atoi(v);
+    else if(name == "repeat") opts.repeat = atoi(v);
+    else if(name == "json") opts.json = v;
+    else if(name == "queries") {
+      string cur;
+      for(const char* s = v; ; ++s) {
+        if(*s == ',' || !*s) { if(!cur.empty()) opts.queries.push_back(cur); cur.clear(); }
+        else cur += *s;
+        if(!*s) break;
+      }
+    }
+    else return false;
+  }
+  return opts.scale > 0 && opts.repeat > 0;
+}
+
+
+int main(int argc, char** argv)
+{
+  Options opts;
+  if(!Parse(argc, argv, opts)) {
+    cerr << "Usage: sqlite_olap [--scale=0.1] [--dir=PATH] [--page-size=16384] [--mmap=BYTES]\n"
+            "         [--cache-size=N] [--repeat=3] [--queries=Q1,Q6] [--reuse] [--json=FILE]\n";
+    return 2;
+  }
+
+  SqliteEngineConfig cfg;
+  cfg.memStatus = 1; // For sqlite3_memory_highwater()
+  if(SqliteEngine::configure(cfg) != SQLITE_OK) return 1;
+
+  char name[64];
+  snprintf(name, sizeof(name), "sqlite_olap_sf%g_p%d.db", opts.scale, opts.pageSize);
+  string file = (opts.dir / name).string();
+
+  if(!opts.reuse || !filesystem::exists(file)) {
+    for(const char* suffix : {"", "-wal", "-shm", "-journal"}) filesystem::remove(file + suffix);
+    SqliteTuning load = SqliteProfileTuning(SqliteProfile::BulkLoad);
+    load.pageSize = opts.pageSize;
+    SqliteDb db;
+    if(OpenSQLiteDB(file, db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, load) != 0) return 1;
+    auto t0 = steady_clock::now();
+    Generate(db, opts.scale);
+    printf("Generated %s in %.1f s\n", file.c_str(), duration<double>(steady_clock::now() - t0).count());
+  }
+
+  SqliteTuning tuning = SqliteProfileTuning(SqliteProfile::Analytics);
+  tuning.journalMode.clear(); // Read-only
+  tuning.pageSize = 0;
+  tuning.mmapSize = opts.mmapSize;
+  tuning.cacheSize = opts.cacheSize;
+  SqliteDb db;
+  if(OpenSQLiteDB(file, db, SQLITE_OPEN_READONLY, tuning) != 0) return 1;
+
+  printf("sqlite_olap: scale %g, page size %d, mmap %lld, cache size %d, %d runs per query\n",
+         opts.scale, opts.pageSize, static_cast<long long>(opts.mmapSize), opts.cacheSize, opts.repeat);
+  printf("%-5s %8s %10s %10s %12s %12s %12s %6s %10s\n",
+         "query", "rows", "min ms", "median ms", "peak heap", "vm steps", "fullscan", "sorts", "autoindex");
+  vector<QueryResult> results;
+  for(const auto& q : Queries) {
+    if(!opts.queries.empty() && find(opts.queries.begin(), opts.queries.end(), q.name) == opts.queries.end()) continue;
+    auto r = RunQuery(db, q, opts.repeat);
+    printf("%-5s %8lld %10.2f %10.2f %12lld %12d %12d %6d %10d\n", r.name.c_str(), static_cast<long long>(r.rows),
+           r.minMs, r.medianMs, static_cast<long long>(r.peakHeap), r.profile.vmSteps, r.profile.fullscanSteps,
+           r.profile.sorts, r.profile.autoindexes);
+    fflush(stdout);
+    results.push_back(std::move(r));
+  }
+
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  printf("Peak RSS %ld KiB\n", ru.ru_maxrss);
+  if(!opts.json.empty()) ofstream(opts.json) << Json(opts, results, ru.ru_maxrss) << '\n';
+  return 0;
+}
@@ -0,0 +1,340 @@
+
+/** \file Oltp.cc
+ * OLTP workload driver: a YCSB-like key-value table under a mixed read/update/insert/scan
+ * load from several threads, each on its own connection, reporting throughput and tail latency.
+ * Runs every combination of the given journal modes, synchronous levels and checkpoint
+ * interference, each on a fresh database file.
+ * Usage: sqlite_oltp [--dir=PATH] [--threads=4] [--records=100000] [--seconds=5]
+ *                    [--mix=read:50,update:30,insert:15,scan:5] [--journal=wal,delete]
+ *                    [--synchronous=off,normal,full] [--checkpoint=off,on] [--checkpoint-ms=50]
+ *                    [--value-size=100] [--scan-length=50] [--theta=0.99] [--pcache=default|shared]
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+#include "SqliteEngine.hh"
+#include "SqlitePageCache.hh"
+#include "SqliteTrace.hh"
+// Std includes
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+using namespace std::chrono;
+using namespace MP;
+
+
+enum Op { Read, Update, Insert, Scan, NOps };
+static constexpr const char* OpNames[NOps] = { "read", "update", "insert", "scan" };
+
+
+struct Options
+{
+  filesystem::path dir;
+  int threads{4};
+  int64_t records{100000};
+  int seconds{5};
+  array<int, NOps> mix{50, 30, 15, 5}; // Percentages
+  vector<string> journals{"wal", "delete"};
+  vector<string> syncs{"off", "normal", "full"};
+  vector<bool> checkpoints{false, true};
+  int checkpointMs{50};
+  int valueSize{100};
+  int scanLength{50};
+  double theta{0.99};
+  bool sharedPcache{false}; // SqlitePageCache instead of SQLite's pcache1
+};
+
+
+// One benchmark configuration
+struct Config
+{
+  string journal;
+  string sync;
+  bool checkpoint;
+};
+
+
+// Scrambled zipfian keys in [0, n), after YCSB's ZipfianGenerator (Gray et al.)
+class Zipfian
+{
+  public:
+    Zipfian(int64_t n, double theta) : m_n{n}, m_theta{theta}
+    {
+      for(int64_t i = 1; i <= n; ++i) m_zetan += 1.0 / pow(double(i), theta);
+      double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+      m_alpha = 1.0 / (1.0 - theta);
+      m_eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / m_zetan);
+    }
+
+    int64_t operator()(mt19937_64& rng) const
+    {
+      double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+      double uz = u * m_zetan;
+      int64_t rank;
+      if(uz < 1.0) rank = 0;
+      else if(uz < 1.0 + pow(0.5, m_theta)) rank = 1;
+      else rank = static_cast<int64_t>(m_n * pow(m_eta * u - m_eta + 1.0, m_alpha));
+      // Spread the popular ranks over the key space
+      uint64_t h = 14695981039346656037ull;
+      for(int i = 0; i < 8; ++i) h = (h ^ ((static_cast<uint64_t>(rank) >> (i * 8)) & 0xff)) * 1099511628211ull;
+      return static_cast<int64_t>(h % static_cast<uint64_t>(m_n));
+    }
+
+  private:
+    int64_t m_n;
+    double m_theta;
+    double m_zetan{0};
+    double m_alpha{0};
+    double m_eta{0};
+};
+
+
+struct Results
+{
+  SqliteLatencyHistogram latency[NOps];
+  atomic<uint64_t> errors{0};
+  atomic<uint64_t> checkpoints{0};
+};
+
+
+static SqliteDb Open(const filesystem::path& file, const Config& cfg)
+{
+  SqliteDb db(file.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX);
+  db.ex(false);
+  sqlite3_busy_timeout(db.get(), 10000);
+  db.exec("PRAGMA journal_mode=" + cfg.journal);
+  db.exec("PRAGMA synchronous=" + cfg.sync);
+  return db;
+}
+
+
+static void Load(const filesystem::path& file, const Config& cfg, const Options& opts)
+{
+  SqliteDb db = Open(file, cfg);
+  db.exec("CREATE TABLE usertable (ycsb_key INTEGER PRIMARY KEY, field TEXT NOT NULL)");
+  string value(opts.valueSize, 'v');
+  SqliteStmt ins = db.stmt("INSERT INTO usertable (ycsb_key, field) VALUES (?, ?)");
+  db.exec("BEGIN");
+  for(int64_t k = 0; k < opts.records; ++k) {
+    ins.bind(1, k);
+    ins.bindref(2, value);
+    ins.step();
+    ins.reset();
+  }
+  db.exec("COMMIT");
+  if(cfg.journal == "wal") db.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+}
+
+
+static void Worker(stop_token st, int id, const filesystem::path& file, const Config& cfg,
+                   const Options& opts, const Zipfian& zipf, atomic<int64_t>& nextKey, Results& res)
+{
+  SqliteDb db = Open(file, cfg);
+  SqliteStmt stmts[NOps] = {
+    db.stmt("SELECT field FROM usertable WHERE ycsb_key = ?"),
+    db.stmt("UPDATE usertable SET field = ? WHERE ycsb_key = ?"),
+    db.stmt("INSERT INTO usertable (ycsb_key, field) VALUES (?, ?)"),
+    db.stmt("SELECT ycsb_key, field FROM usertable WHERE ycsb_key >= ? ORDER BY ycsb_key LIMIT ?"),
+  };
+  for(auto& s : stmts) s.ex(false);
+
+  mt19937_64 rng(0x5eed + id);
+  uniform_int_distribution<int> pick(0, 99);
+  string value(opts.valueSize, 'a' + id % 26);
+  string_view out;
+  int64_t key = 0;
+
+  while(!st.stop_requested()) {
+    int p = pick(rng), op = 0;
+    for(int acc = opts.mix[0]; p >= acc && op < NOps - 1; acc += opts.mix[++op]) {}
+    SqliteStmt& s = stmts[op];
+    int64_t k = op == Insert ? nextKey.fetch_add(1, memory_order_relaxed) : zipf(rng);
+
+    auto t0 = steady_clock::now();
+    int rc = SQLITE_OK;
+    switch(op) {
+      case Read:
+        s.bind(1, k);
+        while((rc = s.step()) == SQLITE_ROW) s.column(0, out);
+        break;
+      case Update:
+      case Insert:
+        s.bindref(op == Update ? 1 : 2, value);
+        s.bind(op == Update ? 2 : 1, k);
+        rc = s.step();
+        break;
+      case Scan:
+        s.bind(1, k);
+        s.bind(2, opts.scanLength);
+        while((rc = s.step()) == SQLITE_ROW) { s.column(0, key); s.column(1, out); }
+        break;
+    }
+    s.reset();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+    if(rc != SQLITE_DONE) res.errors.fetch_add(1, memory_order_relaxed);
+    else res.latency[op].record(static_cast<uint64_t>(ns));
+  }
+}
+
+
+// Checkpoints as aggressively as possible, competing with the writers for the WAL
+static void Checkpointer(stop_token st, const filesystem::path& file, const Config& cfg, const Options& opts, Results& res)
+{
+  SqliteDb db = Open(file, cfg);
+  while(!st.stop_requested()) {
+    this_thread::sleep_for(milliseconds(opts.checkpointMs));
+    if(sqlite3_wal_checkpoint_v2(db.get(), nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr) == SQLITE_OK) {
+      res.checkpoints.fetch_add(1, memory_order_relaxed);
+    }
+  }
+}
+
+
+static void Run(const Config& cfg, const Options& opts, const Zipfian& zipf)
+{
+  filesystem::path file = opts.dir / "sqlite_oltp.db";
+  for(const char* suffix : {"", "-wal", "-shm", "-journal"}) filesystem::remove(file.string() + suffix);
+  Load(file, cfg, opts);
+
+  auto res = make_unique<Results>();
+  atomic<int64_t> nextKey{opts.records};
+  auto t0 = steady_clock::now();
+  {
+    vector<jthread> threads;
+    for(int i = 0; i < opts.threads; ++i) {
+      threads.emplace_back(Worker, i, cref(file), cref(cfg), cref(opts), cref(zipf), ref(nextKey), ref(*res));
+    }
+    if(cfg.checkpoint) threads.emplace_back(Checkpointer, cref(file), cref(cfg), cref(opts), ref(*res));
+    this_thread::sleep_for(seconds(opts.seconds));
+  } // Stops and joins
+  double secs = duration<double>(steady_clock::now() - t0).count();
+
+  uint64_t total = 0;
+  for(auto& h : res->latency) total += h.count();
+  printf("journal=%s synchronous=%s checkpoint=%s threads=%d: %.0f ops/s, %llu errors",
+         cfg.journal.c_str(), cfg.sync.c_str(), cfg.checkpoint ? "on" : "off", opts.threads,
+         total / secs, static_cast<unsigned long long>(res->errors.load()));
+  if(cfg.checkpoint) printf(", %llu checkpoints", static_cast<unsigned long long>(res->checkpoints.load()));
+  printf("\n  %-7s %10s %10s %10s %10s %10s\n", "op", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+  for(int op = 0; op < NOps; ++op) {
+    const auto& h = res->latency[op];
+    if(!h.count()) continue;
+    printf("  %-7s %10llu %10.1f %10.1f %10.1f %10.1f\n", OpNames[op],
+           static_cast<unsigned long long>(h.count()), h.percentile(0.5) / 1e3,
+           h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3, h.max() / 1e3);
+  }
+  fflush(stdout);
+  for(const char* suffix : {"", "-wal", "-shm", "-journal"}) filesystem::remove(file.string() + suffix);
+}
+
+
+static vector<string> Split(const char* s)
+{
+  vector<string> out;
+  string cur;
+  for(; *s; ++s) {
+    if(*s == ',') { out.push_back(cur); cur.clear(); }
+    else cur += *s;
+  }
+  if(!cur.empty()) out.push_back(cur);
+  return out;
+}
+
+
+static bool Parse(int argc, char** argv, Options& opts)
+{
+  // tmpfs when available, the point is SQLite and the library, not the disk
+  opts.dir = filesystem::is_directory("/dev/shm") ? filesystem::path("/dev/shm") : filesystem::temp_directory_path();
+  for(int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const char* v = strchr(a, '=');
+    if(strncmp(a, "--", 2) != 0 || !v) return false;
+    string name(a + 2, v++);
+    if(name == "dir") opts.dir = v;
+    else if(name == "threads") opts.threads = atoi(v);
+    else if(name == "records") opts.records = atoll(v);
+    else if(name == "seconds") opts.seconds = atoi(v);
+    else if(name == "journal") opts.journals = Split(v);
+    else if(name == "synchronous") opts.syncs = Split(v);
+    else if(name == "checkpoint-ms") opts.checkpointMs = atoi(v);
+    else if(name == "value-size") opts.valueSize = atoi(v);
+    else if(name == "scan-length") opts.scanLength = atoi(v);
+    else if(name == "theta") opts.theta = atof(v);
+    else if(name == "pcache") {
+      if(strcmp(v, "shared") != 0 && strcmp(v, "default") != 0) return false;
+      opts.sharedPcache = strcmp(v, "shared") == 0;
+    }
+    else if(name == "checkpoint") {
+      opts.checkpoints.clear();
+      for(auto& c : Split(v)) opts.checkpoints.push_back(c == "on");
+    }
+    else if(name == "mix") {
+      opts.mix.fill(0);
+      for(auto& kv : Split(v)) {
+        auto colon = kv.find(':');
+        if(colon == string::npos) return false;
+        auto it = find(begin(OpNames), end(OpNames), kv.substr(0, colon));
+        if(it == end(OpNames)) return false;
+        opts.mix[it - begin(OpNames)] = stoi(kv.substr(colon + 1));
+      }
+    }
+    else return false;
+  }
+  int sum = 0;
+  for(int m : opts.mix) sum += m;
+  return sum == 100 && opts.threads > 0 && opts.records > 1 && opts.theta > 0 && opts.theta < 1;
+}
+
+
+int main(int argc, char** argv)
+{
+  Options opts;
+  if(!Parse(argc, argv, opts)) {
+    cerr << "Usage: sqlite_oltp [--dir=PATH] [--threads=N] [--records=N] [--seconds=N]\n"
+            "         [--mix=read:50,update:30,insert:15,scan:5] (sums to 100)\n"
+            "         [--journal=wal,delete] [--synchronous=off,normal,full] [--checkpoint=off,on]\n"
+            "         [--checkpoint-ms=N] [--value-size=N] [--scan-length=N] [--theta=0.99]\n"
+            "         [--pcache=default|shared]\n";
+    return 2;
+  }
+  if(opts.sharedPcache) {
+    SqliteEngineConfig cfg;
+    cfg.pcacheMethods = SqlitePageCache::Methods();
+    if(SqliteEngine::configure(cfg) != SQLITE_OK) {
+      cerr << "sqlite_oltp: cannot install the shared page cache\n";
+      return 1;
+    }
+  }
+  printf("sqlite_oltp: %s, %lld records, %d s per configuration, %s page cache\n",
+         opts.dir.string().c_str(), static_cast<long long>(opts.records), opts.seconds,
+         opts.sharedPcache ? "shared" : "default");
+
+  Zipfian zipf(opts.records, opts.theta);
+  for(const auto& journal : opts.journals) {
+    for(const auto& sync : opts.syncs) {
+      for(bool ckpt : opts.checkpoints) {
+        if(ckpt && journal != "wal") continue; // Checkpoints only exist in WAL mode
+        Run({journal, sync, ckpt}, opts, zipf);
+      }
+    }
+  }
+  return 0;
+}
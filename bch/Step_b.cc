@@ -0,0 +1,91 @@
+
+/** \file Step_b.cc
+ * Benchmarks for stepping statements, wrapper against the raw C API.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "Sqlite.hh"
+// Std includes
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+
+using namespace std;
+using namespace MP;
+
+
+static constexpr int StepRows = 1000;
+
+// In-memory database with StepRows rows
+static SqliteDb StepDb()
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  db.exec("CREATE TABLE S (i INTEGER)");
+  db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<1000) INSERT INTO S SELECT i FROM s");
+  return db;
+}
+
+
+static void BM_StepRaw(benchmark::State& state)
+{
+  SqliteDb db = StepDb();
+  SqliteStmt stmt = db.stmt("SELECT i FROM S");
+  sqlite3_stmt* h = stmt.get();
+  for(auto _ : state) {
+    int64_t sum = 0;
+    while(sqlite3_step(h) == SQLITE_ROW) sum += sqlite3_column_int64(h, 0);
+    sqlite3_reset(h);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * StepRows);
+}
+BENCHMARK(BM_StepRaw);
+
+
+static void BM_StepTry(benchmark::State& state)
+{
+  SqliteDb db = StepDb();
+  SqliteStmt stmt = db.stmt("SELECT i FROM S");
+  for(auto _ : state) {
+    int64_t sum = 0, v = 0;
+    for(auto r = stmt.tryStep(); r && *r; r = stmt.tryStep()) { stmt.column(0, v); sum += v; }
+    stmt.tryReset();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * StepRows);
+}
+BENCHMARK(BM_StepTry);
+
+
+static void BM_Step(benchmark::State& state)
+{
+  SqliteDb db = StepDb();
+  SqliteStmt stmt = db.stmt("SELECT i FROM S");
+  for(auto _ : state) {
+    int64_t sum = 0, v = 0;
+    while(stmt.step() == SQLITE_ROW) { stmt.column(0, v); sum += v; }
+    stmt.reset();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * StepRows);
+}
+BENCHMARK(BM_Step);
+
+
+static void BM_StepPostfix(benchmark::State& state)
+{
+  SqliteDb db = StepDb();
+  SqliteStmt stmt = db.stmt("SELECT i FROM S");
+  for(auto _ : state) {
+    int64_t sum = 0, v = 0;
+    while(stmt++) { stmt >> v; sum += v; }
+    stmt.reset();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * StepRows);
+}
+BENCHMARK(BM_StepPostfix);
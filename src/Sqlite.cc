@@ -1,7 +1,11 @@
 
 #include "Sqlite.hh"
+#include "SqliteEngine.hh"
+#include "SqliteTrace.hh"
 // Std
 #include <string>
+#include <sstream>
+#include <cstdlib>
 #if defined(__GNUC__) && (__GNUC__ < 13)
 # define FMT_HEADER_ONLY
 # include <fmt/core.h>
@@ -17,7 +21,21 @@ using namespace std;
 
 namespace MP {
 
-// Custom deleter for sqlite3 shared_ptr objects
+void ContractFailure(const char* kind, const std::source_location& loc)
+{
+  std::ostringstream os;
+  os << kind << " failure at " << loc.file_name() << '(' << loc.line() << ':' << loc.column() << ')' << loc.function_name();
+  if constexpr (SqliteExceptionsEnabled) {
+    throw std::runtime_error(os.str());
+  }
+  else {
+    LOG(FATAL) << os.str();
+    std::abort();
+  }
+}
+
+
+// Custom deleter for sqlite3 handles
 void Sqlite3Deleter(sqlite3* dbh)
 {
   // Called when dbh is going out of scope/deallocated.
@@ -31,28 +49,51 @@ void Sqlite3Deleter(sqlite3* dbh)
 }
 
 // Default constructor
-SqliteDb::SqliteDb() : m_dbh{0}, m_filename{}, m_flags{0}, m_rc{0}, m_ex{SqliteEx} {}
+SqliteDb::SqliteDb() : m_dbh{}, m_filename{}, m_flags{0}, m_rc{0}, m_ex{SqliteEx} {}
 
 // Common constructor
-SqliteDb::SqliteDb(std::string_view filename, int flags) :
+SqliteDb::SqliteDb(std::string_view filename, int flags, std::string_view vfs) :
  m_dbh{}, m_filename{filename}, m_flags{flags}, m_rc{0}, m_ex{SqliteEx}
 {
   sqlite3* dbh = nullptr;
-  const char *zVfs = nullptr;
+  string vfsName{vfs};
+  const char *zVfs = vfs.empty() ? nullptr : vfsName.c_str();
+  SqliteEngine::BeforeOpen(m_filename); // Process-wide configuration is final from here on
   int rv = m_rc = sqlite3_open_v2(filename.data(), &dbh, flags, zVfs);
+  SqliteEngine::OnOpen(rv == SQLITE_OK ? dbh : nullptr);
   if(rv == SQLITE_OK) {
-    m_dbh.reset(dbh, Sqlite3Deleter);
+    m_dbh.reset(dbh);
+    m_cache = make_shared<SqliteStmtCache>(dbh);
     VLOG(2) << format("Constructed Sqlite3 Dbh={}", (void*)m_dbh.get());
     rv = sqlite3_extended_result_codes(dbh, 1); // Enable extended result codes by default
   }
   else {
     LOG(ERROR) << "Sqlite3 err=" << sqlite3_errmsg(dbh);
+    sqlite3_close_v2(dbh); // A handle is allocated even when opening fails
   }  
 }
 
 // Destructor. Actual work is done via Sqlite3Deleter()
 SqliteDb::~SqliteDb()
-{ 
+{
+  // Statements outliving the connection are finalized after the tracer is released
+  if(m_dbh && m_tracer) sqlite3_trace_v2(m_dbh.get(), 0, nullptr, nullptr);
+}
+
+// Move assignment, the old connection goes in the order of the destructor
+SqliteDb& SqliteDb::operator=(SqliteDb&& other) noexcept
+{
+  if(this == &other) return *this;
+  // Statements finalized while closing must not report to a released tracer
+  if(m_dbh && m_tracer) sqlite3_trace_v2(m_dbh.get(), 0, nullptr, nullptr);
+  m_cache = std::move(other.m_cache); // Cached statements are finalized before the close
+  m_dbh = std::move(other.m_dbh);
+  m_tracer = std::move(other.m_tracer);
+  m_filename = std::move(other.m_filename);
+  m_flags = other.m_flags;
+  m_rc = other.m_rc;
+  m_ex = other.m_ex;
+  return *this;
 }
 
 // https://www.sqlite.org/c3ref/errcode.html
@@ -63,10 +104,10 @@ int SqliteDb::checkError() const
     const char* emsg = sqlite3_errmsg(m_dbh.get());
     constexpr const char* fmt = "Sqlite eec={} {}";
     if(eec==SQLITE_ROW or eec==SQLITE_DONE) {
-      LOG(INFO) << format(fmt, eec, emsg);
+      if constexpr (SqliteLoggingEnabled) LOG(INFO) << format(fmt, eec, emsg);
     }
     else {
-      LOG(ERROR) << format(fmt, eec, emsg);
+      if constexpr (SqliteLoggingEnabled) LOG(ERROR) << format(fmt, eec, emsg);
       if(SqliteExceptionsEnabled && m_ex) throw std::runtime_error(emsg);      
     }
   }
@@ -81,10 +122,10 @@ int SqliteDb::CheckError(int rc, bool throwOnError)
     const char* emsg = sqlite3_errstr(rc);
     constexpr const char* fmt = "Sqlite rc={} {}";
     if(rc==SQLITE_ROW or rc==SQLITE_DONE) {
-      LOG(INFO) << format(fmt, rc, emsg);
+      if constexpr (SqliteLoggingEnabled) LOG(INFO) << format(fmt, rc, emsg);
     }
     else {
-      LOG(ERROR) << format(fmt, rc, emsg);
+      if constexpr (SqliteLoggingEnabled) LOG(ERROR) << format(fmt, rc, emsg);
       if(SqliteExceptionsEnabled && throwOnError) throw std::runtime_error(emsg);
     }
   }
@@ -107,8 +148,8 @@ int SqliteDb::exec(std::string_view stmt) const
 
   int rc = m_rc = sqlite3_exec(m_dbh.get(), stmt.data(), nullptr, nullptr, &errmsg);
   if(errmsg)  { 
+    if constexpr (SqliteLoggingEnabled) LOG(ERROR) << errmsg;
     sqlite3_free(errmsg);
-    LOG(ERROR) << errmsg;
   }
   else {
     CheckError(rc, m_ex);
@@ -166,10 +207,197 @@ SqliteStmt SqliteDb::stmt(std::string_view sqlStr)
 }
 
 
+SqliteResult<SqliteStmt> SqliteDb::tryPrepare(std::string_view sqlStr) noexcept
+{
+  sqlite3_stmt *ppStmt = nullptr;
+  const char *pzTail = nullptr;
+
+  int rc = m_rc = sqlite3_prepare_v3(m_dbh.get(), sqlStr.data(), sqlStr.length(), 0, &ppStmt, &pzTail);
+  if(rc != SQLITE_OK) return SqliteFailure(rc);
+  return SqliteStmt(ppStmt);
+}
+
+
+SqliteStmt SqliteDb::cached(std::string_view sqlStr)
+{
+  Expects(m_cache != nullptr); // Must be an open database
+  sqlite3_stmt* stmt = nullptr;
+  SqliteStmtCache::Ticket ticket;
+
+  int rc = m_rc = m_cache->checkout(sqlStr, stmt, ticket);
+  if(rc == SQLITE_OK) {
+    return SqliteStmt(stmt, SqliteStmtReleaser{m_cache, ticket});
+  }
+  else {
+    CheckError(rc, m_ex);
+    return SqliteStmt();
+  }
+}
+
+
+size_t SqliteDb::cacheCapacity() const
+{ return m_cache ? m_cache->capacity() : 0; }
+
+void SqliteDb::cacheCapacity(size_t n)
+{ if(m_cache) m_cache->capacity(n); }
+
+SqliteStmtCacheStats SqliteDb::cacheStats() const
+{ return m_cache ? m_cache->stats() : SqliteStmtCacheStats{}; }
+
+
+SqliteDbMemoryStats SqliteDb::memoryStats() const
+{
+  SqliteDbMemoryStats ms;
+  sqlite3* db = m_dbh.get();
+  if(!db) return ms;
+  int hi = 0;
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &ms.cacheUsed, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, &ms.schemaUsed, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_STMT_USED, &ms.stmtUsed, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_USED, &ms.lookasideUsed, &hi, 0);
+  int cur = 0;
+  sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, &cur, &ms.lookasideHit, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, &cur, &ms.lookasideMissSize, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, &cur, &ms.lookasideMissFull, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &ms.cacheHit, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &ms.cacheMiss, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_WRITE, &ms.cacheWrite, &hi, 0);
+  sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_SPILL, &ms.cacheSpill, &hi, 0);
+  return ms;
+}
+
+
+int SqliteDb::trace(std::shared_ptr<SqliteTracer> tracer)
+{
+  Expects(m_dbh != nullptr);
+  if(tracer) m_rc = sqlite3_trace_v2(m_dbh.get(), SQLITE_TRACE_PROFILE, &SqliteTracer::Callback, tracer.get());
+  else m_rc = sqlite3_trace_v2(m_dbh.get(), 0, nullptr, nullptr);
+  if(m_rc == SQLITE_OK) m_tracer = std::move(tracer);
+  return ce2();
+}
+
+
+
+//===================================================================================
+
+
+SqliteStmtCache::SqliteStmtCache(sqlite3* dbh, size_t capacity) : m_dbh{dbh}, m_capacity{capacity}
+{
+  m_stats.capacity = capacity;
+}
+
+
+SqliteStmtCache::~SqliteStmtCache()
+{
+  // Checked out statements are finalized by their releasers once the cache is gone
+  clear();
+}
+
+
+size_t SqliteStmtCache::capacity() const
+{
+  lock_guard<mutex> lock(m_mtx);
+  return m_capacity;
+}
+
+SqliteStmtCacheStats SqliteStmtCache::stats() const
+{
+  lock_guard<mutex> lock(m_mtx);
+  SqliteStmtCacheStats st = m_stats;
+  st.size = m_lru.size();
+  st.capacity = m_capacity;
+  return st;
+}
+
+
+int SqliteStmtCache::checkout(std::string_view sql, sqlite3_stmt*& stmt, Ticket& ticket)
+{
+  lock_guard<mutex> lock(m_mtx);
+
+  auto it = m_index.find(sql);
+  if(it != m_index.end()) {
+    ticket = it->second;
+    m_index.erase(it);
+    m_out.splice(m_out.begin(), m_lru, ticket); // Move the entry to the checked out list
+    m_stats.hits++;
+    stmt = ticket->stmt;
+    return SQLITE_OK;
+  }
+
+  m_stats.misses++;
+  const char *pzTail = nullptr;
+  int rc = sqlite3_prepare_v3(m_dbh, sql.data(), sql.length(), SQLITE_PREPARE_PERSISTENT, &stmt, &pzTail);
+  if(rc == SQLITE_OK) {
+    m_out.push_front(Entry{string{sql}, stmt});
+    ticket = m_out.begin();
+    VLOG(2) << format("Prepared cached Sqlite3 Stmt={}", (void*)stmt);
+  }
+  return rc;
+}
+
+
+void SqliteStmtCache::checkin(Ticket ticket)
+{
+  // Make the statement ready for the next user
+  sqlite3_reset(ticket->stmt);
+  sqlite3_clear_bindings(ticket->stmt);
+
+  lock_guard<mutex> lock(m_mtx);
+  if(m_capacity == 0 || m_index.contains(ticket->sql)) {
+    // Caching disabled or an identical statement was parked meanwhile
+    Sqlite3StmtDeleter(ticket->stmt);
+    m_out.erase(ticket);
+    m_stats.evictions++;
+    return;
+  }
+
+  m_lru.splice(m_lru.begin(), m_out, ticket);
+  m_index.emplace(ticket->sql, ticket);
+  evict(m_capacity);
+}
+
+
+void SqliteStmtCache::capacity(size_t n)
+{
+  lock_guard<mutex> lock(m_mtx);
+  m_capacity = n;
+  evict(m_capacity);
+}
+
+
+void SqliteStmtCache::clear()
+{
+  lock_guard<mutex> lock(m_mtx);
+  for(auto& e : m_lru) Sqlite3StmtDeleter(e.stmt);
+  m_index.clear();
+  m_lru.clear();
+}
+
+
+void SqliteStmtCache::evict(size_t keep)
+{
+  while(m_lru.size() > keep) {
+    Entry& e = m_lru.back();
+    m_index.erase(e.sql);
+    Sqlite3StmtDeleter(e.stmt);
+    m_lru.pop_back();
+    m_stats.evictions++;
+  }
+}
+
+
+void SqliteStmtReleaser::operator()(sqlite3_stmt* stmt) const
+{
+  if(!stmt) return;
+  if(auto c = cache.lock()) c->checkin(ticket);
+  else Sqlite3StmtDeleter(stmt);
+}
+
+
 //===================================================================================
 
 
-// Custom deleter for sqlite3 shared_ptr objects
+// Custom deleter for sqlite3_stmt handles
 void Sqlite3StmtDeleter(sqlite3_stmt* stmt)
 {
   // Called when stmt is going out of scope/deallocated.
@@ -184,16 +412,23 @@ void Sqlite3StmtDeleter(sqlite3_stmt* stmt)
 }
 
 
-SqliteStmt::SqliteStmt(sqlite3_stmt* stmt) : m_bindPos{1}, m_colPos{0}, m_rc{0}, m_ex{SqliteEx}
+SqliteStmt::SqliteStmt(sqlite3_stmt* stmt) :
+ m_stmt{stmt, SqliteStmtReleaser{}}, m_bindPos{1}, m_colPos{0}, m_done{false}, m_rc{0}, m_ex{SqliteEx}
 {
-  m_stmt.reset(stmt, Sqlite3StmtDeleter);
   if(stmt) {
     VLOG(2) <<  format("Constructed Sqlite3 Stmt={}", (void*)m_stmt.get());
   }
 }
 
+SqliteStmt::SqliteStmt(sqlite3_stmt* stmt, SqliteStmtReleaser releaser) :
+ m_stmt{stmt, std::move(releaser)}, m_bindPos{1}, m_colPos{0}, m_done{false}, m_rc{0}, m_ex{SqliteEx}
+{
+}
+
 SqliteStmt::~SqliteStmt()
 {
+  // Release the statement while the arena backing its bindings is still alive
+  m_stmt.reset();
 }
 
 // https://www.sqlite.org/c3ref/step.html
@@ -202,6 +437,7 @@ int SqliteStmt::step()
   // Reset the column position to the beginning
   m_colPos = 0; 
   m_rc = sqlite3_step(m_stmt.get());
+  if(m_rc == SQLITE_ROW || m_rc == SQLITE_DONE) [[likely]] return m_rc; // Nothing to check
   return checkError();
 }
 
@@ -216,7 +452,7 @@ bool SqliteStmt::operator++(int)
     return false;
   }
   if(rc!=SQLITE_OK) {
-    LOG(WARNING) << "Error stepping Stmt=" << (void*)m_stmt.get();
+    if constexpr (SqliteLoggingEnabled) LOG(WARNING) << "Error stepping Stmt=" << (void*)m_stmt.get();
     checkError(); //?
   }
   return false;
@@ -225,12 +461,25 @@ bool SqliteStmt::operator++(int)
 
 // https://www.sqlite.org/c3ref/reset.html
 int SqliteStmt::reset()
+{
+  resetState();
+  return checkError();
+}
+
+
+int SqliteStmt::resetState() noexcept
 {
   // Reset binding and column positions for the next set operations
   m_bindPos = 1;
   m_colPos = 0;
+  m_done = false;
   m_rc = sqlite3_reset(m_stmt.get());
-  return checkError();
+  if(m_arena && !m_arena->empty()) {
+    // Bound data is released, bindings must not refer to it anymore
+    for(int pos : m_arena->params()) sqlite3_bind_null(m_stmt.get(), pos);
+    m_arena->release();
+  }
+  return m_rc;
 }
 
 
@@ -241,10 +490,98 @@ int SqliteStmt::finalize()
   m_bindPos = 1;
   m_colPos = 0;
   m_stmt.reset(); // This eventually calls sqlite3_finalize() via Deleter
+  if(m_arena) m_arena->release();
   return 0;
 }
 
 
+// https://www.sqlite.org/c3ref/bind_blob.html
+int SqliteStmt::bind(int pos, std::string&& val)
+{
+  const string& s = arena().adopt(std::move(val));
+  m_arena->bound(pos);
+  return m_rc = sqlite3_bind_text(m_stmt.get(), pos, s.data(), s.length(), SQLITE_STATIC);
+}
+
+int SqliteStmt::bind(int pos, Blob_t&& val)
+{
+  const Blob_t& b = arena().adopt(std::move(val));
+  m_arena->bound(pos);
+  return m_rc = sqlite3_bind_blob(m_stmt.get(), pos, b.data(), b.size(), SQLITE_STATIC);
+}
+
+int SqliteStmt::bindCopy(int pos, std::string_view val)
+{
+  const uint8_t* p = arena().copy(val.data(), val.length());
+  m_arena->bound(pos);
+  return m_rc = sqlite3_bind_text(m_stmt.get(), pos, (const char*)p, val.length(), SQLITE_STATIC);
+}
+
+int SqliteStmt::bindCopy(int pos, std::span<const uint8_t> val)
+{
+  const uint8_t* p = arena().copy(val.data(), val.size());
+  m_arena->bound(pos);
+  return m_rc = sqlite3_bind_blob(m_stmt.get(), pos, p, val.size(), SQLITE_STATIC);
+}
+
+SqliteBindArena& SqliteStmt::arena()
+{
+  if(!m_arena) m_arena = make_unique<SqliteBindArena>();
+  return *m_arena;
+}
+
+
+//===================================================================================
+
+
+SqliteBindArena::SqliteBindArena(size_t chunkSize) : m_chunkSize{chunkSize}, m_used{chunkSize}, m_empty{true}
+{
+}
+
+const string& SqliteBindArena::adopt(string&& s)
+{
+  m_empty = false;
+  return m_strings.emplace_back(std::move(s));
+}
+
+const Blob_t& SqliteBindArena::adopt(Blob_t&& b)
+{
+  m_empty = false;
+  return m_blobs.emplace_back(std::move(b));
+}
+
+const uint8_t* SqliteBindArena::copy(const void* data, size_t n)
+{
+  m_empty = false;
+  uint8_t* p = nullptr;
+  if(n > m_chunkSize / 4) {
+    // Large values get a chunk of their own
+    p = m_large.emplace_back(make_unique_for_overwrite<uint8_t[]>(n)).get();
+  }
+  else {
+    if(m_used + n > m_chunkSize) {
+      m_chunks.push_back(make_unique_for_overwrite<uint8_t[]>(m_chunkSize));
+      m_used = 0;
+    }
+    p = m_chunks.back().get() + m_used;
+    m_used += n;
+  }
+  if(n) memcpy(p, data, n);
+  return p;
+}
+
+void SqliteBindArena::release()
+{
+  m_strings.clear();
+  m_blobs.clear();
+  m_large.clear();
+  m_params.clear();
+  if(m_chunks.size() > 1) m_chunks.resize(1); // Keep one chunk for reuse
+  m_used = m_chunks.empty() ? m_chunkSize : 0;
+  m_empty = true;
+}
+
+
 // Check if an error occurred in the last operation
 int SqliteStmt::checkError() const
 {
@@ -252,10 +589,10 @@ int SqliteStmt::checkError() const
     const char* emsg = sqlite3_errstr(m_rc);
     constexpr const char* fmt = "Sqlite rc={} {}";
     if(m_rc==SQLITE_ROW or m_rc==SQLITE_DONE) {
-      VLOG(2) << format(fmt, m_rc, emsg);
+      if constexpr (SqliteLoggingEnabled) VLOG(2) << format(fmt, m_rc, emsg);
     }
     else {
-      LOG(ERROR) << format(fmt, m_rc, emsg);
+      if constexpr (SqliteLoggingEnabled) LOG(ERROR) << format(fmt, m_rc, emsg);
       if(SqliteExceptionsEnabled && m_ex) throw std::runtime_error(emsg);
     }
   }
@@ -265,37 +602,73 @@ int SqliteStmt::checkError() const
 
 
 
-any SqliteStmt::column(int col)
+SqliteStmtProfile SqliteStmt::profile()
 {
-  int ct = sqlite3_column_type(m_stmt.get(), col);
+  SqliteStmtProfile p;
+  sqlite3_stmt* stmt = m_stmt.get();
+  if(!stmt) return p;
+  if(const char* sql = sqlite3_sql(stmt)) p.sql = sql;
+  p.fullscanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+  p.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+  p.autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+  p.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+  p.reprepares = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_REPREPARE, 0);
+  p.runs = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_RUN, 0);
+  p.memUsed = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_MEMUSED, 0);
+
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+  constexpr int flags = SQLITE_SCANSTAT_COMPLEX; // Every plan element, not only the loops
+  for(int i = 0; ; ++i) {
+    SqliteScanLoop l;
+    const char* explain = nullptr;
+    if(sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_EXPLAIN, flags, &explain)) break;
+    if(explain) l.explain = explain;
+    const char* name = nullptr;
+    sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NAME, flags, &name);
+    if(name) l.name = name;
+    sqlite3_int64 v = 0;
+    if(!sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NLOOP, flags, &v)) l.loops = v;
+    if(!sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NVISIT, flags, &v)) l.rowsVisited = v;
+    if(!sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_NCYCLE, flags, &v)) l.cycles = v;
+    sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_EST, flags, &l.rowsEstimated);
+    sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_SELECTID, flags, &l.selectId);
+    sqlite3_stmt_scanstatus_v2(stmt, i, SQLITE_SCANSTAT_PARENTID, flags, &l.parentId);
+    p.loops.push_back(std::move(l));
+  }
+#endif
+  return p;
+}
 
-  any val; 
-  switch(ct) { // Column type
-    case SQLITE_INTEGER: 
-      val = sqlite3_column_int(m_stmt.get(), col);
-      return val;
-    case SQLITE_FLOAT: 
-      val = sqlite3_column_double(m_stmt.get(), col);
-      return val;
-    case SQLITE_TEXT:
-      val = string{ (const char*) sqlite3_column_text(m_stmt.get(), col) };
-      return val;
-    case SQLITE_BLOB: 
-     {
-      uint8_t* ptr = (uint8_t*) sqlite3_column_blob(m_stmt.get(), col); 
-      int size = sqlite3_column_bytes(m_stmt.get(), col);
-      Blob_t blob(size);
-      for(int j=0; j<size; ++j) blob.at(j) = *(ptr+j);      
-      val = blob;
-      return val;
-     }
-    case SQLITE_NULL:
-    default:
-      return val; // Null value
+
+void SqliteStmt::resetProfile()
+{
+  sqlite3_stmt* stmt = m_stmt.get();
+  if(!stmt) return;
+  for(int op : {SQLITE_STMTSTATUS_FULLSCAN_STEP, SQLITE_STMTSTATUS_SORT, SQLITE_STMTSTATUS_AUTOINDEX,
+                SQLITE_STMTSTATUS_VM_STEP, SQLITE_STMTSTATUS_REPREPARE, SQLITE_STMTSTATUS_RUN}) {
+    sqlite3_stmt_status(stmt, op, 1);
   }
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+  sqlite3_stmt_scanstatus_reset(stmt);
+#endif
 }
 
 
+std::string SqliteStmtProfile::dump() const
+{
+  string out = format("{}\n  runs={} vm steps={} fullscan steps={} sorts={} autoindex rows={} reprepares={} mem={}\n",
+                      sql, runs, vmSteps, fullscanSteps, sorts, autoindexes, reprepares, memUsed);
+  for(const auto& l : loops) {
+    out += format("  [{}<{}] {:<40} loops={} rows={} est={:.1f}",
+                  l.selectId, l.parentId, l.explain, l.loops, l.rowsVisited, l.rowsEstimated);
+    if(l.cycles) out += format(" cycles={}", l.cycles);
+    out += '\n';
+  }
+  return out;
+}
+
+
+
 const char* SqliteStmt::columnTypeStr(int col)
 {
   int ct = sqlite3_column_type(m_stmt.get(), col);
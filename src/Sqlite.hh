@@ -15,40 +15,58 @@
 
 
 // Std
-#include <any>
+#include <list>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <string_view>
+#include <span>
 #include <cstring>
+#include <cstdint>
 #include <tuple>
+#include <variant>
+#include <ranges>
+#include <iterator>
+#include <utility>
+#include <type_traits>
 #include <exception>
 #include <stdexcept>
-#include <sstream>
 #include <source_location>
+#include <version>
+#if __has_include(<expected>)
+# include <expected>
+#endif
 // Prj
 #include <sqlite3.h>
 
 namespace MP {
 
 
+// Compile time switches, define as 0 to leave out exceptions or error logging
+#ifndef MP_SQLITE_EXCEPTIONS
+# define MP_SQLITE_EXCEPTIONS 1
+#endif
+#ifndef MP_SQLITE_LOGGING
+# define MP_SQLITE_LOGGING 1
+#endif
+
+
+// Contract failure reporting, kept out of line so that the checks stay cheap.
+// Throws std::runtime_error, or logs and aborts when exceptions are compiled out.
+[[noreturn]] void ContractFailure(const char* kind, const std::source_location& loc);
+
 // Adaptation of DBC facilities: Expects and Ensures
 inline void Expects(bool v, const std::source_location loc = std::source_location::current())
 {
-  if(!v) {
-    std::ostringstream os;
-    os << "Expect failure at " << loc.file_name() << '(' << loc.line() << ':' << loc.column() << ')' << loc.function_name();
-    throw std::runtime_error(os.str());
-  }
+  if(!v) [[unlikely]] ContractFailure("Expect", loc);
 }
 
 inline void Ensures(bool v, const std::source_location loc = std::source_location::current())
 {
-  if(!v) {
-    std::ostringstream os;
-    os << "Ensure failure at " << loc.file_name() << '(' << loc.line() << ':' << loc.column() << ')' << loc.function_name();
-    throw std::runtime_error(os.str());
-  }
+  if(!v) [[unlikely]] ContractFailure("Ensure", loc);
 }
 
 
@@ -60,31 +78,384 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
   typedef std::vector<uint8_t> Blob_t;
 
 
-  constexpr bool SqliteExceptionsEnabled = true;
+  class SqliteOwnedValue;
+
+  // Column value of any type without heap allocation.
+  // Text and blob values refer to the statement's row buffer and are valid until
+  // the next step(), reset() or finalize(); use owned() to keep them longer.
+  class SqliteValue
+  {
+    public:
+      typedef std::variant<std::nullptr_t, int64_t, double, std::string_view, std::span<const uint8_t>> Variant_t;
+
+    protected:
+      Variant_t m_v;
+
+    public:
+      SqliteValue() : m_v{nullptr} {}
+      SqliteValue(std::nullptr_t) : m_v{nullptr} {}
+      SqliteValue(int32_t v) : m_v{int64_t{v}} {}
+      SqliteValue(int64_t v) : m_v{v} {}
+      SqliteValue(double v) : m_v{v} {}
+      SqliteValue(std::string_view v) : m_v{v} {}
+      SqliteValue(std::span<const uint8_t> v) : m_v{v} {}
+
+      // Fundamental datatype as SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+      int type() const
+      {
+        constexpr int types[] = { SQLITE_NULL, SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB };
+        return types[m_v.index()];
+      }
+      bool isNull() const { return m_v.index() == 0; }
+
+      // Typed access, get() throws std::bad_variant_access on type mismatch
+      template <typename T> bool is() const { return std::holds_alternative<T>(m_v); }
+      template <typename T> const T& get() const { return std::get<T>(m_v); }
+      template <typename T> const T* getIf() const { return std::get_if<T>(&m_v); }
+
+      // Invoke f with the held alternative
+      template <typename F> decltype(auto) visit(F&& f) const { return std::visit(std::forward<F>(f), m_v); }
+
+      const Variant_t& variant() const { return m_v; }
+
+      // Copy into a value owning its text/blob data
+      inline SqliteOwnedValue owned() const;
+  };
+
+
+  // Column value of any type owning its text/blob data
+  class SqliteOwnedValue
+  {
+    public:
+      typedef std::variant<std::nullptr_t, int64_t, double, std::string, Blob_t> Variant_t;
+
+    protected:
+      Variant_t m_v;
+
+    public:
+      SqliteOwnedValue() : m_v{nullptr} {}
+      SqliteOwnedValue(Variant_t v) : m_v{std::move(v)} {}
+
+      int type() const { return view().type(); }
+      bool isNull() const { return m_v.index() == 0; }
+
+      template <typename T> bool is() const { return std::holds_alternative<T>(m_v); }
+      template <typename T> const T& get() const { return std::get<T>(m_v); }
+      template <typename T> const T* getIf() const { return std::get_if<T>(&m_v); }
+
+      template <typename F> decltype(auto) visit(F&& f) const { return std::visit(std::forward<F>(f), m_v); }
+
+      const Variant_t& variant() const { return m_v; }
+
+      // Non-owning view of this value
+      SqliteValue view() const
+      {
+        return visit([](const auto& v) -> SqliteValue {
+          if constexpr (std::is_same_v<std::decay_t<decltype(v)>, Blob_t>) return std::span<const uint8_t>(v);
+          else if constexpr (std::is_same_v<std::decay_t<decltype(v)>, std::string>) return std::string_view(v);
+          else return v;
+        });
+      }
+  };
+
+
+  inline SqliteOwnedValue SqliteValue::owned() const
+  {
+    return visit([](const auto& v) -> SqliteOwnedValue::Variant_t {
+      typedef std::decay_t<decltype(v)> T;
+      if constexpr (std::is_same_v<T, std::span<const uint8_t>>) return Blob_t(v.begin(), v.end());
+      else if constexpr (std::is_same_v<T, std::string_view>) return std::string(v);
+      else return v;
+    });
+  }
+
+
+  constexpr bool SqliteExceptionsEnabled = MP_SQLITE_EXCEPTIONS;
+  constexpr bool SqliteLoggingEnabled = MP_SQLITE_LOGGING;
   static inline bool SqliteEx = SqliteExceptionsEnabled;
 
-  // ================================= SqliteDb class ============================================
 
+  // ================================= SqliteResult ==============================================
+
+  // Trivially copyable SQLite error, the result code of the failed call
+  struct SqliteError
+  {
+    int rc{SQLITE_OK};
+
+    int primary() const { return rc & 0xff; }              // Primary result code
+    const char* str() const { return sqlite3_errstr(rc); } // English description, static storage
+
+    friend bool operator==(SqliteError, SqliteError) = default;
+  };
+
+
+  // Result of the no-throw try*() API: a value or a SqliteError.
+  // std::expected when the library provides it, a minimal look-alike otherwise.
+#if defined(__cpp_lib_expected) && (__cpp_lib_expected >= 202202L)
+  template <typename T>
+  using SqliteResult = std::expected<T, SqliteError>;
+
+  inline std::unexpected<SqliteError> SqliteFailure(int rc) noexcept
+  { return std::unexpected<SqliteError>(SqliteError{rc}); }
+#else
+  struct SqliteUnexpected { SqliteError err; };
+
+  inline SqliteUnexpected SqliteFailure(int rc) noexcept
+  { return SqliteUnexpected{SqliteError{rc}}; }
+
+  template <typename T>
+  class SqliteResult
+  {
+    protected:
+      std::variant<T, SqliteError> m_v;
+
+    public:
+      SqliteResult() : m_v{std::in_place_index<0>} {}
+      SqliteResult(const T& v) : m_v{std::in_place_index<0>, v} {}
+      SqliteResult(T&& v) : m_v{std::in_place_index<0>, std::move(v)} {}
+      SqliteResult(SqliteUnexpected u) noexcept : m_v{std::in_place_index<1>, u.err} {}
+
+      bool has_value() const noexcept { return m_v.index() == 0; }
+      explicit operator bool() const noexcept { return has_value(); }
+
+      T& value() & { Ensures(has_value()); return *std::get_if<0>(&m_v); }
+      const T& value() const & { Ensures(has_value()); return *std::get_if<0>(&m_v); }
+      T&& value() && { Ensures(has_value()); return std::move(*std::get_if<0>(&m_v)); }
+
+      T& operator*() & noexcept { return *std::get_if<0>(&m_v); }
+      const T& operator*() const & noexcept { return *std::get_if<0>(&m_v); }
+      T* operator->() noexcept { return std::get_if<0>(&m_v); }
+      const T* operator->() const noexcept { return std::get_if<0>(&m_v); }
+
+      SqliteError error() const noexcept { return has_value() ? SqliteError{} : *std::get_if<1>(&m_v); }
+  };
+
+  template <>
+  class SqliteResult<void>
+  {
+    protected:
+      SqliteError m_err;
+
+    public:
+      SqliteResult() noexcept : m_err{} {}
+      SqliteResult(SqliteUnexpected u) noexcept : m_err{u.err} {}
+
+      bool has_value() const noexcept { return m_err.rc == SQLITE_OK; }
+      explicit operator bool() const noexcept { return has_value(); }
+      void value() const { Ensures(has_value()); }
+      SqliteError error() const noexcept { return m_err; }
+  };
+#endif
+
+  // ================================= SqliteStmtCache class =======================================
+
+  // Counters of the prepared statement cache
+  struct SqliteStmtCacheStats
+  {
+    uint64_t hits{0};      // Lookups served by a parked statement
+    uint64_t misses{0};    // Lookups that had to prepare a new statement
+    uint64_t evictions{0}; // Statements finalized to respect the capacity
+    size_t size{0};        // Statements currently parked in the cache
+    size_t capacity{0};    // Maximum number of parked statements
+  };
+
+
+  // Memory use of one connection, from sqlite3_db_status()
+  struct SqliteDbMemoryStats
+  {
+    int cacheUsed{0};          // Page cache bytes
+    int schemaUsed{0};         // Schema bytes
+    int stmtUsed{0};           // Prepared statement bytes
+    int lookasideUsed{0};      // Lookaside slots in use
+    int lookasideHit{0};       // Allocations served by lookaside (high water)
+    int lookasideMissSize{0};  // Allocations too large for lookaside
+    int lookasideMissFull{0};  // Allocations made while lookaside was full
+    int cacheHit{0};           // Page cache hits
+    int cacheMiss{0};          // Page cache misses
+    int cacheWrite{0};         // Pages written
+    int cacheSpill{0};         // Dirty pages spilled mid-transaction
+  };
+
+
+  // One loop of a query plan, from sqlite3_stmt_scanstatus_v2()
+  struct SqliteScanLoop
+  {
+    std::string explain;     // EXPLAIN QUERY PLAN text of the loop
+    std::string name;        // Table or index scanned, empty for other plan elements
+    int64_t loops{0};        // Times the loop was started
+    int64_t rowsVisited{0};  // Rows visited over all runs of the loop
+    double rowsEstimated{0}; // Planner estimate of rows visited per start of the outer loop
+    int64_t cycles{0};       // CPU cycles, when SQLite counts them
+    int selectId{0};
+    int parentId{0};
+  };
+
+
+  // Counters of one prepared statement, see SqliteStmt::profile()
+  struct SqliteStmtProfile
+  {
+    std::string sql;
+    int fullscanSteps{0};  // Forward steps of full table scans, high values hint at a missing index
+    int sorts{0};          // Sort operations
+    int autoindexes{0};    // Rows inserted into automatic indexes, built again on every run
+    int vmSteps{0};        // Virtual machine operations
+    int reprepares{0};     // Automatic re-preparations after schema changes
+    int runs{0};           // Times the statement ran
+    int memUsed{0};        // Bytes used by the statement
+    std::vector<SqliteScanLoop> loops; // Only with SQLITE_ENABLE_STMT_SCANSTATUS
+
+    // Multi-line report, one line per loop
+    std::string dump() const;
+  };
+
+
+  // Per-connection LRU cache of prepared statements keyed by SQL text.
+  // Statements are checked out while in use and checked back in (reset and
+  // with their bindings cleared) when the owning SqliteStmt releases them.
+  // Cached statements are prepared with SQLITE_PREPARE_PERSISTENT.
+  class SqliteStmtCache : public std::enable_shared_from_this<SqliteStmtCache>
+  {
+    public:
+      struct Entry {
+        std::string sql;    // SQL text used as the key
+        sqlite3_stmt* stmt; // Prepared statement handle
+      };
+      typedef std::list<Entry>::iterator Ticket;
+
+      static constexpr size_t DefaultCapacity = 32;
+
+    protected:
+      sqlite3* m_dbh;         // Connection the statements belong to (not owned)
+      size_t m_capacity;      // Maximum number of parked statements
+      std::list<Entry> m_lru; // Parked statements, most recently used first
+      std::list<Entry> m_out; // Statements checked out by SqliteStmt instances
+      std::unordered_map<std::string_view, Ticket> m_index; // SQL text -> parked entry
+      SqliteStmtCacheStats m_stats;
+      mutable std::mutex m_mtx;
+
+    public:
+      // CREATORS
+      SqliteStmtCache(sqlite3* dbh, size_t capacity = DefaultCapacity);
+      ~SqliteStmtCache(); // Finalizes the parked statements
+
+      // ACCESSORS
+      size_t capacity() const;
+      SqliteStmtCacheStats stats() const;
+
+      // MODIFIERS
+      // Check out the statement for sql, preparing it on a miss. Returns the sqlite3_prepare_v3() rc.
+      int checkout(std::string_view sql, sqlite3_stmt*& stmt, Ticket& ticket);
+
+      // Return a checked out statement; it is reset and parked or finalized if over capacity
+      void checkin(Ticket ticket);
+
+      // Change the capacity, evicting least recently used statements as needed. 0 disables caching.
+      void capacity(size_t n);
+
+      // Finalize all parked statements
+      void clear();
+
+    private:
+      void evict(size_t keep); // Requires m_mtx held
+
+  }; // class
+
+
+  // Deleter for sqlite3_stmt handles.
+  // Statements checked out of a SqliteStmtCache are returned to it, others are finalized.
+  struct SqliteStmtReleaser
+  {
+    std::weak_ptr<SqliteStmtCache> cache; // Owning cache, empty for uncached statements
+    SqliteStmtCache::Ticket ticket;       // Cache entry of the statement
+
+    void operator()(sqlite3_stmt* stmt) const;
+  };
 
-  // Custom deleter for sqlite3 shared_ptr objects
+
+  // ================================= SqliteBindArena class =======================================
+
+  // Owns text/blob data bound to a statement until the statement is reset.
+  // Moved-in strings and blobs are adopted without copying their buffers,
+  // other data is copied into bump-allocated chunks, avoiding a malloc per value.
+  class SqliteBindArena
+  {
+    protected:
+      std::deque<std::string> m_strings; // Adopted strings (deque keeps elements in place)
+      std::deque<Blob_t> m_blobs;        // Adopted blobs
+      std::vector<std::unique_ptr<uint8_t[]>> m_chunks; // Bump allocation chunks
+      std::vector<std::unique_ptr<uint8_t[]>> m_large;  // Dedicated chunks of large values
+      std::vector<int> m_params; // Statement parameters bound to the stored data
+      size_t m_chunkSize; // Size of bump allocation chunks
+      size_t m_used;      // Bytes used in the last chunk
+      bool m_empty;       // Nothing has been stored since the last release()
+
+    public:
+      static constexpr size_t DefaultChunkSize = 4096;
+
+      // CREATORS
+      explicit SqliteBindArena(size_t chunkSize = DefaultChunkSize);
+
+      // ACCESSORS
+      bool empty() const { return m_empty; }
+      const std::vector<int>& params() const { return m_params; }
+
+      // MODIFIERS
+      const std::string& adopt(std::string&& s);
+      const Blob_t& adopt(Blob_t&& b);
+
+      // Copy n bytes into the arena, returns the copy
+      const uint8_t* copy(const void* data, size_t n);
+
+      // Parameter pos was bound to data of the arena
+      void bound(int pos) { m_params.push_back(pos); }
+
+      // Drop all stored data, the first chunk is kept for reuse
+      void release();
+  };
+
+
+  // ================================= SqliteStmt class ============================================
+
+
+  // Custom deleter for sqlite3_stmt handles
   void Sqlite3StmtDeleter(sqlite3_stmt* stmt);
 
+  template <typename... Ts> class SqliteRows;
+  class SqliteColumnBatch;
+
+  class SqliteStmt;
+  // Opt-in shared ownership of a statement, see SqliteStmt::share()
+  typedef std::shared_ptr<SqliteStmt> SqliteSharedStmt;
+
   // Sqlite3 Statement handle/holder
   // https://www.sqlite.org/c3ref/stmt.html
+  // Move-only, a statement has a single owner. Use share() to opt in to shared ownership.
   class SqliteStmt
   {
     protected:
-      std::shared_ptr<sqlite3_stmt> m_stmt; // Shared ptr to the statement handle      
+      // Declared first so move assignment releases the old statement before freeing its arena
+      std::unique_ptr<sqlite3_stmt, SqliteStmtReleaser> m_stmt; // Owned statement handle
+      std::unique_ptr<SqliteBindArena> m_arena; // Data owned by the bindings, created on demand
       int m_bindPos;     // Bind ordinal to use during bind() operations  1-based
       int m_colPos;      // Column ordinal to use during column() operations 0-based
+      bool m_done;       // fetchBatch() reached the last row or an error, until reset()
       mutable int m_rc;  // Return code from the last operation
       mutable bool m_ex; // Exceptions enabled?
 
+      // Shared body of reset() and tryReset(), returns the sqlite3_reset() code
+      int resetState() noexcept;
+
     public:
       // CREATORS
       SqliteStmt(sqlite3_stmt* stmt = nullptr); // Takes ownership of the given pointer
+      SqliteStmt(sqlite3_stmt* stmt, SqliteStmtReleaser releaser); // Releases the pointer via releaser
+      SqliteStmt(SqliteStmt&&) = default;
+      SqliteStmt& operator=(SqliteStmt&&) = default;
       ~SqliteStmt();
 
+      // Move this statement into a shared, reference counted holder
+      SqliteSharedStmt share() && { return std::make_shared<SqliteStmt>(std::move(*this)); }
+
       // ACCESSORS
       // Access the sqlite3 statement handle
       sqlite3_stmt* get() { return m_stmt.get(); }
@@ -108,6 +479,21 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
       int bind(int pos, const T t);
       template <typename T>
       int bindref(int pos, const T& t);
+      // Bind any supported type, dispatching to bind() or bindref()
+      template <typename T>
+      inline int bindValue(int pos, const T& t);
+
+      // Bind by taking over the buffer; the statement owns it until reset()/finalize()
+      int bind(int pos, std::string&& val);
+      int bind(int pos, Blob_t&& val);
+
+      // Bind a copy held in the statement's bind arena until reset()/finalize().
+      // Cheaper than SQLITE_TRANSIENT which makes SQLite malloc each value.
+      int bindCopy(int pos, std::string_view val);
+      int bindCopy(int pos, std::span<const uint8_t> val);
+
+      // Arena owning the data of the above binds
+      SqliteBindArena& arena();
       
       // Bind to a tuple by value
       template <typename... Args>
@@ -130,6 +516,32 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
       // Postfix ++, shorthand for step() but to be used in loops
       bool operator++(int); 
 
+      // No-throw, no-logging variants: true on SQLITE_ROW, false on SQLITE_DONE
+      inline SqliteResult<bool> tryStep() noexcept
+      {
+        m_colPos = 0;
+        int rc = m_rc = sqlite3_step(m_stmt.get());
+        if(rc == SQLITE_ROW) [[likely]] return true;
+        if(rc == SQLITE_DONE) return false;
+        return SqliteFailure(rc);
+      }
+
+      template <typename T>
+      inline SqliteResult<void> tryBind(int pos, const T& t) noexcept
+      {
+        int rc = bindValue(pos, t);
+        if(rc != SQLITE_OK) [[unlikely]] return SqliteFailure(rc);
+        return {};
+      }
+
+      // Same as reset(), without throwing or logging
+      inline SqliteResult<void> tryReset() noexcept
+      {
+        int rc = resetState();
+        if(rc != SQLITE_OK) [[unlikely]] return SqliteFailure(rc);
+        return {};
+      }
+
 
       // Get number of columns available
       int columnCount()
@@ -167,26 +579,57 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
         args = * static_cast<std::tuple<Args...>*>(bptr); // Copy blob data it to the tuple
       }
 
-      // Return column of any type
-      std::any column(int col);      
+      // Return column of any type, text and blob values are views into the row
+      inline SqliteValue column(int col);
+
+      // Zero-copy views into the current row of the given column.
+      // Valid until the next step(), reset() or finalize() on this statement.
+      inline std::string_view columnText(int col);
+      inline std::span<const uint8_t> columnBlob(int col);
+
 
+      // Input range over the remaining rows, each decoded into a std::tuple<Ts...>
+      // from columns 0..sizeof...(Ts)-1. Bind parameters before calling.
+      template <typename... Ts>
+      SqliteRows<Ts...> rows();
+
+      // Step up to maxRows rows into the column buffers of batch, which is cleared first.
+      // Returns the number of rows fetched, fewer than maxRows once the statement is done
+      // and 0 from then on until reset().
+      // Defined in SqliteBatch.cc
+      size_t fetchBatch(SqliteColumnBatch& batch, size_t maxRows);
 
       // at() is synonym for column()
       template <typename T>
       inline void at(int col, T& t) { column(col, t); }
 
       // Reset the statement back to initial state, ready to be executed again.
+      // If the bind arena holds data, it is released and the parameters bound to it are
+      // set to NULL. Other bindings are kept.
       int reset();
 
       // Finalizes the statement, deleting the managed statement handle.
+      // Cached statements are returned to their cache instead.
       int finalize();
 
       // Check if an error occurred in the last operation
       int checkError() const;
 
+      // Status counters of this statement, accumulated since it was prepared or last reset
+      SqliteStmtProfile profile();
+      // Zero the profile() counters, except memUsed
+      void resetProfile();
+
       // << operator is a shorthand for bind()
       template <typename T> friend inline SqliteStmt& operator<<(SqliteStmt& stmt, const T& t)
-      { stmt.m_rc = stmt.bind(stmt.m_bindPos++, t); Ensures(stmt.m_rc == SQLITE_OK); return stmt; }
+      { stmt.m_rc = stmt.bindValue(stmt.m_bindPos++, t); Ensures(stmt.m_rc == SQLITE_OK); return stmt; }
+
+      // Temporaries are moved into the statement, see bind(int, std::string&&)
+      friend inline SqliteStmt& operator<<(SqliteStmt& stmt, std::string&& t)
+      { stmt.m_rc = stmt.bind(stmt.m_bindPos++, std::move(t)); Ensures(stmt.m_rc == SQLITE_OK); return stmt; }
+
+      friend inline SqliteStmt& operator<<(SqliteStmt& stmt, Blob_t&& t)
+      { stmt.m_rc = stmt.bind(stmt.m_bindPos++, std::move(t)); Ensures(stmt.m_rc == SQLITE_OK); return stmt; }
 
       // >> operator is a shorthand for column()
       template <typename T> friend inline SqliteStmt& operator>>(SqliteStmt& stmt, T& t)
@@ -199,6 +642,8 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
   // bind() group
   // Binds input parameters to a prepared statement
   // 1-based ordinals
+  // Text and blobs are bound with SQLITE_STATIC (nullptr) and must outlive the binding,
+  // use the std::string&&/Blob_t&& overloads or bindCopy() for temporaries.
   template <> inline int SqliteStmt::bind(int i, const int32_t val)
   { return m_rc = sqlite3_bind_int(m_stmt.get(), i, val); }
 
@@ -224,6 +669,14 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
   { return m_rc = sqlite3_bind_blob(m_stmt.get(), i, v.data(), v.size(), nullptr); }
 
 
+  template <typename T> inline int SqliteStmt::bindValue(int i, const T& v)
+  {
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, Blob_t>) return bindref(i, v);
+    else if constexpr (std::is_array_v<T>) return bind<const char*>(i, v);
+    else return bind<T>(i, v);
+  }
+
+
   //
   // column() group
   // Extracts output from the executed (stepped) statements
@@ -237,29 +690,135 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
   template <> inline void SqliteStmt::column(int i, double& v)
   { v = sqlite3_column_double(m_stmt.get(), i); }
 
+  // sqlite3_column_text/blob() must be called before sqlite3_column_bytes()
+  // https://www.sqlite.org/c3ref/column_blob.html
+  template <> inline void SqliteStmt::column(int i, std::string_view& v) {
+    const char* ptr = (const char*) sqlite3_column_text(m_stmt.get(), i);
+    v = ptr ? std::string_view(ptr, sqlite3_column_bytes(m_stmt.get(), i)) : std::string_view{};
+  }
+
+  template <> inline void SqliteStmt::column(int i, std::span<const uint8_t>& v) {
+    const uint8_t* ptr = (const uint8_t*) sqlite3_column_blob(m_stmt.get(), i);
+    v = ptr ? std::span<const uint8_t>(ptr, sqlite3_column_bytes(m_stmt.get(), i)) : std::span<const uint8_t>{};
+  }
+
   template <> inline void SqliteStmt::column(int i, std::string& v)
-  { v = (const char*)sqlite3_column_text(m_stmt.get(), i); }
+  { std::string_view sv; column(i, sv); v.assign(sv); }
 
   template <> inline void SqliteStmt::column(int i, Blob_t& v) { 
-    uint8_t* ptr = (uint8_t*) sqlite3_column_blob(m_stmt.get(), i); 
-    Ensures(ptr); // Must be a non-null ptr
-    int size = sqlite3_column_bytes(m_stmt.get(), i);
-    v.resize(size);
-    for(int j=0; j<size; ++j) v.at(j) = *(ptr+j);
-    // Consider memcpy() here
+    std::span<const uint8_t> sp; column(i, sp);
+    Ensures(sp.data()); // Must be a non-null ptr
+    v.assign(sp.begin(), sp.end());
+  }
+
+  inline SqliteValue SqliteStmt::column(int col)
+  {
+    switch(sqlite3_column_type(m_stmt.get(), col)) { // Column type
+      case SQLITE_INTEGER: return SqliteValue{ static_cast<int64_t>(sqlite3_column_int64(m_stmt.get(), col)) };
+      case SQLITE_FLOAT:   return SqliteValue{ sqlite3_column_double(m_stmt.get(), col) };
+      case SQLITE_TEXT:    return SqliteValue{ columnText(col) };
+      case SQLITE_BLOB:    return SqliteValue{ columnBlob(col) };
+      case SQLITE_NULL:
+      default:
+        return SqliteValue{}; // Null value
+    }
   }
 
+  inline std::string_view SqliteStmt::columnText(int col)
+  { std::string_view v; column(col, v); return v; }
+
+  inline std::span<const uint8_t> SqliteStmt::columnBlob(int col)
+  { std::span<const uint8_t> v; column(col, v); return v; }
+
+
+  // ================================= SqliteRows class ==========================================
+
+  // Input range (view) over the rows of a SqliteStmt.
+  // Each row is decoded into a std::tuple<Ts...> with column indices fixed at compile time.
+  // Like std::ranges::istream_view, begin() steps to the first row and the iterators refer
+  // back to the view which holds the current row, so no per-row allocation takes place.
+  template <typename... Ts>
+  class SqliteRows : public std::ranges::view_interface<SqliteRows<Ts...>>
+  {
+    public:
+      typedef std::tuple<Ts...> Row_t;
+
+      class iterator
+      {
+        public:
+          using iterator_concept = std::input_iterator_tag;
+          using value_type = Row_t;
+          using difference_type = std::ptrdiff_t;
+
+          iterator() = default;
+          explicit iterator(SqliteRows* rows) : m_rows{rows} {}
+
+          const Row_t& operator*() const { return m_rows->m_row; }
+          iterator& operator++() { m_rows->next(); return *this; }
+          void operator++(int) { m_rows->next(); }
+
+          friend bool operator==(const iterator& it, std::default_sentinel_t)
+          { return it.atEnd(); }
+
+        private:
+          bool atEnd() const { return m_rows == nullptr || m_rows->m_done; }
+
+          SqliteRows* m_rows{nullptr};
+      };
+
+    protected:
+      SqliteStmt* m_stmt; // Statement being stepped (not owned)
+      Row_t m_row;        // Current row
+      bool m_done;        // No more rows
+
+    public:
+      explicit SqliteRows(SqliteStmt& stmt) : m_stmt{&stmt}, m_row{}, m_done{false} {}
+
+      iterator begin() { next(); return iterator{this}; }
+      std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+      void next()
+      {
+        m_done = !(*m_stmt)++;
+        if(!m_done) decode(std::index_sequence_for<Ts...>{});
+      }
+
+      template <std::size_t... Is>
+      void decode(std::index_sequence<Is...>)
+      { (m_stmt->column(static_cast<int>(Is), std::get<Is>(m_row)), ...); }
+
+  }; // class
+
+
+  template <typename... Ts>
+  inline SqliteRows<Ts...> SqliteStmt::rows()
+  { return SqliteRows<Ts...>(*this); }
+
 
   // ================================= SqliteDb class ============================================
 
-  // Custom deleter for sqlite3 shared_ptr objects
+  // Custom deleter for sqlite3 handles
   void Sqlite3Deleter(sqlite3* dbh);
 
+  struct SqliteDbCloser
+  {
+    void operator()(sqlite3* dbh) const { Sqlite3Deleter(dbh); }
+  };
+
+  class SqliteDb;
+  class SqliteTracer;
+  // Opt-in shared ownership of a database connection, see SqliteDb::share()
+  typedef std::shared_ptr<SqliteDb> SqliteSharedDb;
+
   // Sqlite3 Db handle/session holder
+  // Move-only, a connection has a single owner. Use share() to opt in to shared ownership.
   class SqliteDb
   {
     protected:
-      std::shared_ptr<sqlite3> m_dbh; // Shared ptr to the db handle
+      std::shared_ptr<SqliteTracer> m_tracer; // Statement tracer, outlives m_dbh
+      std::unique_ptr<sqlite3, SqliteDbCloser> m_dbh; // Owned db handle
+      std::shared_ptr<SqliteStmtCache> m_cache; // Prepared statement cache, destroyed before m_dbh
       std::string m_filename; // Filename of the database
       int m_flags;            // Opening flags
       mutable int m_rc;       // Return code from the last operation
@@ -268,9 +827,16 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
     public:
       // CREATORS
       SqliteDb();
-      SqliteDb(std::string_view filename, int flags = SQLITE_OPEN_READWRITE);
+      // vfs names a registered VFS, e.g. SqliteUringVfsOptions::name, empty for the default
+      SqliteDb(std::string_view filename, int flags = SQLITE_OPEN_READWRITE, std::string_view vfs = {});
+      SqliteDb(SqliteDb&&) = default;
+      // Closes the current connection before its tracer is released
+      SqliteDb& operator=(SqliteDb&& other) noexcept;
       ~SqliteDb();
 
+      // Move this connection into a shared, reference counted holder
+      SqliteSharedDb share() && { return std::make_shared<SqliteDb>(std::move(*this)); }
+
       // ACCESSORS
       // Access the sqlite3/database handle
       sqlite3* get() const { return m_dbh.get(); }
@@ -307,6 +873,30 @@ inline void Ensures(bool v, const std::source_location loc = std::source_locatio
       // An alternate form for the prepare()
       SqliteStmt stmt(std::string_view sqlStr);
 
+      // No-throw, no-logging form of stmt()
+      SqliteResult<SqliteStmt> tryPrepare(std::string_view sqlStr) noexcept;
+
+      // Obtain the SqliteStmt for sqlStr from the statement cache, preparing it on a miss.
+      // The statement goes back to the cache when the returned SqliteStmt releases it.
+      SqliteStmt cached(std::string_view sqlStr);
+
+      // Statement cache capacity, 0 disables caching
+      size_t cacheCapacity() const;
+      void cacheCapacity(size_t n);
+
+      // Statement cache hit/miss/eviction counters
+      SqliteStmtCacheStats cacheStats() const;
+
+      // Memory and page cache accounting of this connection
+      SqliteDbMemoryStats memoryStats() const;
+
+      // Statement tracer in use, nullptr if tracing is off
+      const std::shared_ptr<SqliteTracer>& tracer() const { return m_tracer; }
+
+      // Report the latency of every statement run to tracer, which may be shared with other
+      // connections. nullptr turns tracing off and removes the trace callback.
+      int trace(std::shared_ptr<SqliteTracer> tracer);
+
 
     
       // STATIC MEMBERS
@@ -0,0 +1,332 @@
+
+#include "SqliteAlloc.hh"
+// Std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+
+
+using namespace std;
+
+namespace MP {
+
+
+namespace {
+
+constexpr size_t ClassSizes[] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096 };
+constexpr int NClasses = std::size(ClassSizes);
+constexpr int Large = NClasses;          // Class index of malloc() allocations
+constexpr size_t MaxSmall = ClassSizes[NClasses - 1];
+constexpr size_t SlabBytes = 64 * 1024;  // Carved into blocks of one class
+constexpr uint32_t Batch = 32;           // Blocks moved between thread and central lists at once
+constexpr uint32_t MaxCached = 4 * Batch; // Thread list length that triggers a drain
+
+// In front of every allocation, keeps user memory 16 byte aligned
+struct Header
+{
+  uint64_t size; // Usable size
+  uint32_t cls;  // Size class, Large for malloc()
+  uint32_t pad;
+};
+static_assert(sizeof(Header) == 16);
+
+// Free blocks are linked through their first bytes
+struct FreeBlock
+{
+  FreeBlock* next;
+};
+
+// Size class of every size up to MaxSmall, by 16 byte steps
+constexpr auto ClassTable = [] {
+  std::array<uint8_t, MaxSmall / 16 + 1> t{};
+  int c = 0;
+  for(size_t i = 0; i < t.size(); ++i) {
+    while(ClassSizes[c] < i * 16) ++c;
+    t[i] = static_cast<uint8_t>(c);
+  }
+  return t;
+}();
+
+inline int ClassOf(size_t n)
+{
+  return n > MaxSmall ? Large : ClassTable[(n + 15) / 16];
+}
+
+// Relaxed counter bump by its only writer, readable from other threads
+inline void Bump(std::atomic<uint64_t>& a, uint64_t n = 1)
+{
+  a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+
+struct Central
+{
+  mutex mtx;
+  FreeBlock* head{nullptr};
+};
+
+struct ThreadCache
+{
+  FreeBlock* head[NClasses]{};
+  uint32_t count[NClasses]{};
+  std::atomic<uint64_t> allocs[NClasses + 1]{};
+  std::atomic<uint64_t> hits[NClasses]{};
+  std::atomic<uint64_t> frees[NClasses + 1]{};
+};
+
+Central s_central[NClasses];
+std::atomic<uint64_t> s_slabBytes{0};
+
+// Live thread caches and the counters of finished threads
+mutex s_regMtx;
+vector<ThreadCache*> s_caches;
+uint64_t s_retiredAllocs[NClasses + 1]{};
+uint64_t s_retiredHits[NClasses]{};
+uint64_t s_retiredFrees[NClasses + 1]{};
+
+thread_local ThreadCache* t_cache = nullptr;
+thread_local bool t_exiting = false;
+
+
+// Move up to n blocks of class c from list to the central list
+void Drain(int c, FreeBlock*& list, uint32_t& count, uint32_t n)
+{
+  if(!list) return;
+  FreeBlock* first = list;
+  FreeBlock* last = list;
+  uint32_t moved = 1;
+  while(moved < n && last->next) { last = last->next; ++moved; }
+  list = last->next;
+  count -= moved;
+
+  lock_guard<mutex> lock(s_central[c].mtx);
+  last->next = s_central[c].head;
+  s_central[c].head = first;
+}
+
+
+// Returns the thread's blocks and counters when the thread ends
+struct CacheOwner
+{
+  ~CacheOwner()
+  {
+    ThreadCache* tc = t_cache;
+    t_exiting = true;
+    t_cache = nullptr;
+    if(!tc) return;
+    for(int c = 0; c < NClasses; ++c) Drain(c, tc->head[c], tc->count[c], UINT32_MAX);
+
+    lock_guard<mutex> lock(s_regMtx);
+    for(int c = 0; c <= NClasses; ++c) {
+      s_retiredAllocs[c] += tc->allocs[c].load(memory_order_relaxed);
+      s_retiredFrees[c] += tc->frees[c].load(memory_order_relaxed);
+      if(c < NClasses) s_retiredHits[c] += tc->hits[c].load(memory_order_relaxed);
+    }
+    s_caches.erase(std::find(s_caches.begin(), s_caches.end(), tc));
+    delete tc;
+  }
+};
+
+
+// The calling thread's cache, nullptr while the thread is exiting
+ThreadCache* Cache()
+{
+  if(t_cache) [[likely]] return t_cache;
+  if(t_exiting) return nullptr;
+  thread_local CacheOwner owner;
+  auto tc = new ThreadCache;
+  {
+    lock_guard<mutex> lock(s_regMtx);
+    s_caches.push_back(tc);
+  }
+  t_cache = tc;
+  return tc;
+}
+
+
+// Take a batch of class c blocks from the central list, carving a new slab if it is empty.
+// Returns one block, the rest go to tc.
+FreeBlock* Refill(ThreadCache* tc, int c)
+{
+  Central& central = s_central[c];
+  lock_guard<mutex> lock(central.mtx);
+  if(!central.head) {
+    size_t block = sizeof(Header) + ClassSizes[c];
+    size_t n = std::max<size_t>(SlabBytes / block, Batch);
+    auto slab = static_cast<uint8_t*>(malloc(n * block));
+    if(!slab) return nullptr;
+    s_slabBytes.fetch_add(n * block, memory_order_relaxed);
+    for(size_t i = n; i-- > 0; ) {
+      auto b = reinterpret_cast<FreeBlock*>(slab + i * block);
+      b->next = central.head;
+      central.head = b;
+    }
+  }
+
+  FreeBlock* b = central.head;
+  central.head = b->next;
+  if(tc) {
+    for(uint32_t i = 1; i < Batch && central.head; ++i) {
+      FreeBlock* m = central.head;
+      central.head = m->next;
+      m->next = tc->head[c];
+      tc->head[c] = m;
+      tc->count[c]++;
+    }
+  }
+  return b;
+}
+
+
+void* PoolMalloc(int n)
+{
+  int c = ClassOf(static_cast<size_t>(n));
+  ThreadCache* tc = Cache();
+  Header* h;
+  if(c == Large) {
+    h = static_cast<Header*>(malloc(sizeof(Header) + n));
+    if(!h) return nullptr;
+    h->size = static_cast<uint64_t>(n);
+  }
+  else {
+    FreeBlock* b = tc ? tc->head[c] : nullptr;
+    if(b) [[likely]] {
+      tc->head[c] = b->next;
+      tc->count[c]--;
+      Bump(tc->hits[c]);
+    }
+    else {
+      b = Refill(tc, c);
+      if(!b) return nullptr;
+    }
+    h = reinterpret_cast<Header*>(b);
+    h->size = ClassSizes[c];
+  }
+  h->cls = static_cast<uint32_t>(c);
+  if(tc) Bump(tc->allocs[c]);
+  return h + 1;
+}
+
+
+void PoolFree(void* p)
+{
+  if(!p) return;
+  Header* h = static_cast<Header*>(p) - 1;
+  int c = static_cast<int>(h->cls);
+  ThreadCache* tc = Cache();
+  if(tc) Bump(tc->frees[c]);
+  if(c == Large) {
+    free(h);
+    return;
+  }
+
+  auto b = reinterpret_cast<FreeBlock*>(h);
+  if(!tc) {
+    lock_guard<mutex> lock(s_central[c].mtx);
+    b->next = s_central[c].head;
+    s_central[c].head = b;
+    return;
+  }
+  b->next = tc->head[c];
+  tc->head[c] = b;
+  if(++tc->count[c] > MaxCached) [[unlikely]] Drain(c, tc->head[c], tc->count[c], Batch * 2);
+}
+
+
+void* PoolRealloc(void* p, int n)
+{
+  if(!p) return PoolMalloc(n);
+  Header* h = static_cast<Header*>(p) - 1;
+  if(h->cls != Large && static_cast<size_t>(n) <= h->size) return p; // Fits its block
+  if(h->cls == Large && n > static_cast<int>(MaxSmall)) {
+    auto nh = static_cast<Header*>(realloc(h, sizeof(Header) + n));
+    if(!nh) return nullptr;
+    nh->size = static_cast<uint64_t>(n);
+    return nh + 1;
+  }
+  void* q = PoolMalloc(n);
+  if(!q) return nullptr;
+  memcpy(q, p, std::min<size_t>(h->size, static_cast<size_t>(n)));
+  PoolFree(p);
+  return q;
+}
+
+
+int PoolSize(void* p)
+{
+  return p ? static_cast<int>((static_cast<Header*>(p) - 1)->size) : 0;
+}
+
+
+int PoolRoundup(int n)
+{
+  int c = ClassOf(static_cast<size_t>(n));
+  return c == Large ? (n + 15) & ~15 : static_cast<int>(ClassSizes[c]);
+}
+
+
+int PoolInit(void*) { return SQLITE_OK; }
+void PoolShutdown(void*) {}
+
+
+const sqlite3_mem_methods s_methods = {
+  PoolMalloc, PoolFree, PoolRealloc, PoolSize, PoolRoundup, PoolInit, PoolShutdown, nullptr
+};
+
+} // namespace
+
+
+const sqlite3_mem_methods* SqlitePoolAllocator::Methods()
+{
+  return &s_methods;
+}
+
+
+SqliteAllocStats SqlitePoolAllocator::Stats()
+{
+  SqliteAllocStats st;
+  st.classes.resize(NClasses + 1);
+  lock_guard<mutex> lock(s_regMtx);
+  for(int c = 0; c <= NClasses; ++c) {
+    auto& cs = st.classes[c];
+    cs.size = c < NClasses ? ClassSizes[c] : 0;
+    cs.allocs = s_retiredAllocs[c];
+    cs.frees = s_retiredFrees[c];
+    cs.hits = c < NClasses ? s_retiredHits[c] : 0;
+    for(ThreadCache* tc : s_caches) {
+      cs.allocs += tc->allocs[c].load(memory_order_relaxed);
+      cs.frees += tc->frees[c].load(memory_order_relaxed);
+      if(c < NClasses) cs.hits += tc->hits[c].load(memory_order_relaxed);
+    }
+  }
+  st.slabBytes = s_slabBytes.load(memory_order_relaxed);
+  return st;
+}
+
+
+std::string SqliteAllocStats::dump() const
+{
+  string out;
+  for(const auto& c : classes) {
+    if(!c.allocs) continue;
+    string size = c.size ? format("{:>6}", c.size) : string(" large");
+    out += format("{} allocs={:<10} frees={:<10} hits={:<10} hit={:.1f}%\n",
+                  size, c.allocs, c.frees, c.hits, c.hitRate() * 100);
+  }
+  out += format("slab bytes={}\n", slabBytes);
+  return out;
+}
+
+
+} // end namespace
@@ -0,0 +1,66 @@
+#ifndef MP_SQLITEALLOC_HH
+#define MP_SQLITEALLOC_HH
+#pragma once
+
+/** \file SqliteAlloc.hh
+ * Declarations SQLite pool memory allocator
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+#include <string>
+#include <vector>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Counters of one SqlitePoolAllocator size class
+  struct SqliteAllocClassStats
+  {
+    size_t size{0};     // Block size in bytes, 0 for allocations above the largest class
+    uint64_t allocs{0}; // Allocations
+    uint64_t hits{0};   // Allocations served from the thread's own free list
+    uint64_t frees{0};  // Frees
+
+    double hitRate() const { return allocs ? double(hits) / allocs : 0.0; }
+  };
+
+
+  // Counters of SqlitePoolAllocator
+  struct SqliteAllocStats
+  {
+    std::vector<SqliteAllocClassStats> classes; // Size classes, then the large allocations
+    uint64_t slabBytes{0}; // Bytes obtained from malloc() for the pools
+
+    // One line per size class
+    std::string dump() const;
+  };
+
+
+  // sqlite3_mem_methods with thread-local size-class pools. Allocations up to 4 KiB are taken
+  // from per-thread free lists without locking; lists are refilled from and drained into a
+  // central list per class in batches, which in turn carves 64 KiB slabs from malloc().
+  // Larger allocations go to malloc(). Pool memory is kept for the life of the process.
+  // Install with SqliteEngineConfig::memMethods before the first connection is opened.
+  class SqlitePoolAllocator
+  {
+    public:
+      static const sqlite3_mem_methods* Methods();
+      static SqliteAllocStats Stats();
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
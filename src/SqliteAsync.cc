@@ -0,0 +1,150 @@
+
+#include "SqliteAsync.hh"
+// Std
+#include <stdexcept>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+// ===== SqliteCancelToken class =====
+
+// Token of the work running on this thread. sqlite3_interrupt() is not used as it stops
+// every statement of the connection, including open cursors of other tokens.
+static thread_local const SqliteCancelToken* t_running = nullptr;
+
+
+void SqliteCancelToken::cancel()
+{
+  m_state->cancelled.store(true, memory_order_release);
+}
+
+
+void SqliteCancelToken::check() const
+{
+  if(cancelled()) [[unlikely]] throw runtime_error("Sqlite operation cancelled");
+}
+
+
+int SqliteCancelToken::Progress(void*)
+{
+  return t_running && t_running->cancelled();
+}
+
+
+SqliteCancelToken::Scope::Scope(const SqliteCancelToken& tok) :
+  m_prev{t_running}
+{
+  tok.check();
+  t_running = &tok;
+}
+
+
+SqliteCancelToken::Scope::~Scope()
+{
+  t_running = m_prev;
+}
+
+
+// ===== AsyncSqliteDb class =====
+
+AsyncSqliteDb::AsyncSqliteDb(std::string_view filename, SqliteAsyncOptions opts) :
+  m_filename{filename}, m_opts{std::move(opts)}
+{
+  Expects(m_opts.threads > 0);
+  m_workers.resize(m_opts.threads);
+  for(auto& w : m_workers) {
+    w.db = make_unique<SqliteDb>(m_filename, m_opts.flags);
+    Expects(w.db->get() != nullptr);
+    sqlite3_busy_timeout(w.db->get(), m_opts.busyTimeoutMs);
+    sqlite3_progress_handler(w.db->get(), m_opts.progressOps, &SqliteCancelToken::Progress, nullptr);
+  }
+  // Each connection is used by its own thread only
+  for(size_t i = 0; i < m_workers.size(); ++i) {
+    m_threads.emplace_back([this, i] { run(i); });
+  }
+  VLOG(1) << format("Async executor on {} with {} threads", m_filename, m_workers.size());
+}
+
+
+AsyncSqliteDb::~AsyncSqliteDb()
+{
+  {
+    lock_guard<mutex> lock(m_mtx);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+  m_threads.clear(); // Joins
+}
+
+
+SqliteAwaitable<int> AsyncSqliteDb::exec(std::string_view sql, SqliteCancelToken tok)
+{
+  return submit([sql = string(sql)](SqliteDb& db) {
+    int rc = db.exec(sql);
+    if(rc != SQLITE_OK) throw runtime_error(sqlite3_errmsg(db.get()));
+    return rc;
+  }, std::move(tok));
+}
+
+
+void AsyncSqliteDb::post(size_t worker, Job_t job)
+{
+  {
+    lock_guard<mutex> lock(m_mtx);
+    if(worker == AnyWorker) m_jobs.push_back(std::move(job));
+    else m_workers.at(worker).jobs.push_back(std::move(job));
+  }
+  // Pinned work must wake its own worker
+  if(worker == AnyWorker) m_cv.notify_one();
+  else m_cv.notify_all();
+}
+
+
+void AsyncSqliteDb::resume(std::coroutine_handle<> h)
+{
+  if(m_opts.resumer) m_opts.resumer(h);
+  else h.resume();
+}
+
+
+size_t AsyncSqliteDb::workerOf(const SqliteDb& db) const
+{
+  for(size_t i = 0; i < m_workers.size(); ++i) {
+    if(m_workers[i].db.get() == &db) return i;
+  }
+  Expects(false);
+  return AnyWorker;
+}
+
+
+void AsyncSqliteDb::run(size_t worker)
+{
+  Worker& w = m_workers[worker];
+  for(;;) {
+    Job_t job;
+    {
+      unique_lock<mutex> lock(m_mtx);
+      m_cv.wait(lock, [&] { return m_stop || !w.jobs.empty() || !m_jobs.empty(); });
+      auto& q = !w.jobs.empty() ? w.jobs : m_jobs;
+      if(q.empty()) break; // Stopping and nothing left
+      job = std::move(q.front());
+      q.pop_front();
+    }
+    job(*w.db);
+  }
+}
+
+
+} // end namespace
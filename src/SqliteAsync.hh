@@ -0,0 +1,406 @@
+#ifndef MP_SQLITEASYNC_HH
+#define MP_SQLITEASYNC_HH
+#pragma once
+
+/** \file SqliteAsync.hh
+ * Declarations SQLite coroutine based asynchronous executor
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Options for AsyncSqliteDb
+  struct SqliteAsyncOptions
+  {
+    size_t threads{2};        // Worker threads, each owning one connection
+    int flags{SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX};
+    int busyTimeoutMs{5000};  // busy_timeout of every connection
+    size_t batchRows{256};    // Rows per SqliteAsyncCursor::next() batch
+    int progressOps{1000};    // VM instructions between cancellation checks of running work
+    // Resumes a coroutine once its work is done, e.g. by posting it to an event loop.
+    // Empty to resume on the worker thread.
+    std::function<void(std::coroutine_handle<>)> resumer;
+  };
+
+
+  // Cancellation of asynchronous work. Copies share state; cancel() makes pending work
+  // fail without running and stops running work at its next progress handler check.
+  // Only this token's work is stopped, other work on the same connection carries on.
+  class SqliteCancelToken
+  {
+    protected:
+      struct State
+      {
+        std::atomic<bool> cancelled{false};
+      };
+      std::shared_ptr<State> m_state;
+
+    public:
+      SqliteCancelToken() : m_state{std::make_shared<State>()} {}
+
+      bool cancelled() const { return m_state->cancelled.load(std::memory_order_acquire); }
+      void cancel();
+
+      // Makes tok the token checked by Progress() on this thread for the scope's lifetime.
+      // Throws if the token is already cancelled.
+      class Scope
+      {
+          const SqliteCancelToken* m_prev;
+        public:
+          explicit Scope(const SqliteCancelToken& tok);
+          ~Scope();
+          Scope(const Scope&) = delete;
+          Scope& operator=(const Scope&) = delete;
+      };
+
+      // sqlite3_progress_handler callback, non-zero interrupts the statement being stepped
+      // if the token of the current Scope is cancelled
+      static int Progress(void*);
+
+      // Throw if cancelled
+      void check() const;
+  };
+
+
+  class AsyncSqliteDb;
+
+
+  // Awaitable running fn on a worker's connection. The work is submitted when the
+  // coroutine suspends; co_await yields fn's result or rethrows its exception.
+  template <typename T>
+  class SqliteAwaitable
+  {
+    public:
+      typedef std::function<T(SqliteDb&)> Fn_t;
+
+    protected:
+      typedef std::conditional_t<std::is_void_v<T>, std::monostate, std::optional<T>> Value_t;
+
+      AsyncSqliteDb* m_adb;
+      Fn_t m_fn;
+      SqliteCancelToken m_tok;
+      size_t m_worker;
+      Value_t m_value;
+      std::exception_ptr m_error;
+
+    public:
+      SqliteAwaitable(AsyncSqliteDb* adb, Fn_t fn, SqliteCancelToken tok, size_t worker) :
+        m_adb{adb}, m_fn{std::move(fn)}, m_tok{std::move(tok)}, m_worker{worker} {}
+
+      bool await_ready() const noexcept { return false; }
+      inline void await_suspend(std::coroutine_handle<> h);
+
+      T await_resume()
+      {
+        if(m_error) std::rethrow_exception(m_error);
+        if constexpr (!std::is_void_v<T>) return std::move(*m_value);
+      }
+  };
+
+
+  // Batched reader of a query's rows pinned to the worker that prepared it.
+  // co_await next() returns up to SqliteAsyncOptions::batchRows rows, an empty batch at the end.
+  // Must not outlive its AsyncSqliteDb.
+  template <typename... Rs>
+  class SqliteAsyncCursor
+  {
+    public:
+      typedef std::tuple<Rs...> Row_t;
+      typedef std::vector<Row_t> Batch_t;
+
+      // Statement and the bound values it refers to
+      struct State
+      {
+        std::shared_ptr<void> args;
+        SqliteStmt stmt;
+        bool done{false};
+      };
+
+    protected:
+      AsyncSqliteDb* m_adb;
+      size_t m_worker;
+      std::shared_ptr<State> m_state;
+      SqliteCancelToken m_tok;
+
+    public:
+      SqliteAsyncCursor(AsyncSqliteDb* adb, size_t worker, std::shared_ptr<State> state, SqliteCancelToken tok) :
+        m_adb{adb}, m_worker{worker}, m_state{std::move(state)}, m_tok{std::move(tok)} {}
+      SqliteAsyncCursor(SqliteAsyncCursor&&) = default;
+      SqliteAsyncCursor& operator=(SqliteAsyncCursor&&) = delete;
+      ~SqliteAsyncCursor();
+
+      SqliteAwaitable<Batch_t> next();
+  };
+
+
+  // Argument of asynchronous work as held until the work runs: text and blob views and C
+  // strings become owning copies, anything else is stored as is
+  template <typename A>
+  auto SqliteAsyncArg(A&& a)
+  {
+    typedef std::decay_t<A> T;
+    if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+      return std::string(a);
+    else if constexpr (std::is_same_v<T, std::span<const uint8_t>>)
+      return Blob_t(a.begin(), a.end());
+    else
+      return T(std::forward<A>(a));
+  }
+
+
+  // Asynchronous access to one database file for coroutines, e.g.
+  //   auto rows = co_await adb.query<int64_t, std::string>("SELECT id, name FROM T WHERE id > ?", 10);
+  // Work runs on a fixed pool of threads, each owning its connection, so a slow query or an
+  // fsync never blocks the caller's thread. Result rows are copied out, so Rs should be owning
+  // types (std::string, Blob_t, not views). Arguments are copied, including the text and
+  // blobs views refer to, until the work completes.
+  // Each exec() and query() may run on a different connection: statements of one explicit
+  // transaction must run in a single transaction() or submit() call.
+  class AsyncSqliteDb
+  {
+    public:
+      static constexpr size_t AnyWorker = static_cast<size_t>(-1);
+      typedef std::function<void(SqliteDb&)> Job_t;
+
+    protected:
+      struct Worker
+      {
+        std::unique_ptr<SqliteDb> db;
+        std::deque<Job_t> jobs; // Work pinned to this worker
+      };
+
+      std::string m_filename;
+      SqliteAsyncOptions m_opts;
+      std::vector<Worker> m_workers;
+      std::deque<Job_t> m_jobs; // Work for any worker
+      std::mutex m_mtx;
+      std::condition_variable m_cv;
+      bool m_stop{false};
+      std::vector<std::jthread> m_threads;
+
+    public:
+      // CREATORS
+      AsyncSqliteDb(std::string_view filename, SqliteAsyncOptions opts = {});
+      // Runs the queued work, then stops the workers
+      ~AsyncSqliteDb();
+
+      AsyncSqliteDb(const AsyncSqliteDb&) = delete;
+      AsyncSqliteDb& operator=(const AsyncSqliteDb&) = delete;
+
+      // ACCESSORS
+      std::string_view getFileName() const { return m_filename; }
+      size_t threads() const { return m_workers.size(); }
+      const SqliteAsyncOptions& options() const { return m_opts; }
+
+      // MODIFIERS
+      // Run fn(SqliteDb&) on a worker
+      template <typename F, typename T = std::invoke_result_t<F, SqliteDb&>>
+      SqliteAwaitable<T> submit(F fn, SqliteCancelToken tok = {}, size_t worker = AnyWorker)
+      { return SqliteAwaitable<T>(this, std::move(fn), std::move(tok), worker); }
+
+      // Execute SQL without results, throws on error
+      SqliteAwaitable<int> exec(std::string_view sql, SqliteCancelToken tok = {});
+
+      // Run fn(SqliteDb&) on a worker between begin and COMMIT, rolled back if fn throws
+      template <typename F, typename T = std::invoke_result_t<F, SqliteDb&>>
+      SqliteAwaitable<T> transaction(F fn, SqliteCancelToken tok = {}, std::string_view begin = "BEGIN IMMEDIATE");
+
+      // Run a query and return all its rows
+      template <typename... Rs, typename... As>
+      SqliteAwaitable<std::vector<std::tuple<Rs...>>> query(std::string_view sql, As&&... args)
+      { return query<Rs...>(SqliteCancelToken{}, sql, std::forward<As>(args)...); }
+
+      template <typename... Rs, typename... As>
+      SqliteAwaitable<std::vector<std::tuple<Rs...>>> query(SqliteCancelToken tok, std::string_view sql, As&&... args);
+
+      // Prepare a query and return a cursor for reading its rows in batches
+      template <typename... Rs, typename... As>
+      SqliteAwaitable<SqliteAsyncCursor<Rs...>> cursor(SqliteCancelToken tok, std::string_view sql, As&&... args);
+
+      // Queue a job for a worker, AnyWorker for the first free one
+      void post(size_t worker, Job_t job);
+
+      // Resume a coroutine as configured by SqliteAsyncOptions::resumer
+      void resume(std::coroutine_handle<> h);
+
+      // Index of the worker owning db
+      size_t workerOf(const SqliteDb& db) const;
+
+      // Read up to maxRows rows of stmt into out; returns false on SQLITE_DONE
+      template <typename... Rs>
+      static bool Fetch(SqliteStmt& stmt, std::vector<std::tuple<Rs...>>& out, size_t maxRows,
+                        const SqliteCancelToken& tok);
+
+      // Bind a tuple of values to stmt's parameters in order, throws on the first failure
+      template <typename Args>
+      static void BindAll(SqliteStmt& stmt, const Args& args);
+
+    private:
+      void run(size_t worker);
+
+  }; // class
+
+
+  // ===== SqliteAwaitable class =====
+
+  template <typename T>
+  inline void SqliteAwaitable<T>::await_suspend(std::coroutine_handle<> h)
+  {
+    m_adb->post(m_worker, [this, h](SqliteDb& db) {
+      try {
+        SqliteCancelToken::Scope scope(m_tok);
+        if constexpr (std::is_void_v<T>) m_fn(db);
+        else m_value.emplace(m_fn(db));
+      }
+      catch(...) {
+        m_error = std::current_exception();
+      }
+      m_adb->resume(h); // May destroy this
+    });
+  }
+
+
+  // ===== SqliteAsyncCursor class =====
+
+  template <typename... Rs>
+  SqliteAsyncCursor<Rs...>::~SqliteAsyncCursor()
+  {
+    // The statement must be finalized by the thread owning its connection
+    if(m_state) m_adb->post(m_worker, [state = std::move(m_state)](SqliteDb&) mutable { state.reset(); });
+  }
+
+
+  template <typename... Rs>
+  SqliteAwaitable<typename SqliteAsyncCursor<Rs...>::Batch_t> SqliteAsyncCursor<Rs...>::next()
+  {
+    return m_adb->submit([state = m_state, tok = m_tok, n = m_adb->options().batchRows](SqliteDb&) {
+      Batch_t batch;
+      if(!state->done) state->done = !AsyncSqliteDb::Fetch(state->stmt, batch, n, tok);
+      return batch;
+    }, m_tok, m_worker);
+  }
+
+
+  // ===== AsyncSqliteDb class =====
+
+  template <typename Args>
+  void AsyncSqliteDb::BindAll(SqliteStmt& stmt, const Args& args)
+  {
+    int rc = SQLITE_OK;
+    std::apply([&stmt, &rc](const auto&... a) {
+      int pos = 1;
+      (void)(((rc = stmt.bindValue(pos++, a)) == SQLITE_OK) && ...); // Stops at the first failure
+    }, args);
+    // SQLITE_RANGE, TOOBIG, NOMEM: never run with missing parameters
+    if(rc != SQLITE_OK) throw std::runtime_error(sqlite3_errstr(rc));
+  }
+
+
+  template <typename... Rs>
+  bool AsyncSqliteDb::Fetch(SqliteStmt& stmt, std::vector<std::tuple<Rs...>>& out, size_t maxRows,
+                            const SqliteCancelToken& tok)
+  {
+    while(out.size() < maxRows) {
+      tok.check();
+      if(!stmt++) return false;
+      std::apply([&stmt](auto&... v) {
+        int col = 0;
+        ((stmt.column(col++, v)), ...);
+      }, out.emplace_back());
+    }
+    return true;
+  }
+
+
+  template <typename F, typename T>
+  SqliteAwaitable<T> AsyncSqliteDb::transaction(F fn, SqliteCancelToken tok, std::string_view begin)
+  {
+    return submit([fn = std::move(fn), begin = std::string(begin)](SqliteDb& db) -> T {
+      auto run = [&db](std::string_view sql) {
+        if(db.exec(sql) != SQLITE_OK) throw std::runtime_error(sqlite3_errmsg(db.get()));
+      };
+      run(begin);
+      try {
+        if constexpr (std::is_void_v<T>) {
+          fn(db);
+          run("COMMIT");
+        }
+        else {
+          T out = fn(db);
+          run("COMMIT");
+          return out;
+        }
+      }
+      catch(...) {
+        SqliteCancelToken none;
+        SqliteCancelToken::Scope scope(none); // A cancelled token must not interrupt the rollback
+        if(!sqlite3_get_autocommit(db.get())) db.exec("ROLLBACK");
+        throw;
+      }
+    }, std::move(tok));
+  }
+
+
+  template <typename... Rs, typename... As>
+  SqliteAwaitable<std::vector<std::tuple<Rs...>>> AsyncSqliteDb::query(SqliteCancelToken tok, std::string_view sql, As&&... args)
+  {
+    return submit([sql = std::string(sql), args = std::make_tuple(SqliteAsyncArg(std::forward<As>(args))...), tok](SqliteDb& db) {
+      std::vector<std::tuple<Rs...>> rows;
+      SqliteStmt stmt = db.cached(sql);
+      BindAll(stmt, args);
+      while(Fetch(stmt, rows, static_cast<size_t>(-1), tok)) {}
+      return rows;
+    }, tok);
+  }
+
+
+  template <typename... Rs, typename... As>
+  SqliteAwaitable<SqliteAsyncCursor<Rs...>> AsyncSqliteDb::cursor(SqliteCancelToken tok, std::string_view sql, As&&... args)
+  {
+    typedef SqliteAsyncCursor<Rs...> Cursor_t;
+    return submit([this, sql = std::string(sql), args = std::make_tuple(SqliteAsyncArg(std::forward<As>(args))...), tok](SqliteDb& db) {
+      auto state = std::make_shared<typename Cursor_t::State>();
+      auto held = std::make_shared<std::remove_cvref_t<decltype(args)>>(args); // Bound values live as long as the statement
+      state->args = held;
+      state->stmt = db.cached(sql);
+      BindAll(state->stmt, *held);
+      return Cursor_t(this, workerOf(db), std::move(state), tok);
+    }, tok);
+  }
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
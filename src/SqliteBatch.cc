@@ -0,0 +1,150 @@
+
+#include "SqliteBatch.hh"
+// Std
+#include <string>
+#include <cctype>
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+void SqliteColumnBuffer::clear()
+{
+  ints.clear();
+  reals.clear();
+  data.clear();
+  offsets.assign(1, 0);
+  validity.clear();
+  nulls = 0;
+}
+
+
+SqliteColumnBatch::SqliteColumnBatch(initializer_list<int> types)
+{
+  for(int t : types) addColumn(t);
+}
+
+
+void SqliteColumnBatch::addColumn(int type)
+{
+  Expects(type == SQLITE_INTEGER || type == SQLITE_FLOAT || type == SQLITE_TEXT || type == SQLITE_BLOB);
+  SqliteColumnBuffer& col = m_cols.emplace_back();
+  col.type = type;
+  col.clear();
+}
+
+
+void SqliteColumnBatch::reserve(size_t rows, size_t bytesPerRow)
+{
+  for(auto& col : m_cols) {
+    col.validity.reserve((rows + 63) / 64);
+    switch(col.type) {
+      case SQLITE_INTEGER: col.ints.reserve(rows); break;
+      case SQLITE_FLOAT: col.reals.reserve(rows); break;
+      default:
+        col.offsets.reserve(rows + 1);
+        col.data.reserve(rows * bytesPerRow);
+    }
+  }
+}
+
+
+void SqliteColumnBatch::clear()
+{
+  for(auto& col : m_cols) col.clear();
+  m_rows = 0;
+}
+
+
+// Column affinity rules: https://www.sqlite.org/datatype3.html#determination_of_column_affinity
+void SqliteColumnBatch::describe(SqliteStmt& stmt, bool haveRow)
+{
+  m_cols.clear();
+  m_rows = 0;
+  for(int c = 0; c < stmt.columnCount(); ++c) {
+    const char* decl = stmt.columnDeclType(c);
+    int type = SQLITE_NULL;
+    if(decl) {
+      string d{decl};
+      for(auto& ch : d) ch = toupper(static_cast<unsigned char>(ch));
+      if(d.find("INT") != string::npos) type = SQLITE_INTEGER;
+      else if(d.find("CHAR") != string::npos || d.find("CLOB") != string::npos || d.find("TEXT") != string::npos) type = SQLITE_TEXT;
+      else if(d.empty() || d.find("BLOB") != string::npos) type = SQLITE_BLOB;
+      else if(d.find("REAL") != string::npos || d.find("FLOA") != string::npos || d.find("DOUB") != string::npos) type = SQLITE_FLOAT;
+      // NUMERIC affinity (DATE, DECIMAL, BOOLEAN...) holds integers, reals or text
+    }
+    if(type == SQLITE_NULL) {
+      // Expression or NUMERIC affinity, use the type of the current row
+      type = haveRow ? stmt.columnType(c) : SQLITE_NULL;
+      if(type == SQLITE_NULL) type = SQLITE_TEXT;
+    }
+    addColumn(type);
+  }
+}
+
+
+void SqliteColumnBatch::append(sqlite3_stmt* stmt)
+{
+  size_t row = m_rows++;
+  size_t word = row / 64;
+  uint64_t bit = uint64_t{1} << (row % 64);
+
+  for(size_t c = 0; c < m_cols.size(); ++c) {
+    SqliteColumnBuffer& col = m_cols[c];
+    int ic = static_cast<int>(c);
+    if(word == col.validity.size()) col.validity.push_back(0);
+    bool null = sqlite3_column_type(stmt, ic) == SQLITE_NULL;
+    if(null) col.nulls++;
+    else col.validity[word] |= bit;
+
+    switch(col.type) {
+      case SQLITE_INTEGER:
+        col.ints.push_back(null ? 0 : sqlite3_column_int64(stmt, ic));
+        break;
+      case SQLITE_FLOAT:
+        col.reals.push_back(null ? 0.0 : sqlite3_column_double(stmt, ic));
+        break;
+      default:
+      {
+        // sqlite3_column_text/blob() must be called before sqlite3_column_bytes()
+        const uint8_t* p = (col.type == SQLITE_TEXT) ? sqlite3_column_text(stmt, ic)
+                                                     : (const uint8_t*)sqlite3_column_blob(stmt, ic);
+        size_t n = sqlite3_column_bytes(stmt, ic);
+        if(n) col.data.insert(col.data.end(), p, p + n);
+        col.offsets.push_back(col.data.size());
+      }
+    }
+  }
+}
+
+
+//===================================================================================
+
+
+size_t SqliteStmt::fetchBatch(SqliteColumnBatch& batch, size_t maxRows)
+{
+  Expects(batch.columns() <= static_cast<size_t>(columnCount()));
+  batch.clear();
+  m_colPos = 0;
+  if(m_done) return 0; // Stepping again would restart the query
+
+  while(batch.rows() < maxRows) {
+    m_rc = sqlite3_step(m_stmt.get());
+    if(m_rc != SQLITE_ROW) {
+      m_done = true;
+      break;
+    }
+    if(batch.columns() == 0) batch.describe(*this, true);
+    batch.append(m_stmt.get());
+  }
+
+  if(m_rc != SQLITE_ROW && m_rc != SQLITE_DONE) checkError();
+  return batch.rows();
+}
+
+
+} // end namespace
@@ -0,0 +1,101 @@
+#ifndef MP_SQLITEBATCH_HH
+#define MP_SQLITEBATCH_HH
+#pragma once
+
+/** \file SqliteBatch.hh
+ * Declarations SQLite columnar batches
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <vector>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // One column of a SqliteColumnBatch, stored contiguously (struct of arrays).
+  // Integer and float columns fill ints or reals, text and blob columns fill
+  // data with row i at [offsets[i], offsets[i+1]). NULL rows have their validity
+  // bit cleared and hold 0 or an empty value.
+  struct SqliteColumnBuffer
+  {
+    int type{SQLITE_NULL};          // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_BLOB
+    std::vector<int64_t> ints;      // SQLITE_INTEGER values
+    std::vector<double> reals;      // SQLITE_FLOAT values
+    std::vector<size_t> offsets;    // SQLITE_TEXT/SQLITE_BLOB value offsets, rows + 1 entries
+    std::vector<uint8_t> data;      // SQLITE_TEXT/SQLITE_BLOB value bytes
+    std::vector<uint64_t> validity; // Bit i is set if row i is not NULL
+    size_t nulls{0};                // Number of NULL rows
+
+    bool isNull(size_t row) const
+    { return !(validity[row / 64] & (uint64_t{1} << (row % 64))); }
+
+    std::string_view text(size_t row) const
+    { return std::string_view((const char*)data.data() + offsets[row], offsets[row + 1] - offsets[row]); }
+
+    std::span<const uint8_t> blob(size_t row) const
+    { return std::span<const uint8_t>(data.data() + offsets[row], offsets[row + 1] - offsets[row]); }
+
+    // Drop the values, keeping the allocated capacity
+    void clear();
+  };
+
+
+  // Preallocated, reusable column buffers filled by SqliteStmt::fetchBatch().
+  // Column types are given up front or, for a batch without columns, derived from
+  // the declared column types on the first fetch. Expressions and NUMERIC affinity
+  // columns take the storage class of the first row, text when it is NULL.
+  class SqliteColumnBatch
+  {
+    protected:
+      std::vector<SqliteColumnBuffer> m_cols;
+      size_t m_rows{0};
+
+    public:
+      // CREATORS
+      SqliteColumnBatch() = default;
+      SqliteColumnBatch(std::initializer_list<int> types);
+
+      // ACCESSORS
+      size_t rows() const { return m_rows; }
+      size_t columns() const { return m_cols.size(); }
+      const SqliteColumnBuffer& operator[](size_t col) const { return m_cols[col]; }
+      const SqliteColumnBuffer& column(size_t col) const { return m_cols[col]; }
+
+      // MODIFIERS
+      // Append a column of the given SQLITE_* type
+      void addColumn(int type);
+
+      // Reserve room for rows values per column, and bytesPerRow for text/blob columns
+      void reserve(size_t rows, size_t bytesPerRow = 0);
+
+      // Drop all values, keeping columns and capacity
+      void clear();
+
+      // Derive the column types from a statement, see class description
+      void describe(SqliteStmt& stmt, bool haveRow);
+
+    private:
+      friend class SqliteStmt;
+
+      // Append the current row of stmt
+      void append(sqlite3_stmt* stmt);
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
@@ -0,0 +1,47 @@
+
+#include "SqliteBulk.hh"
+// Std
+#include <string>
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+string SqliteBulkInsertSql(string_view verb, string_view table, const vector<string>& columns, size_t nCols, size_t nRows)
+{
+  // One parenthesized group of placeholders per row
+  string group{"("};
+  for(size_t c = 0; c < nCols; ++c) group += (c ? ",?" : "?");
+  group += ')';
+
+  string sql;
+  sql.reserve(verb.size() + table.size() + 32 + nRows * (group.size() + 1));
+  sql.append(verb).append(" INTO ").append(table);
+  if(!columns.empty()) {
+    sql += " (";
+    for(size_t c = 0; c < columns.size(); ++c) {
+      if(c) sql += ',';
+      sql += columns[c];
+    }
+    sql += ')';
+  }
+  sql += " VALUES ";
+  for(size_t r = 0; r < nRows; ++r) {
+    if(r) sql += ',';
+    sql += group;
+  }
+  return sql;
+}
+
+
+void SqliteBulkLogError(string_view msg)
+{
+  LOG(ERROR) << msg;
+}
+
+
+} // end namespace
@@ -0,0 +1,324 @@
+#ifndef MP_SQLITEBULK_HH
+#define MP_SQLITEBULK_HH
+#pragma once
+
+/** \file SqliteBulk.hh
+ * Declarations SQLite bulk inserter
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <algorithm>
+#include <chrono>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <exception>
+#include <functional>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Options for SqliteBulkInserter
+  struct SqliteBulkOptions
+  {
+    size_t maxRowsPerStmt{512};   // Upper limit of rows per multi-row INSERT, also bound by SQLITE_LIMIT_VARIABLE_NUMBER
+    size_t commitRows{100000};    // Commit after this many rows, 0 disables
+    std::chrono::milliseconds commitInterval{1000}; // Commit after this much time in a transaction, 0 disables
+    std::string verb{"INSERT"};   // Statement verb, e.g. "INSERT OR REPLACE"
+  };
+
+
+  // Counters of a SqliteBulkInserter
+  struct SqliteBulkStats
+  {
+    uint64_t rows{0};       // Rows written to the database
+    uint64_t statements{0}; // Multi-row INSERT statements executed
+    uint64_t commits{0};    // Transactions committed
+    std::chrono::nanoseconds elapsed{0}; // Time from the first queued row to the last write
+
+    double rowsPerSec() const
+    { return elapsed.count() ? rows * 1e9 / elapsed.count() : 0.0; }
+  };
+
+
+  // Build "<verb> INTO table (c1,...,cn) VALUES (?,...,?),...,(?,...,?)" for nRows rows.
+  // The column list is omitted when columns is empty.
+  std::string SqliteBulkInsertSql(std::string_view verb, std::string_view table,
+                                  const std::vector<std::string>& columns, size_t nCols, size_t nRows);
+
+  // Log an error that cannot be thrown
+  void SqliteBulkLogError(std::string_view msg);
+
+
+  // Writes rows of std::tuple<Ts...> with multi-row INSERT statements inside explicit transactions.
+  // Rows are buffered until a full statement can be executed, transactions are committed every
+  // commitRows rows or commitInterval, whichever comes first. Call finish() to write the rest;
+  // the destructor does so as well, but rolls back if it runs during stack unwinding.
+  // Buffered rows are bound with SQLITE_STATIC, so view types (std::string_view etc.) in Ts
+  // must refer to data that outlives the next flush().
+  template <typename... Ts>
+  class SqliteBulkInserter
+  {
+    public:
+      typedef std::tuple<Ts...> Row_t;
+      typedef std::chrono::steady_clock Clock_t;
+      static constexpr size_t NCols = sizeof...(Ts);
+
+    protected:
+      SqliteDb& m_db;                     // Target database (not owned)
+      std::string m_table;                // Target table name
+      std::vector<std::string> m_columns; // Target columns, empty for all columns in order
+      SqliteBulkOptions m_opts;
+      size_t m_rowsPerStmt;               // Rows per full statement
+      SqliteStmt m_full;                  // Full-size multi-row statement
+      std::vector<Row_t> m_buf;           // Rows waiting for the next statement
+      bool m_inTxn;                       // A transaction is open
+      uint64_t m_txnRows;                 // Rows written in the current transaction
+      Clock_t::time_point m_txnStart;     // First row queued since the last commit
+      Clock_t::time_point m_start;        // First queued row
+      SqliteBulkStats m_stats;
+
+    public:
+      // CREATORS
+      SqliteBulkInserter(SqliteDb& db, std::string_view table, std::vector<std::string> columns = {},
+                         SqliteBulkOptions opts = {});
+      ~SqliteBulkInserter();
+
+      SqliteBulkInserter(const SqliteBulkInserter&) = delete;
+      SqliteBulkInserter& operator=(const SqliteBulkInserter&) = delete;
+
+      // ACCESSORS
+      size_t rowsPerStmt() const { return m_rowsPerStmt; }
+      size_t pending() const { return m_buf.size(); }
+      const SqliteBulkStats& stats() const { return m_stats; }
+
+      // MODIFIERS
+      // Queue a single row
+      int insert(Row_t row);
+
+      // Queue a range of rows convertible to Row_t
+      template <std::ranges::input_range R>
+      int insertRange(R&& rows)
+      { return insertRange(std::forward<R>(rows), std::identity{}); }
+
+      // Queue a range of structs, proj maps each element to Row_t
+      template <std::ranges::input_range R, typename Proj>
+      int insertRange(R&& rows, Proj proj);
+
+      // Write the buffered rows. Rows a failing statement did not write stay buffered, so
+      // flush() can be retried (e.g. after SQLITE_BUSY) or they can be dropped with discard().
+      int flush();
+
+      // Drop the buffered rows, returns how many were dropped
+      size_t discard();
+
+      // Write the buffered rows and commit the current transaction
+      int commit();
+
+      // Same as commit(), call when done
+      int finish() { return commit(); }
+
+    private:
+      int begin();
+      int execute(SqliteStmt& stmt, size_t nRows);
+      int maybeCommit();
+
+      template <std::size_t... Is>
+      int bindRow(SqliteStmt& stmt, int base, const Row_t& row, std::index_sequence<Is...>)
+      {
+        int rc = SQLITE_OK;
+        // Stops at the first failure
+        (void)(((rc = stmt.bindValue(base + static_cast<int>(Is), std::get<Is>(row))) == SQLITE_OK) && ...);
+        return rc;
+      }
+
+  }; // class
+
+
+  template <typename... Ts>
+  SqliteBulkInserter<Ts...>::SqliteBulkInserter(SqliteDb& db, std::string_view table,
+                                                std::vector<std::string> columns, SqliteBulkOptions opts) :
+    m_db{db}, m_table{table}, m_columns{std::move(columns)}, m_opts{std::move(opts)},
+    m_rowsPerStmt{1}, m_full{}, m_buf{}, m_inTxn{false}, m_txnRows{0}, m_stats{}
+  {
+    static_assert(NCols > 0, "At least one column is needed");
+    Expects(db.get() != nullptr);
+    Expects(m_columns.empty() || m_columns.size() == NCols);
+
+    // Size the full statement to the host parameter limit
+    size_t maxVars = sqlite3_limit(db.get(), SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    m_rowsPerStmt = std::max<size_t>(1, std::min(maxVars / NCols, m_opts.maxRowsPerStmt));
+    m_full = db.stmt(SqliteBulkInsertSql(m_opts.verb, m_table, m_columns, NCols, m_rowsPerStmt));
+    m_buf.reserve(m_rowsPerStmt);
+  }
+
+
+  template <typename... Ts>
+  SqliteBulkInserter<Ts...>::~SqliteBulkInserter()
+  {
+    try {
+      if(std::uncaught_exceptions()) {
+        // Leaving due to an exception, do not commit a partial load
+        if(m_inTxn) m_db.exec("ROLLBACK");
+      }
+      else {
+        finish();
+      }
+    }
+    catch(const std::exception& e) {
+      // Do not throw from the destructor
+      SqliteBulkLogError(e.what());
+    }
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::insert(Row_t row)
+  {
+    if(m_buf.empty() && !m_inTxn) {
+      m_txnStart = Clock_t::now();
+      if(m_stats.rows == 0) m_start = m_txnStart;
+    }
+    m_buf.emplace_back(std::move(row));
+    if(m_buf.size() < m_rowsPerStmt) {
+      // Slow producers are committed on time as well
+      if(m_opts.commitInterval.count() && Clock_t::now() - m_txnStart >= m_opts.commitInterval) return commit();
+      return SQLITE_OK;
+    }
+
+    int rc = flush();
+    if(rc == SQLITE_OK) rc = maybeCommit();
+    return rc;
+  }
+
+
+  template <typename... Ts>
+  template <std::ranges::input_range R, typename Proj>
+  int SqliteBulkInserter<Ts...>::insertRange(R&& rows, Proj proj)
+  {
+    int rc = SQLITE_OK;
+    for(auto&& elem : rows) {
+      rc = insert(Row_t(std::invoke(proj, std::forward<decltype(elem)>(elem))));
+      if(rc != SQLITE_OK) break;
+    }
+    return rc;
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::flush()
+  {
+    if(m_buf.empty()) return SQLITE_OK;
+
+    int rc = begin();
+    if(rc != SQLITE_OK) return rc;
+
+    // A failed flush() may have left more than a full statement buffered
+    while(!m_buf.empty() && rc == SQLITE_OK) {
+      size_t n = std::min(m_rowsPerStmt, m_buf.size());
+      if(n == m_rowsPerStmt) {
+        rc = execute(m_full, n);
+      }
+      else {
+        // Remainder rows go through a statement of their own size, kept in the statement cache
+        SqliteStmt stmt = m_db.cached(SqliteBulkInsertSql(m_opts.verb, m_table, m_columns, NCols, n));
+        rc = execute(stmt, n);
+      }
+      // Each statement writes all of its rows or none, the unwritten ones stay
+      if(rc == SQLITE_OK) m_buf.erase(m_buf.begin(), m_buf.begin() + n);
+    }
+    return rc;
+  }
+
+
+  template <typename... Ts>
+  size_t SqliteBulkInserter<Ts...>::discard()
+  {
+    size_t n = m_buf.size();
+    m_buf.clear();
+    return n;
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::commit()
+  {
+    int rc = flush();
+    if(rc == SQLITE_OK && m_inTxn) {
+      rc = m_db.exec("COMMIT");
+      // A failed COMMIT may leave the transaction open, e.g. on SQLITE_BUSY
+      m_inTxn = !sqlite3_get_autocommit(m_db.get());
+      if(rc == SQLITE_OK) m_stats.commits++;
+    }
+    return rc;
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::begin()
+  {
+    if(m_inTxn) return SQLITE_OK;
+    int rc = m_db.exec("BEGIN");
+    if(rc == SQLITE_OK) {
+      m_inTxn = true;
+      m_txnRows = 0;
+    }
+    return rc;
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::execute(SqliteStmt& stmt, size_t nRows)
+  {
+    int rc = SQLITE_OK;
+    for(size_t r = 0; r < nRows && rc == SQLITE_OK; ++r) {
+      rc = bindRow(stmt, static_cast<int>(r * NCols + 1), m_buf[r], std::index_sequence_for<Ts...>{});
+    }
+    if(rc != SQLITE_OK) return SqliteDb::CheckError(rc, stmt.ex());
+
+    try {
+      rc = stmt.step();
+    }
+    catch(...) {
+      (void)stmt.tryReset(); // Ready to run the same rows again
+      throw;
+    }
+    (void)stmt.tryReset();
+    if(rc != SQLITE_DONE) return rc;
+
+    m_stats.rows += nRows;
+    m_stats.statements++;
+    m_txnRows += nRows;
+    m_stats.elapsed = Clock_t::now() - m_start;
+    return SQLITE_OK;
+  }
+
+
+  template <typename... Ts>
+  int SqliteBulkInserter<Ts...>::maybeCommit()
+  {
+    bool due = m_opts.commitRows && m_txnRows >= m_opts.commitRows;
+    if(!due && m_opts.commitInterval.count()) {
+      due = Clock_t::now() - m_txnStart >= m_opts.commitInterval;
+    }
+    return due ? commit() : SQLITE_OK;
+  }
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
@@ -0,0 +1,146 @@
+
+#include "SqliteCheckpoint.hh"
+// Std
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+using namespace std::chrono;
+
+namespace MP {
+
+
+SqliteCheckpointer::SqliteCheckpointer(SqliteDb& db, SqliteCheckpointOptions opts) :
+  m_db{db}, m_opts{std::move(opts)}
+{
+  Expects(db.get() != nullptr);
+  const char* file = sqlite3_db_filename(db.get(), "main");
+  Expects(file && *file); // Not for temporary or in-memory databases
+  m_walPath = string(file) + "-wal";
+
+  // Open on the VFS of the attached connection, e.g. SqliteCompressVfs has its own file format
+  sqlite3_vfs* vfs = nullptr;
+  sqlite3_file_control(db.get(), "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+  m_ckpt = SqliteDb(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, vfs ? vfs->zName : "");
+  Expects(m_ckpt.get() != nullptr);
+  m_ckpt.ex(false);
+  sqlite3_busy_timeout(m_ckpt.get(), m_opts.busyTimeoutMs);
+  // Read once so the connection opens the WAL, otherwise checkpoints report no frames
+  m_ckpt.exec("SELECT count(*) FROM sqlite_schema");
+
+  SqliteStmt autoCkpt = db.stmt("PRAGMA wal_autocheckpoint");
+  if(autoCkpt++) autoCkpt.column(0, m_autoCheckpoint);
+  autoCkpt.finalize();
+  sqlite3_wal_hook(db.get(), &SqliteCheckpointer::WalHook, this);
+  m_thread = thread([this] { run(); });
+}
+
+
+SqliteCheckpointer::~SqliteCheckpointer()
+{
+  sqlite3_wal_autocheckpoint(m_db.get(), m_autoCheckpoint); // Replaces WalHook
+  {
+    lock_guard<mutex> lock(m_mtx);
+    m_stop = true;
+  }
+  m_cv.notify_one();
+  m_thread.join();
+}
+
+
+SqliteCheckpointStats SqliteCheckpointer::stats() const
+{
+  lock_guard<mutex> lock(m_mtx);
+  SqliteCheckpointStats s = m_stats;
+  s.walFrames = m_frames.load(memory_order_relaxed);
+  return s;
+}
+
+
+void SqliteCheckpointer::wake()
+{
+  {
+    lock_guard<mutex> lock(m_mtx);
+    m_due = true;
+  }
+  m_cv.notify_one();
+}
+
+
+// Called by SQLite after each commit on the attached connection, must be cheap
+int SqliteCheckpointer::WalHook(void* self, sqlite3*, const char*, int frames)
+{
+  auto ckpt = static_cast<SqliteCheckpointer*>(self);
+  int prev = ckpt->m_frames.exchange(frames, memory_order_relaxed);
+  if(frames >= ckpt->m_opts.passiveFrames && prev < ckpt->m_opts.passiveFrames) ckpt->wake();
+  return SQLITE_OK;
+}
+
+
+void SqliteCheckpointer::run()
+{
+  unique_lock<mutex> lock(m_mtx);
+  while(!m_stop) {
+    m_cv.wait_for(lock, m_opts.interval, [this] { return m_stop || m_due; });
+    if(m_stop) break;
+    m_due = false;
+    if(m_frames.load(memory_order_relaxed) < m_opts.passiveFrames) continue;
+
+    lock.unlock();
+    checkpoint(SQLITE_CHECKPOINT_PASSIVE);
+    int behind = stats().framesBehind;
+    if(behind >= m_opts.truncateFrames) checkpoint(SQLITE_CHECKPOINT_TRUNCATE);
+    else if(behind >= m_opts.restartFrames) checkpoint(SQLITE_CHECKPOINT_RESTART);
+    lock.lock();
+  }
+}
+
+
+void SqliteCheckpointer::checkpoint(int mode)
+{
+  int logFrames = 0, ckptFrames = 0;
+  auto start = steady_clock::now();
+  int rc = sqlite3_wal_checkpoint_v2(m_ckpt.get(), "main", mode, &logFrames, &ckptFrames);
+  auto took = duration_cast<microseconds>(steady_clock::now() - start);
+
+  error_code ec;
+  uint64_t walBytes = filesystem::file_size(m_walPath, ec);
+
+  {
+    lock_guard<mutex> lock(m_mtx);
+    switch(mode) {
+      case SQLITE_CHECKPOINT_PASSIVE: m_stats.passive++; break;
+      case SQLITE_CHECKPOINT_RESTART: m_stats.restart++; break;
+      case SQLITE_CHECKPOINT_TRUNCATE: m_stats.truncate++; break;
+    }
+    if(rc == SQLITE_BUSY) m_stats.busy++;
+    m_stats.framesBehind = (rc == SQLITE_OK) ? max(0, logFrames - ckptFrames) : m_stats.framesBehind;
+    m_stats.walBytes = ec ? 0 : walBytes;
+    m_stats.lastDuration = took;
+    m_stats.maxDuration = max(m_stats.maxDuration, took);
+    m_stats.totalDuration += took;
+  }
+  // After RESTART/TRUNCATE the next commit starts the WAL over
+  if(rc == SQLITE_OK && mode != SQLITE_CHECKPOINT_PASSIVE) m_frames.store(0, memory_order_relaxed);
+
+  if(rc != SQLITE_OK && rc != SQLITE_BUSY) {
+    LOG(WARNING) << format("Checkpoint mode={} rc={} {}", mode, rc, sqlite3_errmsg(m_ckpt.get()));
+  }
+  else {
+    VLOG(1) << format("Checkpoint mode={} rc={} log={} ckpt={} took={}us", mode, rc, logFrames, ckptFrames, took.count());
+  }
+}
+
+
+} // end namespace
@@ -0,0 +1,107 @@
+#ifndef MP_SQLITECHECKPOINT_HH
+#define MP_SQLITECHECKPOINT_HH
+#pragma once
+
+/** \file SqliteCheckpoint.hh
+ * Declarations SQLite background WAL checkpointer
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Options for SqliteCheckpointer, thresholds are in WAL frames (pages)
+  struct SqliteCheckpointOptions
+  {
+    int passiveFrames{1000};     // PASSIVE checkpoint once the WAL has this many frames
+    int restartFrames{10000};    // RESTART once this many frames remain after a PASSIVE one
+    int truncateFrames{50000};   // TRUNCATE once this many frames remain after a PASSIVE one
+    std::chrono::milliseconds interval{1000}; // Check at least this often
+    int busyTimeoutMs{100};      // How long RESTART/TRUNCATE wait for readers, writers wait as long
+  };
+
+
+  // Metrics of a SqliteCheckpointer
+  struct SqliteCheckpointStats
+  {
+    int walFrames{0};         // WAL frames reported by the last commit
+    int framesBehind{0};      // WAL frames not yet copied back to the database after the last checkpoint
+    uint64_t walBytes{0};     // WAL file size after the last checkpoint
+    uint64_t passive{0};      // Checkpoints run per mode
+    uint64_t restart{0};
+    uint64_t truncate{0};
+    uint64_t busy{0};         // Checkpoints that could not complete due to readers or writers
+    std::chrono::microseconds lastDuration{0}; // Duration of the last checkpoint
+    std::chrono::microseconds maxDuration{0};  // Longest checkpoint
+    std::chrono::microseconds totalDuration{0};
+  };
+
+
+  // Checkpoints a WAL mode database on a background thread and connection, opened on the
+  // attached connection's VFS. Commits on the attached connection report the WAL size through
+  // sqlite3_wal_hook(), which replaces the connection's automatic checkpoints. Past
+  // passiveFrames a PASSIVE checkpoint runs, which never blocks writers. If readers kept it
+  // from catching up the checkpointer escalates to RESTART or TRUNCATE, which bound the WAL
+  // but hold the write lock while waiting up to busyTimeoutMs for the readers, so commits on
+  // other connections stall for as long.
+  class SqliteCheckpointer
+  {
+    protected:
+      SqliteDb& m_db;           // Attached writer connection (not owned)
+      SqliteCheckpointOptions m_opts;
+      std::string m_walPath;
+      int m_autoCheckpoint{0};  // wal_autocheckpoint of m_db before the WAL hook replaced it
+      SqliteDb m_ckpt;          // Checkpoint connection, used by m_thread only
+      std::atomic<int> m_frames{0};
+      mutable std::mutex m_mtx;
+      std::condition_variable m_cv;
+      bool m_stop{false};
+      bool m_due{false};
+      SqliteCheckpointStats m_stats;
+      std::thread m_thread;
+
+    public:
+      // CREATORS
+      SqliteCheckpointer(SqliteDb& db, SqliteCheckpointOptions opts = {});
+      // Removes the WAL hook and restores the connection's automatic checkpoints
+      ~SqliteCheckpointer();
+
+      SqliteCheckpointer(const SqliteCheckpointer&) = delete;
+      SqliteCheckpointer& operator=(const SqliteCheckpointer&) = delete;
+
+      // ACCESSORS
+      SqliteCheckpointStats stats() const;
+
+      // MODIFIERS
+      // Request a checkpoint check now
+      void wake();
+
+    private:
+      static int WalHook(void* self, sqlite3* db, const char* dbName, int frames);
+      void run();
+      void checkpoint(int mode);
+
+  }; // class
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
@@ -0,0 +1,925 @@
+
+#include "SqliteCompressVfs.hh"
+// Std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Posix
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+// Codecs
+#ifdef MP_SQLITE_LZ4
+# include <lz4.h>
+#endif
+#ifdef MP_SQLITE_ZSTD
+# include <zstd.h>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+using namespace std::chrono;
+
+namespace MP {
+
+
+namespace {
+
+constexpr char Magic[8] = {'M', 'P', 'S', 'Q', 'P', 'G', 'I', 'X'};
+constexpr uint32_t Version = 1;
+constexpr uint64_t SlotAlign = 512;
+constexpr uint32_t RawFlag = 1u << 31;        // Slot holds the page uncompressed
+constexpr uint64_t LockStart = 0x40000000;    // SQLite's lock bytes, never written
+constexpr uint64_t LockEnd = LockStart + SlotAlign;
+
+// Head of the index file, native byte order
+struct IndexHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t codec;
+  uint32_t pageSize;
+  uint32_t reserved;
+  uint64_t pages;       // Logical size in pages
+};
+static_assert(sizeof(IndexHeader) == 32);
+
+// Index entry of a page, follows the header in page order
+struct IndexEntry
+{
+  uint64_t off;
+  uint32_t len;         // Stored bytes | RawFlag, 0 for a page never written (zeros)
+  uint32_t crc;         // crc32 of the stored bytes
+  bool operator==(const IndexEntry&) const = default;
+};
+static_assert(sizeof(IndexEntry) == 16);
+
+
+uint64_t SlotSize(uint32_t len)
+{
+  return ((len & ~RawFlag) + SlotAlign - 1) & ~(SlotAlign - 1);
+}
+
+bool OverlapsLock(uint64_t off, uint64_t size)
+{
+  return off < LockEnd && off + size > LockStart;
+}
+
+
+uint32_t Crc32(const uint8_t* p, size_t n)
+{
+  static const auto table = [] {
+    array<uint32_t, 256> t{};
+    for(uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for(int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  uint32_t c = 0xFFFFFFFFu;
+  for(size_t i = 0; i < n; ++i) c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFu;
+}
+
+
+// ---- Codecs ----
+
+#ifdef MP_SQLITE_ZSTD
+struct ZstdFree
+{
+  void operator()(ZSTD_CCtx* c) const { ZSTD_freeCCtx(c); }
+  void operator()(ZSTD_DCtx* d) const { ZSTD_freeDCtx(d); }
+};
+#endif
+
+size_t Bound(SqliteCompressCodec codec, size_t n)
+{
+  switch(codec) {
+#ifdef MP_SQLITE_LZ4
+    case SqliteCompressCodec::Lz4: return static_cast<size_t>(LZ4_compressBound(static_cast<int>(n)));
+#endif
+#ifdef MP_SQLITE_ZSTD
+    case SqliteCompressCodec::Zstd: return ZSTD_compressBound(n);
+#endif
+    default: return n;
+  }
+}
+
+// Compressed size of src in dst, 0 when the codec cannot make it smaller
+size_t Compress(SqliteCompressCodec codec, [[maybe_unused]] int level, [[maybe_unused]] const void* src,
+                [[maybe_unused]] size_t n, [[maybe_unused]] void* dst, [[maybe_unused]] size_t cap)
+{
+  switch(codec) {
+#ifdef MP_SQLITE_LZ4
+    case SqliteCompressCodec::Lz4: {
+      int r = LZ4_compress_fast(static_cast<const char*>(src), static_cast<char*>(dst),
+                                static_cast<int>(n), static_cast<int>(cap), max(level, 1));
+      return r > 0 ? static_cast<size_t>(r) : 0;
+    }
+#endif
+#ifdef MP_SQLITE_ZSTD
+    case SqliteCompressCodec::Zstd: {
+      thread_local unique_ptr<ZSTD_CCtx, ZstdFree> cctx{ZSTD_createCCtx()};
+      size_t r = ZSTD_compressCCtx(cctx.get(), dst, cap, src, n, level);
+      return ZSTD_isError(r) ? 0 : r;
+    }
+#endif
+    default: return 0;
+  }
+}
+
+bool Decompress(SqliteCompressCodec codec, [[maybe_unused]] const void* src, [[maybe_unused]] size_t n,
+                [[maybe_unused]] void* dst, [[maybe_unused]] size_t pageSize)
+{
+  switch(codec) {
+#ifdef MP_SQLITE_LZ4
+    case SqliteCompressCodec::Lz4:
+      return LZ4_decompress_safe(static_cast<const char*>(src), static_cast<char*>(dst),
+                                 static_cast<int>(n), static_cast<int>(pageSize)) == static_cast<int>(pageSize);
+#endif
+#ifdef MP_SQLITE_ZSTD
+    case SqliteCompressCodec::Zstd: {
+      thread_local unique_ptr<ZSTD_DCtx, ZstdFree> dctx{ZSTD_createDCtx()};
+      return ZSTD_decompressDCtx(dctx.get(), dst, pageSize, src, n) == pageSize;
+    }
+#endif
+    default: return false;
+  }
+}
+
+
+// ---- State ----
+
+struct Counters
+{
+  atomic<uint64_t> pagesWritten{0};
+  atomic<uint64_t> pagesRead{0};
+  atomic<uint64_t> logicalBytes{0};
+  atomic<uint64_t> storedBytes{0};
+  atomic<uint64_t> compressNs{0};
+  atomic<uint64_t> decompressNs{0};
+  atomic<uint64_t> inPlace{0};
+  atomic<uint64_t> appended{0};
+  atomic<uint64_t> cacheHits{0};
+  atomic<uint64_t> cacheMisses{0};
+};
+
+// One registered VFS, lives as long as the process
+struct Vfs
+{
+  sqlite3_vfs base;    // Registered with SQLite, must be first
+  sqlite3_vfs* root;   // VFS delegated to
+  SqliteCompressVfsOptions opts;
+  Counters stats;
+};
+
+
+// LRU of decompressed pages
+class PageCache
+{
+  public:
+    explicit PageCache(size_t capacity) : m_capacity{capacity} {}
+
+    bool get(uint64_t pg, uint8_t* dst, size_t pageSize)
+    {
+      auto it = m_map.find(pg);
+      if(it == m_map.end()) return false;
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      memcpy(dst, it->second->second.data(), pageSize);
+      return true;
+    }
+
+    void put(uint64_t pg, const uint8_t* src, size_t pageSize)
+    {
+      if(pageSize > m_capacity) return;
+      auto it = m_map.find(pg);
+      if(it != m_map.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        it->second->second.assign(src, src + pageSize);
+        return;
+      }
+      while(m_bytes + pageSize > m_capacity) {
+        m_bytes -= m_lru.back().second.size();
+        m_map.erase(m_lru.back().first);
+        m_lru.pop_back();
+      }
+      m_lru.emplace_front(pg, vector<uint8_t>(src, src + pageSize));
+      m_map[pg] = m_lru.begin();
+      m_bytes += pageSize;
+    }
+
+    void truncate(uint64_t pages)
+    {
+      for(auto it = m_lru.begin(); it != m_lru.end();) {
+        if(it->first < pages) { ++it; continue; }
+        m_bytes -= it->second.size();
+        m_map.erase(it->first);
+        it = m_lru.erase(it);
+      }
+    }
+
+  private:
+    size_t m_capacity;
+    size_t m_bytes{0};
+    list<pair<uint64_t, vector<uint8_t>>> m_lru;
+    unordered_map<uint64_t, list<pair<uint64_t, vector<uint8_t>>>::iterator> m_map;
+};
+
+
+// Index, slot allocator and page cache of one database file, shared by its connections
+struct State
+{
+  Vfs* vfs;
+  string path;
+  int refs{0};
+  int idxFd{-1};
+  bool writable{false};  // idxFd is open for writing, some connection is read-write
+  int lockFd{-1};        // Read-only descriptor still holding the flock after the index was reopened for writing
+  mutex mtx;
+  SqliteCompressCodec codec;
+  uint32_t pageSize{0};
+  uint64_t pages{0};
+  vector<IndexEntry> index;
+  uint64_t end{0};                                 // End of the last slot
+  unordered_map<uint64_t, vector<uint64_t>> freeSlots; // Free slot offsets by slot size
+  vector<pair<uint64_t, uint64_t>> pendingFree;    // Slots freed since the last sync, {offset, size}
+  PageCache cache;
+
+  State(Vfs* v, string p) : vfs{v}, path{std::move(p)}, cache{v->opts.cacheBytes} {}
+  ~State()
+  {
+    if(idxFd >= 0) close(idxFd);
+    if(lockFd >= 0) close(lockFd);
+  }
+
+  uint64_t maxSlot() const { return SlotSize(pageSize); }
+
+  void addFree(uint64_t off, uint64_t len)
+  {
+    uint64_t chunk = max(maxSlot(), SlotAlign);
+    while(len >= SlotAlign) {
+      uint64_t n = min(len, chunk);
+      if(!OverlapsLock(off, n)) freeSlots[n].push_back(off);
+      off += n;
+      len -= n;
+    }
+  }
+
+  // Free a slot once the synced index no longer refers to it. Until then a crash could
+  // leave the old entry on disk pointing at a page written into the reused slot.
+  void addPending(uint64_t off, uint64_t len)
+  {
+    pendingFree.emplace_back(off, len);
+  }
+
+  // Free slots are the gaps between the slots of the index and those pending a sync
+  void rebuild()
+  {
+    vector<pair<uint64_t, uint64_t>> used{pendingFree};
+    for(uint64_t pg = 0; pg < pages && pg < index.size(); ++pg) {
+      if(index[pg].len) used.emplace_back(index[pg].off, SlotSize(index[pg].len));
+    }
+    sort(used.begin(), used.end());
+    freeSlots.clear();
+    uint64_t at = 0;
+    for(auto [off, size] : used) {
+      if(off > at) addFree(at, off - at);
+      at = max(at, off + size);
+    }
+    end = at;
+  }
+
+  uint64_t alloc(uint64_t size)
+  {
+    auto it = freeSlots.find(size);
+    if(it != freeSlots.end() && !it->second.empty()) {
+      uint64_t off = it->second.back();
+      it->second.pop_back();
+      return off;
+    }
+    uint64_t off = end;
+    if(OverlapsLock(off, size)) {
+      addFree(off, LockStart - off);
+      off = LockEnd;
+    }
+    end = off + size;
+    return off;
+  }
+
+  int writeHeader()
+  {
+    IndexHeader h{};
+    memcpy(h.magic, Magic, sizeof(Magic));
+    h.version = Version;
+    h.codec = static_cast<uint32_t>(codec);
+    h.pageSize = pageSize;
+    h.pages = pages;
+    return pwrite(idxFd, &h, sizeof(h), 0) == sizeof(h) ? 0 : errno ? errno : EIO;
+  }
+
+  int writeEntry(uint64_t pg, const IndexEntry& e)
+  {
+    off_t at = static_cast<off_t>(sizeof(IndexHeader) + pg * sizeof(IndexEntry));
+    return pwrite(idxFd, &e, sizeof(e), at) == sizeof(e) ? 0 : errno ? errno : EIO;
+  }
+};
+
+
+mutex s_mtx;
+deque<Vfs> s_vfs;                          // Stable addresses, never unregistered
+unordered_map<string, State*> s_states;   // Open database files by path
+
+
+int IoErr(int err, int rc)
+{
+  return err == ENOSPC ? SQLITE_FULL : rc;
+}
+
+
+// Open the index of the main database path, s_mtx held
+int OpenState(Vfs* vfs, sqlite3_file* real, const string& path, int flags, State*& out)
+{
+  string idxPath = path + "-pgidx";
+  bool readonly = flags & SQLITE_OPEN_READONLY;
+  auto it = s_states.find(path);
+  if(it != s_states.end()) {
+    State* st = it->second;
+    if(!readonly && !st->writable) {
+      // Only read-only connections so far, reopen the index for writing. The read-only
+      // descriptor keeps the lock, locking the new one would conflict with it.
+      int fd = open(idxPath.c_str(), O_RDWR | O_CLOEXEC);
+      if(fd < 0) {
+        LOG(ERROR) << format("SqliteCompressVfs cannot open {} errno={}", idxPath, errno);
+        return SQLITE_CANTOPEN;
+      }
+      st->lockFd = st->idxFd;
+      st->idxFd = fd;
+      st->writable = true;
+    }
+    st->refs++;
+    out = st;
+    return SQLITE_OK;
+  }
+
+  auto st = make_unique<State>(vfs, path);
+  // Read-only connections neither create nor write the index, e.g. on read-only media
+  st->idxFd = readonly ? open(idxPath.c_str(), O_RDONLY | O_CLOEXEC)
+                       : open(idxPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  st->writable = !readonly;
+  if(st->idxFd < 0) {
+    LOG(ERROR) << format("SqliteCompressVfs cannot open {} errno={}", idxPath, errno);
+    return SQLITE_CANTOPEN;
+  }
+  // The in-memory index is not shared with other processes
+  if(flock(st->idxFd, LOCK_EX | LOCK_NB) != 0) {
+    LOG(ERROR) << format("SqliteCompressVfs {} is open in another process", path);
+    return SQLITE_BUSY;
+  }
+
+  sqlite3_int64 dataSize = 0;
+  if(int rc = real->pMethods->xFileSize(real, &dataSize); rc != SQLITE_OK) return rc;
+  IndexHeader h{};
+  ssize_t n = pread(st->idxFd, &h, sizeof(h), 0);
+  if(dataSize == 0) {
+    // New database, a leftover index of a deleted one is discarded
+    st->codec = vfs->opts.codec;
+    if(!readonly) {
+      if(ftruncate(st->idxFd, 0) != 0 || st->writeHeader() != 0) return SQLITE_CANTOPEN;
+      if(n <= 0) {
+        // Make the new index itself durable
+        string dir = idxPath.substr(0, idxPath.find_last_of('/') + 1);
+        int dfd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if(dfd >= 0) {
+          fsync(dfd);
+          close(dfd);
+        }
+      }
+    }
+  }
+  else {
+    if(n != sizeof(h) || memcmp(h.magic, Magic, sizeof(Magic)) != 0 || h.version != Version) {
+      LOG(ERROR) << format("SqliteCompressVfs {}: missing or invalid page index", path);
+      return SQLITE_CANTOPEN;
+    }
+    st->codec = static_cast<SqliteCompressCodec>(h.codec);
+    if(st->codec != SqliteCompressCodec::Store && !SqliteCompressVfs::Supported(st->codec)) {
+      LOG(ERROR) << format("SqliteCompressVfs {}: codec {} not built in", path, h.codec);
+      return SQLITE_CANTOPEN;
+    }
+    st->pageSize = h.pageSize;
+    st->pages = h.pages;
+    st->index.resize(h.pages);
+    size_t bytes = h.pages * sizeof(IndexEntry);
+    n = pread(st->idxFd, st->index.data(), bytes, sizeof(h));
+    if(n < 0) return SQLITE_IOERR_READ;
+    // Entries past a short index were never written
+    memset(reinterpret_cast<uint8_t*>(st->index.data()) + n, 0, bytes - n);
+    st->rebuild();
+  }
+  st->refs = 1;
+  out = st.release();
+  s_states.emplace(path, out);
+  return SQLITE_OK;
+}
+
+
+void CloseState(State* st)
+{
+  lock_guard<mutex> lock(s_mtx);
+  if(--st->refs > 0) return;
+  s_states.erase(st->path);
+  delete st;
+}
+
+
+// Page pg into dst, SQLite result code
+int ReadPage(State* st, sqlite3_file* real, uint64_t pg, uint8_t* dst)
+{
+  Counters& stats = st->vfs->stats;
+  IndexEntry e{};
+  size_t pageSize;
+  {
+    lock_guard<mutex> lock(st->mtx);
+    pageSize = st->pageSize;
+    if(st->cache.get(pg, dst, pageSize)) {
+      stats.cacheHits.fetch_add(1, memory_order_relaxed);
+      return SQLITE_OK;
+    }
+    if(pg < st->pages && pg < st->index.size()) e = st->index[pg];
+  }
+  stats.cacheMisses.fetch_add(1, memory_order_relaxed);
+  if(!e.len) {
+    memset(dst, 0, pageSize);
+    return SQLITE_OK;
+  }
+
+  uint32_t len = e.len & ~RawFlag;
+  thread_local vector<uint8_t> t_buf;
+  if(t_buf.size() < len) t_buf.resize(len);
+  if(int rc = real->pMethods->xRead(real, t_buf.data(), static_cast<int>(len), static_cast<sqlite3_int64>(e.off));
+     rc != SQLITE_OK) {
+    return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_IOERR_DATA : rc;
+  }
+  if(Crc32(t_buf.data(), len) != e.crc) {
+    LOG(ERROR) << format("SqliteCompressVfs {}: page {} fails its crc", st->path, pg + 1);
+    return SQLITE_IOERR_DATA;
+  }
+  if(e.len & RawFlag) {
+    memcpy(dst, t_buf.data(), pageSize);
+  }
+  else {
+    auto t0 = steady_clock::now();
+    bool ok = Decompress(st->codec, t_buf.data(), len, dst, pageSize);
+    stats.decompressNs.fetch_add(duration_cast<nanoseconds>(steady_clock::now() - t0).count(), memory_order_relaxed);
+    if(!ok) return SQLITE_IOERR_DATA;
+  }
+  stats.pagesRead.fetch_add(1, memory_order_relaxed);
+
+  lock_guard<mutex> lock(st->mtx);
+  if(pg < st->index.size() && st->index[pg] == e) st->cache.put(pg, dst, pageSize);
+  return SQLITE_OK;
+}
+
+
+// Store page pg from src, SQLite result code
+int WritePage(State* st, sqlite3_file* real, uint64_t pg, const uint8_t* src)
+{
+  Counters& stats = st->vfs->stats;
+  size_t pageSize = st->pageSize; // Fixed once set
+  thread_local vector<uint8_t> t_buf;
+  size_t cap = Bound(st->codec, pageSize);
+  if(t_buf.size() < cap) t_buf.resize(cap);
+
+  auto t0 = steady_clock::now();
+  size_t n = Compress(st->codec, st->vfs->opts.level, src, pageSize, t_buf.data(), cap);
+  stats.compressNs.fetch_add(duration_cast<nanoseconds>(steady_clock::now() - t0).count(), memory_order_relaxed);
+  const uint8_t* data = t_buf.data();
+  uint32_t len = static_cast<uint32_t>(n);
+  if(!n || SlotSize(len) >= SlotSize(static_cast<uint32_t>(pageSize))) {
+    data = src; // Does not pay off
+    n = pageSize;
+    len = static_cast<uint32_t>(pageSize) | RawFlag;
+  }
+  IndexEntry e{0, len, Crc32(data, n)};
+
+  bool header = false;
+  {
+    lock_guard<mutex> lock(st->mtx);
+    if(pg >= st->index.size()) st->index.resize(pg + 1);
+    IndexEntry& old = st->index[pg];
+    uint64_t slot = SlotSize(len);
+    if(old.len && slot <= SlotSize(old.len)) {
+      e.off = old.off;
+      if(slot < SlotSize(old.len)) st->addPending(old.off + slot, SlotSize(old.len) - slot);
+      stats.inPlace.fetch_add(1, memory_order_relaxed);
+    }
+    else {
+      if(old.len) st->addPending(old.off, SlotSize(old.len));
+      e.off = st->alloc(slot);
+      stats.appended.fetch_add(1, memory_order_relaxed);
+    }
+    old = e;
+    st->cache.put(pg, src, pageSize);
+    if(pg >= st->pages) {
+      st->pages = pg + 1;
+      header = true;
+    }
+  }
+
+  // Page first, its entry second: a crash in between leaves the old entry failing its crc
+  if(int rc = real->pMethods->xWrite(real, data, static_cast<int>(n), static_cast<sqlite3_int64>(e.off));
+     rc != SQLITE_OK) {
+    return rc;
+  }
+  int err = st->writeEntry(pg, e);
+  if(!err && header) {
+    lock_guard<mutex> lock(st->mtx);
+    err = st->writeHeader();
+  }
+  if(err) return IoErr(err, SQLITE_IOERR_WRITE);
+  stats.pagesWritten.fetch_add(1, memory_order_relaxed);
+  stats.logicalBytes.fetch_add(pageSize, memory_order_relaxed);
+  stats.storedBytes.fetch_add(n, memory_order_relaxed);
+  return SQLITE_OK;
+}
+
+
+// ---- sqlite3_io_methods ----
+
+// sqlite3_file of the VFS, followed by the file of the delegated VFS
+struct CompressFile
+{
+  sqlite3_file base;   // Must be first
+  sqlite3_file* real;
+  State* st;           // nullptr: plain delegation
+};
+
+#define REAL(f) reinterpret_cast<CompressFile*>(f)->real
+#define STATE(f) reinterpret_cast<CompressFile*>(f)->st
+
+int FileClose(sqlite3_file* f)
+{
+  if(State* st = STATE(f)) {
+    CloseState(st);
+    STATE(f) = nullptr;
+  }
+  return REAL(f)->pMethods->xClose(REAL(f));
+}
+
+
+int FileRead(sqlite3_file* f, void* buf, int amt, sqlite3_int64 off)
+{
+  State* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xRead(REAL(f), buf, amt, off);
+  uint64_t pageSize, pages;
+  {
+    lock_guard<mutex> lock(st->mtx);
+    pageSize = st->pageSize;
+    pages = st->pages;
+  }
+  auto dst = static_cast<uint8_t*>(buf);
+  if(!pageSize) {
+    memset(dst, 0, amt);
+    return SQLITE_IOERR_SHORT_READ;
+  }
+
+  bool shortRead = false;
+  thread_local vector<uint8_t> t_page;
+  for(uint64_t at = static_cast<uint64_t>(off), left = static_cast<uint64_t>(amt); left > 0;) {
+    uint64_t pg = at / pageSize, in = at % pageSize;
+    uint64_t n = min(pageSize - in, left);
+    if(pg >= pages) {
+      memset(dst, 0, n);
+      shortRead = true;
+    }
+    else if(in == 0 && n == pageSize) {
+      if(int rc = ReadPage(st, REAL(f), pg, dst); rc != SQLITE_OK) return rc;
+    }
+    else {
+      t_page.resize(pageSize);
+      if(int rc = ReadPage(st, REAL(f), pg, t_page.data()); rc != SQLITE_OK) return rc;
+      memcpy(dst, t_page.data() + in, n);
+    }
+    dst += n;
+    at += n;
+    left -= n;
+  }
+  return shortRead ? SQLITE_IOERR_SHORT_READ : SQLITE_OK;
+}
+
+
+int FileWrite(sqlite3_file* f, const void* buf, int amt, sqlite3_int64 off)
+{
+  State* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xWrite(REAL(f), buf, amt, off);
+  {
+    lock_guard<mutex> lock(st->mtx);
+    if(!st->pageSize) {
+      // The first write of a new database is a whole page, page 1 or a checkpointed one
+      if(amt < 512 || amt > 65536 || (amt & (amt - 1))) return SQLITE_IOERR_WRITE;
+      st->pageSize = static_cast<uint32_t>(amt);
+      if(int err = st->writeHeader()) return IoErr(err, SQLITE_IOERR_WRITE);
+    }
+  }
+
+  uint64_t pageSize = st->pageSize;
+  auto src = static_cast<const uint8_t*>(buf);
+  thread_local vector<uint8_t> t_page;
+  for(uint64_t at = static_cast<uint64_t>(off), left = static_cast<uint64_t>(amt); left > 0;) {
+    uint64_t pg = at / pageSize, in = at % pageSize;
+    uint64_t n = min(pageSize - in, left);
+    if(in == 0 && n == pageSize) {
+      if(int rc = WritePage(st, REAL(f), pg, src); rc != SQLITE_OK) return rc;
+    }
+    else {
+      // Writes smaller than the first page size, e.g. after a page_size change
+      t_page.resize(pageSize);
+      if(int rc = ReadPage(st, REAL(f), pg, t_page.data()); rc != SQLITE_OK) return rc;
+      memcpy(t_page.data() + in, src, n);
+      if(int rc = WritePage(st, REAL(f), pg, t_page.data()); rc != SQLITE_OK) return rc;
+    }
+    src += n;
+    at += n;
+    left -= n;
+  }
+  return SQLITE_OK;
+}
+
+
+int FileTruncate(sqlite3_file* f, sqlite3_int64 size)
+{
+  State* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xTruncate(REAL(f), size);
+  lock_guard<mutex> lock(st->mtx);
+  if(!st->pageSize) return SQLITE_OK;
+  uint64_t pages = (static_cast<uint64_t>(size) + st->pageSize - 1) / st->pageSize;
+  if(pages >= st->pages) return SQLITE_OK;
+  st->pages = pages;
+  st->index.resize(pages);
+  st->cache.truncate(pages);
+  st->rebuild();
+  if(int err = st->writeHeader()) return IoErr(err, SQLITE_IOERR_TRUNCATE);
+  if(ftruncate(st->idxFd, static_cast<off_t>(sizeof(IndexHeader) + pages * sizeof(IndexEntry))) != 0) {
+    return SQLITE_IOERR_TRUNCATE;
+  }
+  return REAL(f)->pMethods->xTruncate(REAL(f), static_cast<sqlite3_int64>(st->end));
+}
+
+
+int FileSync(sqlite3_file* f, int flags)
+{
+  State* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xSync(REAL(f), flags);
+  // Slots freed from here on may still be referenced by entries written after the fsync
+  vector<pair<uint64_t, uint64_t>> freed;
+  {
+    lock_guard<mutex> lock(st->mtx);
+    freed.swap(st->pendingFree);
+  }
+  int rc = REAL(f)->pMethods->xSync(REAL(f), flags);
+  if(rc == SQLITE_OK) {
+    int r = flags & SQLITE_SYNC_DATAONLY ? fdatasync(st->idxFd) : fsync(st->idxFd);
+    if(r != 0) rc = SQLITE_IOERR_FSYNC;
+  }
+  lock_guard<mutex> lock(st->mtx);
+  if(rc == SQLITE_OK) {
+    for(auto [off, len] : freed) st->addFree(off, len);
+  }
+  else {
+    st->pendingFree.insert(st->pendingFree.end(), freed.begin(), freed.end());
+  }
+  return rc;
+}
+
+
+int FileSize(sqlite3_file* f, sqlite3_int64* size)
+{
+  State* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xFileSize(REAL(f), size);
+  lock_guard<mutex> lock(st->mtx);
+  *size = static_cast<sqlite3_int64>(st->pages * st->pageSize);
+  return SQLITE_OK;
+}
+
+
+int FileLock(sqlite3_file* f, int lock)
+{
+  return REAL(f)->pMethods->xLock(REAL(f), lock);
+}
+
+
+int FileUnlock(sqlite3_file* f, int lock)
+{
+  return REAL(f)->pMethods->xUnlock(REAL(f), lock);
+}
+
+
+int FileCheckReservedLock(sqlite3_file* f, int* out)
+{
+  return REAL(f)->pMethods->xCheckReservedLock(REAL(f), out);
+}
+
+
+int FileControl(sqlite3_file* f, int op, void* arg)
+{
+  // Preallocation would size the file by logical, not stored, bytes
+  if(STATE(f) && op == SQLITE_FCNTL_SIZE_HINT) return SQLITE_OK;
+  return REAL(f)->pMethods->xFileControl(REAL(f), op, arg);
+}
+
+
+int FileSectorSize(sqlite3_file* f)
+{
+  return REAL(f)->pMethods->xSectorSize(REAL(f));
+}
+
+
+int FileDeviceCharacteristics(sqlite3_file* f)
+{
+  int caps = REAL(f)->pMethods->xDeviceCharacteristics(REAL(f));
+  // A page write also writes its index entry
+  if(STATE(f)) caps &= ~(SQLITE_IOCAP_ATOMIC | SQLITE_IOCAP_ATOMIC512 | SQLITE_IOCAP_ATOMIC1K |
+                         SQLITE_IOCAP_ATOMIC2K | SQLITE_IOCAP_ATOMIC4K | SQLITE_IOCAP_ATOMIC8K |
+                         SQLITE_IOCAP_ATOMIC16K | SQLITE_IOCAP_ATOMIC32K | SQLITE_IOCAP_ATOMIC64K |
+                         SQLITE_IOCAP_BATCH_ATOMIC);
+  return caps;
+}
+
+
+int FileShmMap(sqlite3_file* f, int region, int size, int extend, void volatile** out)
+{
+  return REAL(f)->pMethods->xShmMap(REAL(f), region, size, extend, out);
+}
+
+
+int FileShmLock(sqlite3_file* f, int offset, int n, int flags)
+{
+  return REAL(f)->pMethods->xShmLock(REAL(f), offset, n, flags);
+}
+
+
+void FileShmBarrier(sqlite3_file* f)
+{
+  REAL(f)->pMethods->xShmBarrier(REAL(f));
+}
+
+
+int FileShmUnmap(sqlite3_file* f, int deleteFlag)
+{
+  return REAL(f)->pMethods->xShmUnmap(REAL(f), deleteFlag);
+}
+
+
+int FileFetch(sqlite3_file* f, sqlite3_int64 off, int amt, void** out)
+{
+  return REAL(f)->pMethods->xFetch(REAL(f), off, amt, out);
+}
+
+
+int FileUnfetch(sqlite3_file* f, sqlite3_int64 off, void* p)
+{
+  return REAL(f)->pMethods->xUnfetch(REAL(f), off, p);
+}
+
+#undef REAL
+#undef STATE
+
+
+// By iVersion, compressed files stop at 2 so SQLite never maps them
+const sqlite3_io_methods s_io[3] = {
+  {1, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+  {2, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   FileShmMap, FileShmLock, FileShmBarrier, FileShmUnmap, nullptr, nullptr},
+  {3, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   FileShmMap, FileShmLock, FileShmBarrier, FileShmUnmap, FileFetch, FileUnfetch},
+};
+
+
+int VfsOpen(sqlite3_vfs* pVfs, const char* zName, sqlite3_file* file, int flags, int* outFlags)
+{
+  Vfs* vfs = reinterpret_cast<Vfs*>(pVfs);
+  CompressFile* f = reinterpret_cast<CompressFile*>(file);
+  f->real = reinterpret_cast<sqlite3_file*>(f + 1);
+  f->st = nullptr;
+  file->pMethods = nullptr;
+  int rc = vfs->root->xOpen(vfs->root, zName, f->real, flags, outFlags);
+  if(rc != SQLITE_OK) {
+    if(f->real->pMethods) f->real->pMethods->xClose(f->real);
+    return rc;
+  }
+  int version = std::clamp(f->real->pMethods->iVersion, 1, 3);
+  if((flags & SQLITE_OPEN_MAIN_DB) && zName) {
+    {
+      lock_guard<mutex> lock(s_mtx);
+      rc = OpenState(vfs, f->real, zName, flags, f->st);
+    }
+    if(rc != SQLITE_OK) {
+      f->real->pMethods->xClose(f->real);
+      return rc;
+    }
+    version = min(version, 2);
+  }
+  file->pMethods = &s_io[version - 1];
+  return SQLITE_OK;
+}
+
+
+Vfs* FindVfs(std::string_view name)
+{
+  for(auto& v : s_vfs) if(v.opts.name == name) return &v;
+  return nullptr;
+}
+
+} // namespace
+
+
+bool SqliteCompressVfs::Supported(SqliteCompressCodec codec)
+{
+  switch(codec) {
+    case SqliteCompressCodec::Store: return true;
+#ifdef MP_SQLITE_LZ4
+    case SqliteCompressCodec::Lz4: return true;
+#endif
+#ifdef MP_SQLITE_ZSTD
+    case SqliteCompressCodec::Zstd: return true;
+#endif
+    default: return false;
+  }
+}
+
+
+int SqliteCompressVfs::Register(const SqliteCompressVfsOptions& opts)
+{
+  if(!Supported(opts.codec)) {
+    LOG(ERROR) << format("SqliteCompressVfs {}: codec {} not built in", opts.name, static_cast<uint32_t>(opts.codec));
+    return SQLITE_ERROR;
+  }
+  lock_guard<mutex> lock(s_mtx);
+  if(FindVfs(opts.name)) return SQLITE_OK;
+  sqlite3_vfs* root = sqlite3_vfs_find(nullptr);
+  if(!root) return SQLITE_ERROR;
+
+  Vfs& v = s_vfs.emplace_back();
+  v.opts = opts;
+  v.root = root;
+  // Apart from xOpen the delegated methods only use mxPathname of the VFS, which is copied
+  v.base = *root;
+  v.base.pNext = nullptr;
+  v.base.szOsFile = static_cast<int>(sizeof(CompressFile)) + root->szOsFile;
+  v.base.zName = v.opts.name.c_str();
+  v.base.pAppData = root;
+  v.base.xOpen = VfsOpen;
+  int rc = sqlite3_vfs_register(&v.base, opts.makeDefault ? 1 : 0);
+  if(rc != SQLITE_OK) s_vfs.pop_back();
+  VLOG(1) << format("SqliteCompressVfs {} registered over {} codec={} rc={}", opts.name, root->zName,
+                    static_cast<uint32_t>(opts.codec), rc);
+  return rc;
+}
+
+
+SqliteCompressVfsStats SqliteCompressVfs::Stats(std::string_view name)
+{
+  SqliteCompressVfsStats st;
+  lock_guard<mutex> lock(s_mtx);
+  Vfs* v = FindVfs(name);
+  if(!v) return st;
+  st.pagesWritten = v->stats.pagesWritten.load(memory_order_relaxed);
+  st.pagesRead = v->stats.pagesRead.load(memory_order_relaxed);
+  st.logicalBytes = v->stats.logicalBytes.load(memory_order_relaxed);
+  st.storedBytes = v->stats.storedBytes.load(memory_order_relaxed);
+  st.compressNs = v->stats.compressNs.load(memory_order_relaxed);
+  st.decompressNs = v->stats.decompressNs.load(memory_order_relaxed);
+  st.inPlace = v->stats.inPlace.load(memory_order_relaxed);
+  st.appended = v->stats.appended.load(memory_order_relaxed);
+  st.cacheHits = v->stats.cacheHits.load(memory_order_relaxed);
+  st.cacheMisses = v->stats.cacheMisses.load(memory_order_relaxed);
+  return st;
+}
+
+
+} // end namespace
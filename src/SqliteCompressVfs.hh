@@ -0,0 +1,91 @@
+#ifndef MP_SQLITECOMPRESSVFS_HH
+#define MP_SQLITECOMPRESSVFS_HH
+#pragma once
+
+/** \file SqliteCompressVfs.hh
+ * Declarations SQLite page compression VFS
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+#include <string>
+#include <string_view>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Page codec, Lz4 and Zstd exist when the library was built with MP_SQLITE_LZ4/MP_SQLITE_ZSTD
+  enum class SqliteCompressCodec : uint32_t { Store = 0, Lz4 = 1, Zstd = 2 };
+
+
+  // Options of one registered SqliteCompressVfs
+  struct SqliteCompressVfsOptions
+  {
+    std::string name{"compress"};  // VFS name, pass it to SqliteDb to select the VFS
+    SqliteCompressCodec codec{SqliteCompressCodec::Zstd}; // Codec of new databases
+    int level{3};                  // Zstd level or LZ4 acceleration
+    size_t cacheBytes{64u << 20};  // Decompressed pages cached per database file
+    bool makeDefault{false};       // Register as the default VFS of the process
+  };
+
+
+  // Counters of one registered SqliteCompressVfs
+  struct SqliteCompressVfsStats
+  {
+    uint64_t pagesWritten{0};      // Pages compressed
+    uint64_t pagesRead{0};         // Pages read and decompressed
+    uint64_t logicalBytes{0};      // Page bytes written
+    uint64_t storedBytes{0};       // Bytes they took on disk
+    uint64_t compressNs{0};
+    uint64_t decompressNs{0};
+    uint64_t inPlace{0};           // Pages rewritten in their slot
+    uint64_t appended{0};          // Pages given a new slot
+    uint64_t cacheHits{0};         // Reads served by the decompressed page cache
+    uint64_t cacheMisses{0};
+
+    double ratio() const { return storedBytes ? double(logicalBytes) / storedBytes : 0; }
+    double compressUsPerPage() const { return pagesWritten ? compressNs / 1e3 / pagesWritten : 0; }
+    double decompressUsPerPage() const { return pagesRead ? decompressNs / 1e3 / pagesRead : 0; }
+  };
+
+
+  // VFS layered over the default VFS storing main database pages compressed. The database
+  // file holds one slot per page at any offset, a sidecar "<db>-pgidx" maps each page to its
+  // {offset, length, crc32}. A rewritten page stays in its slot when it fits the slot's 512
+  // byte rounded size, otherwise it moves to a free slot of its size or the end of the file.
+  // Index entries are written after their page and synced with the database, and slots a
+  // page left are reused only once that sync succeeded, so no synced entry points at a slot
+  // holding another page. A crash can only damage pages written since the last sync, which
+  // SQLite rewrites from its journal or WAL during recovery, so committed pages are never lost.
+  // A page failing its crc reads as SQLITE_IOERR_DATA. Journals, WAL and temporary files
+  // are not compressed. Memory mapping is disabled for compressed files.
+  // The index is shared by the connections of one process and locked against other processes.
+  class SqliteCompressVfs
+  {
+    public:
+      // Register a VFS named opts.name over the current default VFS. Registering a name
+      // again keeps the first options. SQLITE_ERROR if opts.codec was not built in.
+      // Call after SqliteEngine::configure(), this initializes SQLite.
+      static int Register(const SqliteCompressVfsOptions& opts = {});
+
+      // codec was built in
+      static bool Supported(SqliteCompressCodec codec);
+
+      static SqliteCompressVfsStats Stats(std::string_view name = "compress");
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
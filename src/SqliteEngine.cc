@@ -0,0 +1,189 @@
+
+#include "SqliteEngine.hh"
+// Std
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Posix
+#include <unistd.h>
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+static atomic<bool> s_opened{false};
+static bool s_configured{false};
+static atomic<int> s_workerThreads{-1};
+static mutex s_mtx;
+
+// Config with every setting left at the compiled-in default
+static SqliteEngineConfig Unchanged()
+{
+  SqliteEngineConfig cfg;
+  cfg.threadingMode = 0;
+  cfg.memStatus = cfg.lookasideSize = cfg.lookasideCount = -1;
+  cfg.mmapSize = cfg.mmapMaxSize = -1;
+  cfg.uri = -1;
+  return cfg;
+}
+
+static SqliteEngineConfig s_effective = Unchanged();
+
+
+// sqlite3_config() has no getter, so read the mmap_size default and hard limit back as
+// SQLite clamped them, through a probe connection on a scratch file of this process
+static void ReadMmapSize(SqliteEngineConfig& eff)
+{
+  error_code ec;
+  auto path = filesystem::temp_directory_path(ec) / format("SqliteEngine_mmap_{}.probe", getpid());
+  if(ec) return;
+  sqlite3* db = nullptr;
+  if(sqlite3_open_v2(path.string().c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) == SQLITE_OK) {
+    auto pragma = [db](const char* sql) {
+      int64_t val = -1;
+      sqlite3_stmt* stmt = nullptr;
+      if(sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        val = sqlite3_column_int64(stmt, 0);
+      }
+      sqlite3_finalize(stmt);
+      return val;
+    };
+    int64_t size = pragma("PRAGMA mmap_size");
+    int64_t max = pragma("PRAGMA mmap_size=9223372036854775807"); // Clamped to the hard limit
+    if(size >= 0 && max >= 0) {
+      eff.mmapSize = size;
+      eff.mmapMaxSize = max;
+    }
+  }
+  sqlite3_close(db);
+  filesystem::remove(path, ec);
+}
+
+
+int SqliteEngine::configure(const SqliteEngineConfig& cfg)
+{
+  lock_guard<mutex> lock(s_mtx);
+  if(s_opened.load(memory_order_acquire)) {
+    LOG(ERROR) << "SqliteEngine::configure() called after a SqliteDb was opened";
+    return SQLITE_MISUSE;
+  }
+  if(s_configured) {
+    // The shutdown below would drop the global state the first call set up
+    LOG(ERROR) << "SqliteEngine::configure() called twice";
+    return SQLITE_MISUSE;
+  }
+  s_configured = true;
+
+  // sqlite3_config() only works while the library is not initialized
+  int rc = sqlite3_shutdown();
+  if(rc != SQLITE_OK) return rc;
+
+  SqliteEngineConfig eff = Unchanged();
+  auto apply = [](const char* what, int rc) {
+    if(rc != SQLITE_OK) LOG(WARNING) << format("sqlite3_config({}) rc={} {}", what, rc, sqlite3_errstr(rc));
+    return rc == SQLITE_OK;
+  };
+
+  // The allocator goes first, later settings may allocate
+  if(cfg.memMethods && apply("MALLOC", sqlite3_config(SQLITE_CONFIG_MALLOC, cfg.memMethods))) {
+    eff.memMethods = cfg.memMethods;
+  }
+  if(cfg.pcacheMethods && apply("PCACHE2", sqlite3_config(SQLITE_CONFIG_PCACHE2, cfg.pcacheMethods))) {
+    eff.pcacheMethods = cfg.pcacheMethods;
+  }
+  if(cfg.threadingMode > 0 && apply("threading mode", sqlite3_config(cfg.threadingMode))) {
+    eff.threadingMode = cfg.threadingMode;
+  }
+  if(cfg.memStatus >= 0 && apply("MEMSTATUS", sqlite3_config(SQLITE_CONFIG_MEMSTATUS, cfg.memStatus))) {
+    eff.memStatus = cfg.memStatus;
+  }
+  if(cfg.lookasideSize >= 0 && cfg.lookasideCount >= 0 &&
+     apply("LOOKASIDE", sqlite3_config(SQLITE_CONFIG_LOOKASIDE, cfg.lookasideSize, cfg.lookasideCount))) {
+    eff.lookasideSize = cfg.lookasideSize;
+    eff.lookasideCount = cfg.lookasideCount;
+  }
+  bool mmap = false;
+  if(cfg.mmapSize >= 0 || cfg.mmapMaxSize >= 0) {
+    // Negative values are passed on, SQLite then keeps its default size and compiled-in limit
+    mmap = apply("MMAP_SIZE", sqlite3_config(SQLITE_CONFIG_MMAP_SIZE, static_cast<sqlite3_int64>(cfg.mmapSize),
+                                             static_cast<sqlite3_int64>(cfg.mmapMaxSize)));
+    if(mmap) {
+      eff.mmapSize = cfg.mmapSize;
+      eff.mmapMaxSize = cfg.mmapMaxSize;
+    }
+  }
+  if(cfg.uri >= 0 && apply("URI", sqlite3_config(SQLITE_CONFIG_URI, cfg.uri))) {
+    eff.uri = cfg.uri;
+  }
+  eff.workerThreads = cfg.workerThreads;
+  s_workerThreads.store(cfg.workerThreads, memory_order_relaxed);
+
+  rc = sqlite3_initialize();
+  if(rc == SQLITE_OK && mmap) ReadMmapSize(eff);
+  eff.threadsafe = sqlite3_threadsafe();
+  s_effective = eff;
+
+  LOG(INFO) << format("SqliteEngine threading={} memstatus={} lookaside={}x{} mmap={}/{} uri={} workers={} threadsafe={}",
+                      eff.threadingMode, eff.memStatus, eff.lookasideSize, eff.lookasideCount,
+                      eff.mmapSize, eff.mmapMaxSize, eff.uri, eff.workerThreads, eff.threadsafe);
+  return rc;
+}
+
+
+SqliteEngineConfig SqliteEngine::effective()
+{
+  lock_guard<mutex> lock(s_mtx);
+  SqliteEngineConfig eff = s_effective;
+  eff.threadsafe = sqlite3_threadsafe();
+  return eff;
+}
+
+
+bool SqliteEngine::opened()
+{
+  return s_opened.load(memory_order_acquire);
+}
+
+
+// Set by BeforeOpen() and cleared by OnOpen(), see OpeningFile()
+static thread_local std::string_view t_openingFile;
+
+
+void SqliteEngine::BeforeOpen(std::string_view filename)
+{
+  t_openingFile = filename;
+  if(!s_opened.load(memory_order_relaxed)) {
+    // Serialize with a configure() in progress
+    lock_guard<mutex> lock(s_mtx);
+    s_opened.store(true, memory_order_release);
+  }
+}
+
+
+void SqliteEngine::OnOpen(sqlite3* db)
+{
+  t_openingFile = {};
+  if(!db) return;
+  int workers = s_workerThreads.load(memory_order_relaxed);
+  if(workers >= 0) sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, workers);
+}
+
+
+std::string_view SqliteEngine::OpeningFile()
+{
+  return t_openingFile;
+}
+
+
+} // end namespace
@@ -0,0 +1,75 @@
+#ifndef MP_SQLITEENGINE_HH
+#define MP_SQLITEENGINE_HH
+#pragma once
+
+/** \file SqliteEngine.hh
+ * Declarations SQLite process-wide engine configuration
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+#include <string_view>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Process-wide SQLite settings, see SqliteEngine::configure().
+  // Negative values leave the compiled-in default in place.
+  struct SqliteEngineConfig
+  {
+    int threadingMode{SQLITE_CONFIG_MULTITHREAD}; // SQLITE_CONFIG_SINGLETHREAD, _MULTITHREAD or _SERIALIZED, 0 leaves as is
+    int memStatus{0};           // Memory statistics, 0 off (avoids a global mutex per malloc), 1 on
+    int lookasideSize{1200};    // Default lookaside slot size in bytes per connection
+    int lookasideCount{100};    // Default lookaside slots per connection
+    int64_t mmapSize{-1};       // Default mmap_size of new connections
+    int64_t mmapMaxSize{-1};    // Hard upper limit of mmap_size, -1 keeps the compiled-in limit
+    int uri{1};                 // Accept URI filenames in sqlite3_open_v2()
+    int workerThreads{-1};      // SQLITE_LIMIT_WORKER_THREADS applied to every SqliteDb opened
+    const sqlite3_mem_methods* memMethods{nullptr}; // Memory allocator, e.g. SqlitePoolAllocator::Methods()
+    const sqlite3_pcache_methods2* pcacheMethods{nullptr}; // Page cache, e.g. SqlitePageCache::Methods()
+    int threadsafe{-1};         // Reported by effective(): sqlite3_threadsafe() of the build
+  };
+
+
+  // Configuration of the SQLite library itself, via sqlite3_config().
+  // Connections are thread-confined here, so the default config drops the per-connection
+  // mutexes (MULTITHREAD) and memory statistics, both of which cost in every step loop.
+  class SqliteEngine
+  {
+    public:
+      // Apply cfg, once per process. Must run before the first SqliteDb is opened and while
+      // no other sqlite3 connections exist; returns SQLITE_MISUSE after a SqliteDb was opened
+      // or on a second call. Settings SQLite rejects are logged and reported as left in
+      // place by effective().
+      static int configure(const SqliteEngineConfig& cfg);
+
+      // Settings in force, -1 where the compiled-in default applies.
+      // Configured mmap sizes are reported as read back from SQLite.
+      static SqliteEngineConfig effective();
+
+      // Has a SqliteDb been opened?
+      static bool opened();
+
+      // Called by SqliteDb before and after opening a connection, db is nullptr if opening failed
+      static void BeforeOpen(std::string_view filename);
+      static void OnOpen(sqlite3* db);
+
+      // File being opened by SqliteDb on the calling thread, empty outside of an open
+      static std::string_view OpeningFile();
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
@@ -0,0 +1,188 @@
+
+#include "SqliteGroupCommit.hh"
+// Std
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+SqliteGroupCommit::SqliteGroupCommit(std::string_view filename, SqliteGroupCommitOptions opts) :
+  m_opts{std::move(opts)},
+  m_db{filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX}
+{
+  Expects(m_db.get() != nullptr);
+  Expects(m_opts.maxBatch > 0);
+  sqlite3_busy_timeout(m_db.get(), m_opts.busyTimeoutMs);
+  if(m_opts.wal) m_db.exec("PRAGMA journal_mode=WAL");
+  m_thread = thread([this] { run(); });
+}
+
+
+SqliteGroupCommit::~SqliteGroupCommit()
+{
+  m_stop.store(true, memory_order_release);
+  m_signal.fetch_add(1, memory_order_release);
+  m_signal.notify_one();
+  m_thread.join();
+}
+
+
+SqliteGroupCommitStats SqliteGroupCommit::stats() const
+{
+  SqliteGroupCommitStats s;
+  s.writes = m_writes.load(memory_order_relaxed);
+  s.failed = m_failed.load(memory_order_relaxed);
+  s.commits = m_commits.load(memory_order_relaxed);
+  return s;
+}
+
+
+std::future<void> SqliteGroupCommit::submit(Write_t fn)
+{
+  auto node = new Queue_t::Node;
+  node->value.fn = std::move(fn);
+  future<void> f = node->value.done.get_future();
+  m_queue.push(node);
+  m_signal.fetch_add(1, memory_order_release);
+  m_signal.notify_one();
+  return f;
+}
+
+
+std::future<void> SqliteGroupCommit::submit(std::string sql)
+{
+  return submit([sql = std::move(sql)](SqliteDb& db) {
+    if(db.exec(sql) != SQLITE_OK) throw runtime_error(sqlite3_errmsg(db.get()));
+  });
+}
+
+
+// Transaction control bypasses SqliteDb::exec() so errors are returned, never thrown
+static int Control(SqliteDb& db, const char* sql)
+{
+  return sqlite3_exec(db.get(), sql, nullptr, nullptr, nullptr);
+}
+
+
+bool SqliteGroupCommit::apply(Item& item, std::vector<std::pair<Item*, std::exception_ptr>>& batch)
+{
+  // Savepoint per write so that a failure does not take the others down
+  exception_ptr error;
+  if(Control(m_db, "SAVEPOINT gc") != SQLITE_OK) {
+    error = make_exception_ptr(runtime_error(sqlite3_errmsg(m_db.get())));
+  }
+  else {
+    try {
+      item.fn(m_db);
+      // A write not throwing, e.g. with exceptions off, may still have lost the transaction
+      if(sqlite3_get_autocommit(m_db.get())) {
+        throw runtime_error(format("write rolled back the transaction: {}", sqlite3_errmsg(m_db.get())));
+      }
+      if(Control(m_db, "RELEASE gc") != SQLITE_OK) throw runtime_error(sqlite3_errmsg(m_db.get()));
+    }
+    catch(...) {
+      error = current_exception();
+      // SQLITE_FULL, IOERR, NOMEM or OR ROLLBACK can roll back the whole transaction
+      if(!sqlite3_get_autocommit(m_db.get())) {
+        Control(m_db, "ROLLBACK TO gc");
+        Control(m_db, "RELEASE gc");
+      }
+    }
+  }
+  batch.emplace_back(&item, error);
+  return !sqlite3_get_autocommit(m_db.get());
+}
+
+
+void SqliteGroupCommit::run()
+{
+  vector<unique_ptr<Queue_t::Node>> nodes;
+  vector<pair<Item*, exception_ptr>> batch;
+  nodes.reserve(m_opts.maxBatch);
+  batch.reserve(m_opts.maxBatch);
+
+  for(;;) {
+    uint32_t signal = m_signal.load(memory_order_acquire);
+    Queue_t::Node* first = m_queue.pop();
+    if(!first) {
+      if(m_stop.load(memory_order_acquire)) break;
+      m_signal.wait(signal, memory_order_acquire); // Until the next submit or stop
+      continue;
+    }
+
+    // Gather the writes of this window into one transaction
+    int rc = Control(m_db, "BEGIN IMMEDIATE");
+    size_t txnFirst = 0; // First write of batch in the open transaction
+    auto deadline = Clock_t::now() + m_opts.window;
+    for(Queue_t::Node* n = first; ; ) {
+      nodes.emplace_back(n);
+      if(rc != SQLITE_OK) {
+        batch.emplace_back(&n->value, make_exception_ptr(runtime_error(sqlite3_errmsg(m_db.get()))));
+      }
+      else if(!apply(n->value, batch)) {
+        // The transaction is gone and the earlier writes in it with it.
+        // Fail those and continue with the rest of the batch in a new transaction.
+        auto lost = make_exception_ptr(runtime_error("rolled back by a failing write in the same transaction"));
+        for(size_t i = txnFirst; i + 1 < batch.size(); ++i) if(!batch[i].second) batch[i].second = lost;
+        VLOG(1) << format("Group commit transaction rolled back, {} writes lost", batch.size() - 1 - txnFirst);
+        rc = Control(m_db, "BEGIN IMMEDIATE");
+        txnFirst = batch.size();
+      }
+      if(nodes.size() >= m_opts.maxBatch) break;
+
+      while(!(n = m_queue.pop())) {
+        auto now = Clock_t::now();
+        if(now >= deadline || m_stop.load(memory_order_relaxed)) break;
+        this_thread::sleep_for(std::min<Clock_t::duration>(deadline - now, 50us));
+      }
+      if(!n) break;
+    }
+
+    if(rc == SQLITE_OK) {
+      rc = Control(m_db, "COMMIT");
+      if(rc == SQLITE_OK) {
+        m_commits.fetch_add(1, memory_order_relaxed);
+      }
+      else {
+        // The whole batch is lost
+        string msg = sqlite3_errmsg(m_db.get());
+        Control(m_db, "ROLLBACK");
+        for(size_t i = txnFirst; i < batch.size(); ++i) {
+          if(!batch[i].second) batch[i].second = make_exception_ptr(runtime_error(msg));
+        }
+      }
+    }
+
+    // Complete the submitters after the shared commit
+    for(auto& [item, error] : batch) {
+      if(error) {
+        m_failed.fetch_add(1, memory_order_relaxed);
+        item->done.set_exception(error);
+      }
+      else {
+        m_writes.fetch_add(1, memory_order_relaxed);
+        item->done.set_value();
+      }
+    }
+    VLOG(2) << format("Group commit of {} writes", batch.size());
+    batch.clear();
+    nodes.clear();
+  }
+}
+
+
+} // end namespace
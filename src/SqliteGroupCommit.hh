@@ -0,0 +1,171 @@
+#ifndef MP_SQLITEGROUPCOMMIT_HH
+#define MP_SQLITEGROUPCOMMIT_HH
+#pragma once
+
+/** \file SqliteGroupCommit.hh
+ * Declarations SQLite group commit writer
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Intrusive multi-producer single-consumer queue (D. Vyukov).
+  // push() is wait-free, pop() is lock-free and may only be called by one thread.
+  // pop() can miss an element whose push() has not completed yet; it shows up on a later pop().
+  template <typename T>
+  class SqliteMpscQueue
+  {
+    public:
+      struct Node
+      {
+        std::atomic<Node*> next{nullptr};
+        T value;
+      };
+
+    protected:
+      alignas(64) std::atomic<Node*> m_head; // Producers push here
+      alignas(64) Node* m_tail;              // Consumer pops here
+      Node m_stub;
+
+    public:
+      SqliteMpscQueue() : m_head{&m_stub}, m_tail{&m_stub} {}
+      ~SqliteMpscQueue() { while(Node* n = pop()) delete n; }
+
+      SqliteMpscQueue(const SqliteMpscQueue&) = delete;
+      SqliteMpscQueue& operator=(const SqliteMpscQueue&) = delete;
+
+      // Takes ownership of n
+      void push(Node* n)
+      {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+      }
+
+      // Caller owns the returned node, nullptr if empty
+      Node* pop()
+      {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(tail == &m_stub) {
+          if(!next) return nullptr;
+          m_tail = tail = next;
+          next = next->next.load(std::memory_order_acquire);
+        }
+        if(next) {
+          m_tail = next;
+          return tail;
+        }
+        if(tail != m_head.load(std::memory_order_acquire)) return nullptr; // A push is in progress
+        push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if(next) {
+          m_tail = next;
+          return tail;
+        }
+        return nullptr;
+      }
+  };
+
+
+  // Options for SqliteGroupCommit
+  struct SqliteGroupCommitOptions
+  {
+    size_t maxBatch{1024};                 // Most writes per transaction
+    std::chrono::microseconds window{500}; // Longest time a transaction waits for more writes
+    int busyTimeoutMs{5000};               // busy_timeout of the writer connection
+    bool wal{true};                        // Switch the database to WAL mode
+  };
+
+
+  // Counters of a SqliteGroupCommit
+  struct SqliteGroupCommitStats
+  {
+    uint64_t writes{0};   // Writes completed
+    uint64_t failed{0};   // Writes that failed or were rolled back with their transaction
+    uint64_t commits{0};  // Transactions committed
+  };
+
+
+  // Single writer thread applying writes submitted from any thread.
+  // Writes queued within SqliteGroupCommitOptions::window, up to maxBatch of them, share one
+  // BEGIN IMMEDIATE ... COMMIT and so one fsync. Each write runs inside its own SAVEPOINT so a
+  // failing write is rolled back alone. If SQLite rolls back the whole transaction instead
+  // (SQLITE_FULL, IOERR, OR ROLLBACK...), the earlier writes of that transaction fail with it
+  // and the remaining writes start a new one. A write's future completes after the shared COMMIT.
+  class SqliteGroupCommit
+  {
+    public:
+      typedef std::function<void(SqliteDb&)> Write_t;
+      typedef std::chrono::steady_clock Clock_t;
+
+    protected:
+      struct Item
+      {
+        Write_t fn;
+        std::promise<void> done;
+      };
+      typedef SqliteMpscQueue<Item> Queue_t;
+
+      SqliteGroupCommitOptions m_opts;
+      SqliteDb m_db;                     // Writer connection, used by m_thread only
+      Queue_t m_queue;
+      std::atomic<uint32_t> m_signal{0}; // Bumped on every submit and on stop
+      std::atomic<bool> m_stop{false};
+      std::atomic<uint64_t> m_writes{0};
+      std::atomic<uint64_t> m_failed{0};
+      std::atomic<uint64_t> m_commits{0};
+      std::thread m_thread;
+
+    public:
+      // CREATORS
+      SqliteGroupCommit(std::string_view filename, SqliteGroupCommitOptions opts = {});
+      // Applies the queued writes, then stops the writer thread
+      ~SqliteGroupCommit();
+
+      SqliteGroupCommit(const SqliteGroupCommit&) = delete;
+      SqliteGroupCommit& operator=(const SqliteGroupCommit&) = delete;
+
+      // ACCESSORS
+      SqliteGroupCommitStats stats() const;
+
+      // MODIFIERS
+      // Queue a write run on the writer connection
+      std::future<void> submit(Write_t fn);
+
+      // Queue SQL text executed on the writer connection
+      std::future<void> submit(std::string sql);
+
+    private:
+      void run();
+      // Runs one write, false if the transaction was rolled back
+      bool apply(Item& item, std::vector<std::pair<Item*, std::exception_ptr>>& batch);
+
+  }; // class
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
@@ -0,0 +1,375 @@
+
+#include "SqlitePageCache.hh"
+// Std
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+// Posix
+#include <sys/mman.h>
+// Prj
+#include "SqliteEngine.hh"
+
+
+using namespace std;
+
+namespace MP {
+
+
+namespace {
+
+constexpr size_t SlabSize = 2u << 20; // One transparent huge page
+constexpr size_t HeaderSize = 64;     // Page header, keeps page buffers cache line aligned
+constexpr uint8_t MaxUse = 3;         // Saturation of the CLOCK use counter
+
+struct Cache;
+
+// Header of every cached page, followed by the page buffer and the extra bytes.
+// pinned changes under the cache's lock, the CLOCK sweep reads it and use without it.
+struct Page
+{
+  sqlite3_pcache_page base; // Handed to SQLite, must be first
+  Cache* cache;
+  unsigned key;
+  uint32_t ring;            // Position in PageCache::ring
+  atomic<uint8_t> use;      // CLOCK use counter
+  atomic<bool> pinned;
+};
+static_assert(sizeof(Page) <= HeaderSize);
+
+// Counters of the closed caches of one file
+struct FileStats
+{
+  string file;
+  uint64_t hits{0};
+  uint64_t misses{0};
+  uint64_t evictions{0};
+};
+
+// One sqlite3_pcache, i.e. one database of one connection. SQLite calls the methods of a cache
+// from one connection at a time, mtx only keeps out the evictions of other connections.
+struct Cache
+{
+  mutex mtx;                // Guards pages
+  size_t szPage;
+  size_t szExtra;
+  size_t blockSize;
+  bool purgeable;
+  unsigned maxPages{0};
+  unordered_map<unsigned, Page*> pages;
+  FileStats* stats;
+  atomic<uint64_t> hits{0};
+  atomic<uint64_t> misses{0};
+  atomic<uint64_t> evictions{0};
+};
+
+// Process-wide state: the budget, the CLOCK ring and the slabs, all access under mtx.
+// Lock order: Cache::mtx, then PageCache::mtx, then only try_lock of another Cache::mtx.
+struct PageCache
+{
+  SqlitePageCacheOptions opts;
+  mutex mtx;
+  vector<Page*> ring;      // CLOCK ring of all pages
+  size_t hand{0};
+  unordered_map<size_t, vector<void*>> freeBlocks;        // Free blocks by size
+  unordered_map<size_t, pair<uint8_t*, size_t>> carving;  // Slab being carved by block size
+  size_t used{0};
+  size_t slabBytes{0};
+  bool huge{false};
+  deque<FileStats> files;  // Stable addresses
+  unordered_map<string, FileStats*> byName;
+  unordered_set<Cache*> caches; // Open caches, for Stats()
+
+  explicit PageCache(const SqlitePageCacheOptions& o) : opts{o} {}
+};
+
+PageCache* s_pc = nullptr;
+
+
+// Map a SlabSize aligned slab, advised as a huge page
+uint8_t* MapSlab(PageCache& pc)
+{
+  size_t len = SlabSize * 2;
+  void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED) return nullptr;
+  uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  uintptr_t aligned = (start + SlabSize - 1) & ~(SlabSize - 1);
+  if(aligned > start) munmap(p, aligned - start);
+  size_t tail = start + len - (aligned + SlabSize);
+  if(tail) munmap(reinterpret_cast<void*>(aligned + SlabSize), tail);
+#ifdef MADV_HUGEPAGE
+  if(pc.opts.hugePages && madvise(reinterpret_cast<void*>(aligned), SlabSize, MADV_HUGEPAGE) == 0) pc.huge = true;
+#endif
+  pc.slabBytes += SlabSize;
+  return reinterpret_cast<uint8_t*>(aligned);
+}
+
+
+void* AllocBlock(PageCache& pc, size_t size)
+{
+  auto& free = pc.freeBlocks[size];
+  if(!free.empty()) {
+    void* b = free.back();
+    free.pop_back();
+    return b;
+  }
+  auto& [next, left] = pc.carving[size];
+  if(left < size) {
+    next = MapSlab(pc);
+    if(!next) return nullptr;
+    left = SlabSize;
+  }
+  void* b = next;
+  next += size;
+  left -= size;
+  return b;
+}
+
+
+// Both pc.mtx and the page's cache mtx are held
+void FreePage(PageCache& pc, Page* p)
+{
+  Cache* c = p->cache;
+  c->pages.erase(p->key);
+  Page* last = pc.ring.back();
+  pc.ring[p->ring] = last;
+  last->ring = p->ring;
+  pc.ring.pop_back();
+  if(pc.hand >= pc.ring.size()) pc.hand = 0;
+  pc.used -= c->blockSize;
+  pc.freeBlocks[c->blockSize].push_back(p);
+}
+
+
+// Sweep the CLOCK hand for an unpinned page with a zero use counter and free it, of cache
+// only if given. pc.mtx and the mtx of self are held. Pages of a cache busy on another
+// thread are skipped.
+bool EvictOne(PageCache& pc, Cache* self, Cache* only)
+{
+  for(size_t steps = 0, n = pc.ring.size() * (MaxUse + 1); steps < n; ++steps) {
+    if(pc.hand >= pc.ring.size()) pc.hand = 0;
+    Page* p = pc.ring[pc.hand++];
+    Cache* c = p->cache;
+    if(p->pinned.load(memory_order_relaxed) || !c->purgeable || (only && c != only)) continue;
+    if(uint8_t use = p->use.load(memory_order_relaxed)) {
+      p->use.store(use - 1, memory_order_relaxed);
+      continue;
+    }
+    unique_lock<mutex> lock(c->mtx, defer_lock);
+    if(c != self && !lock.try_lock()) continue;
+    if(p->pinned.load(memory_order_relaxed)) continue; // Fetched meanwhile
+    c->evictions.fetch_add(1, memory_order_relaxed);
+    FreePage(pc, p);
+    return true;
+  }
+  return false;
+}
+
+
+int PcInit(void*) { return SQLITE_OK; }
+void PcShutdown(void*) {}
+
+
+sqlite3_pcache* PcCreate(int szPage, int szExtra, int bPurgeable)
+{
+  auto c = new Cache;
+  c->szPage = static_cast<size_t>(szPage);
+  c->szExtra = static_cast<size_t>(szExtra);
+  c->blockSize = (HeaderSize + c->szPage + c->szExtra + 63) & ~size_t{63};
+  c->purgeable = bPurgeable != 0;
+
+  // Main databases are created while SqliteDb opens them
+  string file{SqliteEngine::OpeningFile()};
+  lock_guard<mutex> lock(s_pc->mtx);
+  auto it = s_pc->byName.find(file);
+  if(it == s_pc->byName.end()) {
+    s_pc->files.push_back(FileStats{file});
+    it = s_pc->byName.emplace(file, &s_pc->files.back()).first;
+  }
+  c->stats = it->second;
+  s_pc->caches.insert(c);
+  return reinterpret_cast<sqlite3_pcache*>(c);
+}
+
+
+void PcCachesize(sqlite3_pcache* pc, int nCachesize)
+{
+  Cache* c = reinterpret_cast<Cache*>(pc);
+  lock_guard<mutex> lock(c->mtx);
+  c->maxPages = nCachesize > 0 ? static_cast<unsigned>(nCachesize) : 0;
+}
+
+
+int PcPagecount(sqlite3_pcache* pc)
+{
+  Cache* c = reinterpret_cast<Cache*>(pc);
+  lock_guard<mutex> lock(c->mtx);
+  return static_cast<int>(c->pages.size());
+}
+
+
+sqlite3_pcache_page* PcFetch(sqlite3_pcache* pcache, unsigned key, int createFlag)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  lock_guard<mutex> lock(c->mtx);
+
+  // Hits only take the lock of this cache
+  auto it = c->pages.find(key);
+  if(it != c->pages.end()) {
+    Page* p = it->second;
+    c->hits.fetch_add(1, memory_order_relaxed);
+    if(uint8_t use = p->use.load(memory_order_relaxed); use < MaxUse) p->use.store(use + 1, memory_order_relaxed);
+    p->pinned.store(true, memory_order_relaxed);
+    return &p->base;
+  }
+  if(!createFlag) return nullptr; // Probe, not a miss
+
+  // Loading a page draws from the shared budget
+  PageCache& pc = *s_pc;
+  lock_guard<mutex> global(pc.mtx);
+  if(c->purgeable) {
+    bool overCache = c->maxPages && c->pages.size() >= c->maxPages;
+    bool overBudget = pc.used + c->blockSize > pc.opts.budgetBytes;
+    if((overCache || overBudget) && !EvictOne(pc, c, overCache ? c : nullptr) && createFlag == 1) {
+      return nullptr; // SQLite spills dirty pages and asks again with createFlag 2
+    }
+  }
+
+  void* block = AllocBlock(pc, c->blockSize);
+  if(!block) return nullptr;
+  c->misses.fetch_add(1, memory_order_relaxed); // Counted once the page is loaded, SQLite may ask again with createFlag 2
+  Page* p = new (block) Page;
+  p->base.pBuf = static_cast<uint8_t*>(block) + HeaderSize;
+  p->base.pExtra = static_cast<uint8_t*>(p->base.pBuf) + c->szPage;
+  memset(p->base.pExtra, 0, c->szExtra); // SQLite expects new pages with zeroed extra bytes
+  p->cache = c;
+  p->key = key;
+  p->use.store(0, memory_order_relaxed); // Enters cold, see SqlitePageCache
+  p->pinned.store(true, memory_order_relaxed);
+  p->ring = static_cast<uint32_t>(pc.ring.size());
+  pc.ring.push_back(p);
+  c->pages.emplace(key, p);
+  pc.used += c->blockSize;
+  return &p->base;
+}
+
+
+void PcUnpin(sqlite3_pcache* pcache, sqlite3_pcache_page* page, int discard)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  Page* p = reinterpret_cast<Page*>(page);
+  lock_guard<mutex> lock(c->mtx);
+  p->pinned.store(false, memory_order_relaxed);
+  if(discard) {
+    lock_guard<mutex> global(s_pc->mtx);
+    FreePage(*s_pc, p);
+  }
+}
+
+
+void PcRekey(sqlite3_pcache* pcache, sqlite3_pcache_page* page, unsigned oldKey, unsigned newKey)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  Page* p = reinterpret_cast<Page*>(page);
+  lock_guard<mutex> lock(c->mtx);
+  auto it = c->pages.find(newKey);
+  if(it != c->pages.end() && it->second != p) {
+    lock_guard<mutex> global(s_pc->mtx);
+    FreePage(*s_pc, it->second);
+  }
+  c->pages.erase(oldKey);
+  p->key = newKey;
+  c->pages[newKey] = p;
+}
+
+
+void PcTruncate(sqlite3_pcache* pcache, unsigned iLimit)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  lock_guard<mutex> lock(c->mtx);
+  vector<Page*> gone;
+  for(auto& [key, p] : c->pages) if(key >= iLimit) gone.push_back(p);
+  if(gone.empty()) return;
+  lock_guard<mutex> global(s_pc->mtx);
+  for(Page* p : gone) FreePage(*s_pc, p);
+}
+
+
+void PcDestroy(sqlite3_pcache* pcache)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  {
+    lock_guard<mutex> lock(c->mtx);
+    lock_guard<mutex> global(s_pc->mtx);
+    while(!c->pages.empty()) FreePage(*s_pc, c->pages.begin()->second);
+    // No page left in the ring, no other thread can reach c anymore
+    s_pc->caches.erase(c);
+    c->stats->hits += c->hits.load(memory_order_relaxed);
+    c->stats->misses += c->misses.load(memory_order_relaxed);
+    c->stats->evictions += c->evictions.load(memory_order_relaxed);
+  }
+  delete c;
+}
+
+
+void PcShrink(sqlite3_pcache* pcache)
+{
+  Cache* c = reinterpret_cast<Cache*>(pcache);
+  lock_guard<mutex> lock(c->mtx);
+  vector<Page*> gone;
+  for(auto& [key, p] : c->pages) if(!p->pinned.load(memory_order_relaxed)) gone.push_back(p);
+  if(gone.empty()) return;
+  lock_guard<mutex> global(s_pc->mtx);
+  for(Page* p : gone) FreePage(*s_pc, p);
+}
+
+
+const sqlite3_pcache_methods2 s_methods = {
+  1, nullptr, PcInit, PcShutdown, PcCreate, PcCachesize, PcPagecount,
+  PcFetch, PcUnpin, PcRekey, PcTruncate, PcDestroy, PcShrink
+};
+
+} // namespace
+
+
+const sqlite3_pcache_methods2* SqlitePageCache::Methods(const SqlitePageCacheOptions& opts)
+{
+  static once_flag once;
+  call_once(once, [&opts] { s_pc = new PageCache(opts); }); // Lives as long as the process
+  return &s_methods;
+}
+
+
+SqlitePageCacheStats SqlitePageCache::Stats()
+{
+  SqlitePageCacheStats st;
+  if(!s_pc) return st;
+  lock_guard<mutex> lock(s_pc->mtx);
+  st.budgetBytes = s_pc->opts.budgetBytes;
+  st.usedBytes = s_pc->used;
+  st.slabBytes = s_pc->slabBytes;
+  st.hugePages = s_pc->huge;
+  unordered_map<const FileStats*, size_t> index;
+  for(const auto& f : s_pc->files) {
+    index.emplace(&f, st.files.size());
+    st.files.push_back({f.file, f.hits, f.misses, f.evictions, 0});
+  }
+  // Open caches count on, their pages stay in the ring while the lock is held
+  for(const Cache* c : s_pc->caches) {
+    auto& f = st.files[index[c->stats]];
+    f.hits += c->hits.load(memory_order_relaxed);
+    f.misses += c->misses.load(memory_order_relaxed);
+    f.evictions += c->evictions.load(memory_order_relaxed);
+  }
+  for(const Page* p : s_pc->ring) st.files[index[p->cache->stats]].pages++;
+  return st;
+}
+
+
+} // end namespace
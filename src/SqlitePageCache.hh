@@ -0,0 +1,81 @@
+#ifndef MP_SQLITEPAGECACHE_HH
+#define MP_SQLITEPAGECACHE_HH
+#pragma once
+
+/** \file SqlitePageCache.hh
+ * Declarations SQLite shared budget page cache
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+#include <string>
+#include <vector>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Options of SqlitePageCache
+  struct SqlitePageCacheOptions
+  {
+    size_t budgetBytes{256u << 20}; // Memory shared by the pages of all connections
+    bool hugePages{true};           // Back slabs with transparent huge pages (MADV_HUGEPAGE)
+  };
+
+
+  // Page cache counters of one database file
+  struct SqlitePageCacheFileStats
+  {
+    // File name given to SqliteDb. "" for temporary and attached databases, and for caches
+    // SQLite recreates after the open, e.g. when PRAGMA page_size changes an empty database.
+    std::string file;
+    uint64_t hits{0};    // Fetches that found the page
+    uint64_t misses{0};  // Fetches that did not and loaded the page
+    uint64_t evictions{0}; // Pages evicted to make room
+    uint64_t pages{0};   // Pages currently cached
+  };
+
+
+  // Counters of the whole SqlitePageCache
+  struct SqlitePageCacheStats
+  {
+    size_t budgetBytes{0};
+    size_t usedBytes{0};   // Bytes held by cached pages
+    size_t slabBytes{0};   // Bytes mapped for slabs
+    bool hugePages{false}; // Slabs were advised as huge pages
+    std::vector<SqlitePageCacheFileStats> files;
+  };
+
+
+  // sqlite3_pcache_methods2 drawing every connection's pages from one process-wide budget.
+  // Pages live in 2 MiB slabs mapped with MADV_HUGEPAGE to cut TLB misses. When the budget is
+  // reached the least useful unpinned page of any connection is replaced, so busy connections
+  // take memory from idle ones instead of each holding cache_size pages. Replacement is CLOCK
+  // with a two bit use counter: new pages enter cold and only pages fetched again survive a
+  // sweep, so a large scan does not flush the hot pages. cache_size still caps each connection.
+  // A cache hit only locks the cache of its connection; loading a page also takes the
+  // process-wide lock for the budget, and eviction skips caches busy on other threads.
+  // Connections of one file still cache their own copies, the PCACHE2 interface does not allow
+  // sharing page buffers. Install with SqliteEngineConfig::pcacheMethods.
+  class SqlitePageCache
+  {
+    public:
+      // Methods of the process-wide cache, created with opts by the first call
+      static const sqlite3_pcache_methods2* Methods(const SqlitePageCacheOptions& opts = {});
+      static SqlitePageCacheStats Stats();
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
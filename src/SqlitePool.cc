@@ -0,0 +1,195 @@
+
+#include "SqlitePool.hh"
+// Std
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <thread>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+// Transaction control statements (BEGIN IMMEDIATE included) are read-only for
+// sqlite3_stmt_readonly() but must run on the connection doing the writes.
+static bool IsTransactionControl(std::string_view sql)
+{
+  // Skip blanks and comments before the first keyword
+  size_t i = 0;
+  for(;;) {
+    while(i < sql.size() && isspace(static_cast<unsigned char>(sql[i]))) ++i;
+    if(sql.substr(i, 2) == "--") {
+      i = sql.find('\n', i);
+      if(i == std::string_view::npos) return false;
+    }
+    else if(sql.substr(i, 2) == "/*") {
+      i = sql.find("*/", i + 2);
+      if(i == std::string_view::npos) return false;
+      i += 2;
+    }
+    else break;
+  }
+  string kw;
+  for(; i < sql.size() && isalpha(static_cast<unsigned char>(sql[i])); ++i) {
+    kw += static_cast<char>(toupper(static_cast<unsigned char>(sql[i])));
+  }
+  return kw == "BEGIN" || kw == "COMMIT" || kw == "END" || kw == "ROLLBACK" || kw == "SAVEPOINT" || kw == "RELEASE";
+}
+
+
+SqliteConnectionManager::SqliteConnectionManager(std::string_view filename, SqlitePoolOptions opts) :
+  m_filename{filename}, m_opts{std::move(opts)}
+{
+  m_writer = SqliteDb(m_filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX);
+  Expects(m_writer.get() != nullptr);
+  sqlite3_busy_timeout(m_writer.get(), m_opts.busyTimeoutMs);
+  m_writer.cacheCapacity(m_opts.cacheCapacity);
+
+  // Readers need WAL to run alongside the writer
+  string mode;
+  {
+    SqliteStmt jm = m_writer.stmt("PRAGMA journal_mode=WAL");
+    if(jm++) jm.column(0, mode);
+  }
+  Ensures(mode == "wal");
+
+  // Classifies unseen SQL without taking a lease, callers may hold every reader
+  m_classifier = SqliteDb(m_filename, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+  Expects(m_classifier.get() != nullptr);
+  sqlite3_busy_timeout(m_classifier.get(), m_opts.busyTimeoutMs);
+
+  size_t n = m_opts.readers ? m_opts.readers : max(1u, thread::hardware_concurrency());
+  m_readers.resize(n);
+
+  // Open and warm the readers in parallel: schema load and statement preparation
+  vector<jthread> warmers;
+  vector<string> errors(n);
+  for(size_t i = 0; i < n; ++i) {
+    warmers.emplace_back([this, i, &errors] {
+      try {
+        auto db = make_unique<SqliteDb>(m_filename, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+        if(!db->get()) throw runtime_error("cannot open reader");
+        sqlite3_busy_timeout(db->get(), m_opts.busyTimeoutMs);
+        db->cacheCapacity(m_opts.cacheCapacity);
+        if(db->exec("SELECT count(*) FROM sqlite_schema") != SQLITE_OK) throw runtime_error(sqlite3_errmsg(db->get()));
+        for(const auto& sql : m_opts.warmSql) db->cached(sql);
+        m_readers[i] = std::move(db);
+      }
+      catch(const std::exception& e) {
+        errors[i] = e.what();
+      }
+    });
+  }
+  warmers.clear(); // Joins
+
+  for(size_t i = 0; i < n; ++i) {
+    if(!errors[i].empty()) {
+      LOG(ERROR) << format("Reader {} of {}: {}", i, m_filename, errors[i]);
+      throw runtime_error(errors[i]);
+    }
+  }
+
+  m_free.resize(n);
+  for(size_t i = 0; i < n; ++i) m_free[i] = n - 1 - i;
+  VLOG(1) << format("Opened {} with 1 writer and {} readers", m_filename, n);
+}
+
+
+SqliteConnectionManager::~SqliteConnectionManager()
+{
+  // Leases must not outlive the manager
+  lock_guard<mutex> lock(m_poolMtx);
+  if(m_free.size() != m_readers.size()) {
+    LOG(ERROR) << format("{} reader leases outstanding at destruction", m_readers.size() - m_free.size());
+  }
+}
+
+
+SqliteConnectionManager::Lease SqliteConnectionManager::reader()
+{
+  unique_lock<mutex> lock(m_poolMtx);
+  m_poolCv.wait(lock, [this] { return !m_free.empty(); });
+  size_t slot = m_free.back();
+  m_free.pop_back();
+  return Lease(this, m_readers[slot].get(), slot);
+}
+
+
+SqliteConnectionManager::Lease SqliteConnectionManager::writer()
+{
+  unique_lock<mutex> lock(m_writerMtx);
+  if(m_writerBusy && m_writerOwner == this_thread::get_id()) {
+    // Waiting would deadlock, e.g. run() nested in a run() on the writer
+    LOG(ERROR) << format("Writer of {} requested again by the thread holding it", m_filename);
+    throw runtime_error("writer already leased by this thread");
+  }
+  m_writerCv.wait(lock, [this] { return !m_writerBusy; });
+  m_writerBusy = true;
+  m_writerOwner = this_thread::get_id();
+  return Lease(this, &m_writer, Lease::WriterSlot);
+}
+
+
+SqliteConnectionManager::Lease SqliteConnectionManager::route(std::string_view sql)
+{
+  return isReadOnly(sql) ? reader() : writer();
+}
+
+
+bool SqliteConnectionManager::isReadOnly(std::string_view sql)
+{
+  {
+    shared_lock<shared_mutex> lock(m_routesMtx);
+    auto it = m_routes.find(sql);
+    if(it != m_routes.end()) return it->second;
+  }
+
+  bool ro = false;
+  if(!IsTransactionControl(sql)) {
+    lock_guard<mutex> lock(m_classifierMtx);
+    auto stmt = m_classifier.tryPrepare(sql);
+    // Failures go to the writer which reports them. Not remembered, the SQL may be
+    // valid later (e.g. once its table exists).
+    if(!stmt) return false;
+    ro = sqlite3_stmt_readonly(stmt->get());
+  }
+
+  unique_lock<shared_mutex> lock(m_routesMtx);
+  // Bounded for callers building SQL dynamically, hot statements are classified again
+  if(m_routes.size() >= m_opts.routeCapacity) m_routes.clear();
+  if(m_opts.routeCapacity > 0) m_routes.emplace(sql, ro);
+  return ro;
+}
+
+
+void SqliteConnectionManager::release(size_t slot)
+{
+  if(slot == Lease::WriterSlot) {
+    {
+      lock_guard<mutex> lock(m_writerMtx);
+      m_writerBusy = false;
+      m_writerOwner = {};
+    }
+    m_writerCv.notify_one();
+    return;
+  }
+  {
+    lock_guard<mutex> lock(m_poolMtx);
+    m_free.push_back(slot);
+  }
+  m_poolCv.notify_one();
+}
+
+
+} // end namespace
@@ -0,0 +1,144 @@
+#ifndef MP_SQLITEPOOL_HH
+#define MP_SQLITEPOOL_HH
+#pragma once
+
+/** \file SqlitePool.hh
+ * Declarations SQLite connection manager
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Options for SqliteConnectionManager
+  struct SqlitePoolOptions
+  {
+    size_t readers{0};        // Reader connections, 0 for one per hardware thread
+    int busyTimeoutMs{5000};  // busy_timeout of every connection
+    size_t cacheCapacity{SqliteStmtCache::DefaultCapacity}; // Statement cache size per connection
+    std::vector<std::string> warmSql; // Statements prepared into every reader's cache at startup
+    size_t routeCapacity{1024}; // Remembered routing decisions, forgotten all at once when full
+  };
+
+
+  // Connections to one WAL mode database file: a dedicated writer and a pool of readers.
+  // Each connection has its own statement cache and is used by one thread at a time
+  // through a Lease. route()/run() send read-only statements (sqlite3_stmt_readonly)
+  // to a reader and everything else, including transaction control, to the writer.
+  // Explicit transactions spanning several statements should lease writer() directly.
+  // The writer lease belongs to the thread that took it, asking for the writer again on
+  // that thread throws instead of deadlocking. A lease may be released on any thread.
+  class SqliteConnectionManager
+  {
+    public:
+      // Exclusive use of one connection, returned to the manager on destruction
+      class Lease
+      {
+        protected:
+          SqliteConnectionManager* m_mgr; // Owning manager
+          SqliteDb* m_db;                 // Leased connection
+          size_t m_slot;                  // Reader slot, WriterSlot for the writer
+
+        public:
+          static constexpr size_t WriterSlot = static_cast<size_t>(-1);
+
+          Lease(SqliteConnectionManager* mgr, SqliteDb* db, size_t slot) : m_mgr{mgr}, m_db{db}, m_slot{slot} {}
+          Lease(Lease&& other) noexcept : m_mgr{other.m_mgr}, m_db{other.m_db}, m_slot{other.m_slot} { other.m_mgr = nullptr; }
+          Lease& operator=(Lease&&) = delete;
+          ~Lease() { if(m_mgr) m_mgr->release(m_slot); }
+
+          SqliteDb& db() { return *m_db; }
+          SqliteDb* operator->() { return m_db; }
+          bool isWriter() const { return m_slot == WriterSlot; }
+      };
+
+    protected:
+      struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+      };
+
+      std::string m_filename;
+      SqlitePoolOptions m_opts;
+      SqliteDb m_writer;                               // Dedicated writer connection
+      std::mutex m_writerMtx;                          // Guards m_writerBusy and m_writerOwner
+      std::condition_variable m_writerCv;              // Signalled when the writer is released
+      bool m_writerBusy{false};                        // The writer is leased
+      std::thread::id m_writerOwner;                   // Thread that leased the writer
+      std::vector<std::unique_ptr<SqliteDb>> m_readers; // Reader connections
+      std::vector<size_t> m_free;                      // Free reader slots
+      std::mutex m_poolMtx;
+      std::condition_variable m_poolCv;
+      std::unordered_map<std::string, bool, Hash, std::equal_to<>> m_routes; // SQL text -> read-only
+      mutable std::shared_mutex m_routesMtx;
+      SqliteDb m_classifier;                           // Prepares unseen SQL outside the pool
+      std::mutex m_classifierMtx;                      // Guards m_classifier
+
+    public:
+      // CREATORS
+      // Opens (creating if needed) filename in WAL mode and warms the readers in parallel
+      SqliteConnectionManager(std::string_view filename, SqlitePoolOptions opts = {});
+      ~SqliteConnectionManager();
+
+      SqliteConnectionManager(const SqliteConnectionManager&) = delete;
+      SqliteConnectionManager& operator=(const SqliteConnectionManager&) = delete;
+
+      // ACCESSORS
+      std::string_view getFileName() const { return m_filename; }
+      size_t readers() const { return m_readers.size(); }
+      // Routing decisions remembered, at most SqlitePoolOptions::routeCapacity
+      size_t routes() const { std::shared_lock<std::shared_mutex> lock(m_routesMtx); return m_routes.size(); }
+
+      // MODIFIERS
+      // Lease a reader, waits while all readers are in use
+      Lease reader();
+
+      // Lease the writer, waits while it is in use. Throws if this thread holds it already.
+      Lease writer();
+
+      // Lease the connection sql should run on
+      Lease route(std::string_view sql);
+
+      // Run f(SqliteStmt&) with the cached statement for sql on the routed connection
+      template <typename F>
+      decltype(auto) run(std::string_view sql, F&& f)
+      {
+        Lease lease = route(sql);
+        SqliteStmt stmt = lease->cached(sql); // Destroyed before the lease
+        return std::forward<F>(f)(stmt);
+      }
+
+      // Is sql read-only? Decided once per SQL text on a private connection, so it never
+      // waits for a lease, and remembered. SQL that fails to prepare is not remembered.
+      bool isReadOnly(std::string_view sql);
+
+    private:
+      void release(size_t slot);
+
+  }; // class
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
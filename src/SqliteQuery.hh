@@ -0,0 +1,214 @@
+#ifndef MP_SQLITEQUERY_HH
+#define MP_SQLITEQUERY_HH
+#pragma once
+
+/** \file SqliteQuery.hh
+ * Declarations SQLite typed queries
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+// Prj
+#include "Sqlite.hh"
+
+
+namespace MP {
+
+
+  // Number of host parameters in an SQL text, as sqlite3_bind_parameter_count() would report it.
+  // "?" takes the next index and "?NNN" the given one; string literals, quoted identifiers
+  // and comments are skipped. Named parameters (:AAA, @AAA, $AAA) are not supported.
+  consteval size_t SqliteCountParams(std::string_view sql)
+  {
+    size_t count = 0;
+    for(size_t i = 0; i < sql.size(); ++i) {
+      char c = sql[i];
+      if(c == '\'' || c == '"' || c == '`' || c == '[') {
+        // Skip literal or quoted identifier, doubled quotes are escapes
+        char close = (c == '[') ? ']' : c;
+        for(++i; i < sql.size(); ++i) {
+          if(sql[i] != close) continue;
+          if(close != ']' && i + 1 < sql.size() && sql[i + 1] == close) { ++i; continue; }
+          break;
+        }
+      }
+      else if(c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+        while(i < sql.size() && sql[i] != '\n') ++i;
+      }
+      else if(c == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+        for(i += 2; i + 1 < sql.size() && !(sql[i] == '*' && sql[i + 1] == '/'); ++i) {}
+        ++i;
+      }
+      else if(c == '?') {
+        size_t n = 0;
+        bool numbered = false;
+        while(i + 1 < sql.size() && sql[i + 1] >= '0' && sql[i + 1] <= '9') {
+          n = n * 10 + (sql[++i] - '0');
+          numbered = true;
+        }
+        count = numbered ? (n > count ? n : count) : count + 1;
+      }
+    }
+    return count;
+  }
+
+
+  // SQL text of a SqliteQuery. Constructed from a string literal at compile time,
+  // the build fails unless the literal has exactly NParams host parameters.
+  template <size_t NParams>
+  struct SqliteQuerySql
+  {
+    std::string_view sql;
+
+    template <size_t N>
+    consteval SqliteQuerySql(const char (&str)[N]) : sql{str, N - 1}
+    {
+      if(SqliteCountParams(sql) != NParams)
+        throw "SQL host parameter count does not match SqliteParams<>";
+    }
+  };
+
+
+  // Parameter and result row type lists of a SqliteQuery
+  template <typename... Ts>
+  struct SqliteParams { static constexpr size_t Count = sizeof...(Ts); };
+
+  template <typename... Ts>
+  struct SqliteRow { static constexpr size_t Count = sizeof...(Ts); };
+
+
+  // Owning counterpart of a result column type, views are copied out of the statement
+  template <typename T>
+  struct SqliteOwned
+  { typedef T type; static const T& copy(const T& v) { return v; } };
+
+  template <>
+  struct SqliteOwned<std::string_view>
+  { typedef std::string type; static type copy(std::string_view v) { return type(v); } };
+
+  template <>
+  struct SqliteOwned<std::span<const uint8_t>>
+  { typedef Blob_t type; static type copy(std::span<const uint8_t> v) { return type(v.begin(), v.end()); } };
+
+
+  template <typename P, typename R = SqliteRow<>>
+  class SqliteQuery;
+
+  // Typed prepared statement, e.g.
+  //   SqliteQuery<SqliteParams<int64_t>, SqliteRow<double, std::string_view>> q(db, "SELECT v, t FROM T WHERE id=?");
+  //   auto row = q.one(42);
+  // The statement comes from the connection's statement cache. execute() does reset,
+  // binding of all parameters and a single step with one error check for the lot.
+  template <typename... Ps, typename... Rs>
+  class SqliteQuery<SqliteParams<Ps...>, SqliteRow<Rs...>>
+  {
+    public:
+      typedef SqliteQuerySql<sizeof...(Ps)> Sql_t;
+      typedef std::tuple<Rs...> Row_t;
+      typedef std::tuple<typename SqliteOwned<Rs>::type...> OwnedRow_t; // Row_t with views copied
+
+    protected:
+      SqliteStmt m_stmt; // Cached statement
+
+    public:
+      // CREATORS
+      SqliteQuery(SqliteDb& db, Sql_t sql) : m_stmt{db.cached(sql.sql)}
+      {
+        Expects(m_stmt.get() != nullptr);
+        Ensures(sqlite3_bind_parameter_count(m_stmt.get()) == static_cast<int>(sizeof...(Ps)));
+        Ensures(sqlite3_column_count(m_stmt.get()) >= static_cast<int>(sizeof...(Rs)));
+      }
+
+      // ACCESSORS
+      SqliteStmt& stmt() { return m_stmt; }
+
+      // MODIFIERS
+      // Reset, bind all parameters and step once. Returns the sqlite3_step() rc.
+      inline int execute(const Ps&... args)
+      {
+        int rc = bind(std::index_sequence_for<Ps...>{}, args...);
+        if(rc != SQLITE_OK) [[unlikely]] return SqliteDb::CheckError(rc, m_stmt.ex());
+        rc = sqlite3_step(m_stmt.get());
+        if(rc != SQLITE_ROW && rc != SQLITE_DONE) [[unlikely]] return SqliteDb::CheckError(rc, m_stmt.ex());
+        return rc;
+      }
+
+      // execute() and copy the first result row, if any. The statement is reset before
+      // returning so it holds no read transaction.
+      std::optional<OwnedRow_t> one(const Ps&... args)
+      {
+        if(execute(args...) != SQLITE_ROW) {
+          m_stmt.reset();
+          return std::nullopt;
+        }
+        Row_t row;
+        decode(row, std::index_sequence_for<Rs...>{});
+        std::optional<OwnedRow_t> out{own(row, std::index_sequence_for<Rs...>{})};
+        m_stmt.reset();
+        return out;
+      }
+
+      // Reset, bind all parameters and iterate over the result rows.
+      // Text and blob arguments are copied into the statement's bind arena, the rows outlive
+      // temporaries passed as arguments. The copies are released by the next reset.
+      SqliteRows<Rs...> rows(const Ps&... args)
+      {
+        (void)m_stmt.tryReset(); // Releases the copies of the previous call
+        int rc = bind<true>(std::index_sequence_for<Ps...>{}, args...);
+        if(rc != SQLITE_OK) SqliteDb::CheckError(rc, m_stmt.ex());
+        return m_stmt.rows<Rs...>();
+      }
+
+    private:
+      template <bool Copy = false, std::size_t... Is>
+      inline int bind(std::index_sequence<Is...>, const Ps&... args)
+      {
+        sqlite3_reset(m_stmt.get());
+        int rc = SQLITE_OK;
+        // Stops at the first failure
+        (void)(((rc = bindOne<Copy>(static_cast<int>(Is) + 1, args)) == SQLITE_OK) && ...);
+        return rc;
+      }
+
+      // Binds text and blobs without copying unless Copy is set
+      template <bool Copy, typename T>
+      inline int bindOne(int pos, const T& v)
+      {
+        if constexpr(Copy && (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::span<const uint8_t>>))
+          return m_stmt.bindCopy(pos, v);
+        else if constexpr(Copy && (std::is_same_v<T, const char*> || std::is_same_v<T, std::string>))
+          return m_stmt.bindCopy(pos, std::string_view{v});
+        else if constexpr(Copy && std::is_same_v<T, Blob_t>)
+          return m_stmt.bindCopy(pos, std::span<const uint8_t>{v});
+        else
+          return m_stmt.bindValue(pos, v);
+      }
+
+      template <std::size_t... Is>
+      inline void decode(Row_t& row, std::index_sequence<Is...>)
+      { (m_stmt.column(static_cast<int>(Is), std::get<Is>(row)), ...); }
+
+      template <std::size_t... Is>
+      static OwnedRow_t own(const Row_t& row, std::index_sequence<Is...>)
+      { return OwnedRow_t{SqliteOwned<Rs>::copy(std::get<Is>(row))...}; }
+
+  }; // class
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
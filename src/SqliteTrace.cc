@@ -0,0 +1,270 @@
+
+#include "SqliteTrace.hh"
+// Std
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+using namespace std::chrono;
+
+namespace MP {
+
+
+namespace {
+
+// Append s to out as a JSON string
+void JsonString(string& out, std::string_view s)
+{
+  out += '"';
+  for(char c : s) {
+    switch(c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if(static_cast<unsigned char>(c) < 0x20) out += format("\\u{:04x}", static_cast<unsigned>(c));
+        else out += c;
+    }
+  }
+  out += '"';
+}
+
+// Key of a statement
+const char* StmtKey(sqlite3_stmt* stmt)
+{
+#ifdef SQLITE_ENABLE_NORMALIZE
+  if(const char* n = sqlite3_normalized_sql(stmt)) return n;
+#endif
+  const char* s = sqlite3_sql(stmt);
+  return s ? s : "";
+}
+
+// Histogram last recorded into by a statement on this thread
+struct StmtSlot
+{
+  uint64_t tracer{0};
+  sqlite3_stmt* stmt{nullptr};
+  std::string_view sql; // Key in SqliteTracer::m_stmts
+  SqliteLatencyHistogram* hist{nullptr};
+};
+
+// Direct mapped by statement address, a collision only costs a lookup under the lock
+constexpr size_t StmtSlots = 64;
+thread_local StmtSlot t_slots[StmtSlots];
+
+atomic<uint64_t> s_tracerIds{0};
+
+} // namespace
+
+
+// ================================= SqliteLatencyHistogram ====================================
+
+int SqliteLatencyHistogram::BucketOf(uint64_t ns)
+{
+  if(ns < SubCount) return static_cast<int>(ns);
+  int e = std::bit_width(ns) - 1; // >= SubBits
+  int sub = static_cast<int>((ns >> (e - SubBits)) & (SubCount - 1));
+  return SubCount + (e - SubBits) * SubCount + sub;
+}
+
+
+uint64_t SqliteLatencyHistogram::BucketFloor(int bucket)
+{
+  if(bucket < SubCount) return static_cast<uint64_t>(bucket);
+  int e = (bucket - SubCount) / SubCount + SubBits;
+  uint64_t sub = static_cast<uint64_t>((bucket - SubCount) % SubCount);
+  return (SubCount + sub) << (e - SubBits);
+}
+
+
+uint64_t SqliteLatencyHistogram::percentile(double q) const
+{
+  uint64_t n = count();
+  if(!n) return 0;
+  uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * n));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for(int b = 0; b < Buckets; ++b) {
+    seen += m_counts[b].load(memory_order_relaxed);
+    if(seen >= rank) {
+      uint64_t upper = b + 1 < Buckets ? BucketFloor(b + 1) - 1 : UINT64_MAX;
+      return std::min(upper, max());
+    }
+  }
+  return max(); // Counts raced ahead of m_count
+}
+
+
+void SqliteLatencyHistogram::record(uint64_t ns)
+{
+  m_counts[BucketOf(ns)].fetch_add(1, memory_order_relaxed);
+  m_count.fetch_add(1, memory_order_relaxed);
+  m_sum.fetch_add(ns, memory_order_relaxed);
+  uint64_t prev = m_max.load(memory_order_relaxed);
+  while(prev < ns && !m_max.compare_exchange_weak(prev, ns, memory_order_relaxed)) {}
+}
+
+
+void SqliteLatencyHistogram::reset()
+{
+  for(auto& c : m_counts) c.store(0, memory_order_relaxed);
+  m_count.store(0, memory_order_relaxed);
+  m_sum.store(0, memory_order_relaxed);
+  m_max.store(0, memory_order_relaxed);
+}
+
+
+// ================================= SqliteTracer ==============================================
+
+SqliteTracer::SqliteTracer(SqliteTraceOptions opts) :
+  m_id{s_tracerIds.fetch_add(1, memory_order_relaxed) + 1}, m_opts{std::move(opts)}
+{
+}
+
+
+int SqliteTracer::Callback(unsigned type, void* ctx, void* p, void* x)
+{
+  if(type == SQLITE_TRACE_PROFILE) {
+    auto ns = *static_cast<sqlite3_int64*>(x);
+    static_cast<SqliteTracer*>(ctx)->record(static_cast<sqlite3_stmt*>(p), static_cast<uint64_t>(ns));
+  }
+  return 0;
+}
+
+
+void SqliteTracer::record(sqlite3_stmt* stmt, uint64_t ns)
+{
+  std::string_view sql = StmtKey(stmt);
+  // The SQL is compared as a finalized statement's address may be reused by another one
+  StmtSlot& slot = t_slots[(reinterpret_cast<uintptr_t>(stmt) >> 4) % StmtSlots];
+  if(slot.tracer != m_id || slot.stmt != stmt || slot.sql != sql) [[unlikely]] {
+    const auto& [key, hist] = histogram(sql);
+    slot = {m_id, stmt, key, hist.get()};
+  }
+  slot.hist->record(ns);
+  if(ns >= static_cast<uint64_t>(m_opts.slowThreshold.count())) [[unlikely]] slow(stmt, sql, ns);
+}
+
+
+const SqliteTracer::Stmts_t::value_type& SqliteTracer::histogram(std::string_view sql)
+{
+  {
+    shared_lock<shared_mutex> lock(m_mtx);
+    auto it = m_stmts.find(sql);
+    if(it != m_stmts.end()) [[likely]] return *it;
+  }
+  unique_lock<shared_mutex> lock(m_mtx);
+  auto it = m_stmts.try_emplace(string(sql)).first;
+  if(!it->second) it->second = make_unique<SqliteLatencyHistogram>();
+  return *it; // Entries are never removed, the reference stays valid
+}
+
+
+void SqliteTracer::slow(sqlite3_stmt* stmt, std::string_view sql, uint64_t ns)
+{
+  // Sample evenly: the n-th slow query is expanded when n * rate crosses an integer
+  uint64_t n = m_slowSeen.fetch_add(1, memory_order_relaxed);
+  double rate = std::clamp(m_opts.sampleRate, 0.0, 1.0);
+  bool sampled = std::floor((n + 1) * rate) > std::floor(n * rate);
+
+  SqliteSlowQuery q{string(sql), {}, ns, system_clock::now()};
+  if(sampled) {
+    if(char* e = sqlite3_expanded_sql(stmt)) {
+      q.expanded = e;
+      sqlite3_free(e);
+    }
+  }
+  if(m_opts.logSlow) {
+    LOG(WARNING) << format("Slow SQLite statement {:.3f}ms: {}", ns / 1e6,
+                           q.expanded.empty() ? q.sql : q.expanded);
+  }
+
+  lock_guard<mutex> lock(m_slowMtx);
+  m_slow.push_back(std::move(q));
+  while(m_slow.size() > m_opts.slowLogSize) m_slow.pop_front();
+}
+
+
+std::vector<SqliteStatementLatency> SqliteTracer::snapshot() const
+{
+  vector<SqliteStatementLatency> out;
+  {
+    shared_lock<shared_mutex> lock(m_mtx);
+    out.reserve(m_stmts.size());
+    for(const auto& [sql, h] : m_stmts) {
+      if(!h->count()) continue;
+      out.push_back({sql, h->count(), h->sum(), h->max(),
+                     h->percentile(0.5), h->percentile(0.9), h->percentile(0.99), h->percentile(0.999)});
+    }
+  }
+  sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.sumNs > b.sumNs; });
+  return out;
+}
+
+
+std::vector<SqliteSlowQuery> SqliteTracer::slowQueries() const
+{
+  lock_guard<mutex> lock(m_slowMtx);
+  return {m_slow.begin(), m_slow.end()};
+}
+
+
+std::string SqliteTracer::json() const
+{
+  string out = "{\"statements\":[";
+  bool first = true;
+  for(const auto& s : snapshot()) {
+    if(!first) out += ',';
+    first = false;
+    out += "{\"sql\":";
+    JsonString(out, s.sql);
+    out += format(",\"count\":{},\"total_us\":{:.3f},\"mean_us\":{:.3f},\"p50_us\":{:.3f},"
+                  "\"p90_us\":{:.3f},\"p99_us\":{:.3f},\"p999_us\":{:.3f},\"max_us\":{:.3f}}}",
+                  s.count, s.sumNs / 1e3, s.sumNs / 1e3 / s.count, s.p50Ns / 1e3,
+                  s.p90Ns / 1e3, s.p99Ns / 1e3, s.p999Ns / 1e3, s.maxNs / 1e3);
+  }
+  out += "],\"slow\":[";
+  first = true;
+  for(const auto& q : slowQueries()) {
+    if(!first) out += ',';
+    first = false;
+    out += "{\"sql\":";
+    JsonString(out, q.sql);
+    if(!q.expanded.empty()) {
+      out += ",\"expanded\":";
+      JsonString(out, q.expanded);
+    }
+    auto at = duration_cast<milliseconds>(q.at.time_since_epoch()).count();
+    out += format(",\"us\":{:.3f},\"at_ms\":{}}}", q.ns / 1e3, at);
+  }
+  out += "]}";
+  return out;
+}
+
+
+void SqliteTracer::reset()
+{
+  {
+    shared_lock<shared_mutex> lock(m_mtx);
+    for(auto& [sql, h] : m_stmts) h->reset();
+  }
+  m_slowSeen.store(0, memory_order_relaxed);
+  lock_guard<mutex> lock(m_slowMtx);
+  m_slow.clear();
+}
+
+
+} // end namespace
@@ -0,0 +1,161 @@
+#ifndef MP_SQLITETRACE_HH
+#define MP_SQLITETRACE_HH
+#pragma once
+
+/** \file SqliteTrace.hh
+ * Declarations SQLite statement latency tracing
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Lock-free log-linear latency histogram in nanoseconds.
+  // 16 sub-buckets per power of two, i.e. values are kept within 6.25% at any magnitude.
+  class SqliteLatencyHistogram
+  {
+    public:
+      static constexpr int SubBits = 4;
+      static constexpr int SubCount = 1 << SubBits;
+      static constexpr int Buckets = SubCount + (64 - SubBits) * SubCount;
+
+      // Bucket of value ns, and the smallest value of a bucket
+      static int BucketOf(uint64_t ns);
+      static uint64_t BucketFloor(int bucket);
+
+      // ACCESSORS
+      uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+      uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+      uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+      // Value at quantile q in [0,1]: the upper end of its bucket, at most max()
+      uint64_t percentile(double q) const;
+
+      // MODIFIERS
+      void record(uint64_t ns);
+      void reset();
+
+    private:
+      std::atomic<uint64_t> m_counts[Buckets]{};
+      std::atomic<uint64_t> m_count{0};
+      std::atomic<uint64_t> m_sum{0};
+      std::atomic<uint64_t> m_max{0};
+  };
+
+
+  // Options of SqliteTracer
+  struct SqliteTraceOptions
+  {
+    std::chrono::nanoseconds slowThreshold{std::chrono::milliseconds(100)}; // Statements this slow go to the slow-query log
+    double sampleRate{1.0};  // Fraction of slow queries logged with their expanded SQL, expanding is costly
+    size_t slowLogSize{256}; // Most recent slow queries kept
+    bool logSlow{true};      // Also LOG(WARNING) each slow query
+  };
+
+
+  // Latencies of one statement, see SqliteTracer::snapshot()
+  struct SqliteStatementLatency
+  {
+    std::string sql;   // Normalized SQL
+    uint64_t count{0};
+    uint64_t sumNs{0};
+    uint64_t maxNs{0};
+    uint64_t p50Ns{0};
+    uint64_t p90Ns{0};
+    uint64_t p99Ns{0};
+    uint64_t p999Ns{0};
+  };
+
+
+  // Entry of the slow-query log
+  struct SqliteSlowQuery
+  {
+    std::string sql;      // Normalized SQL
+    std::string expanded; // SQL with bound parameters, empty if not sampled
+    uint64_t ns{0};
+    std::chrono::system_clock::time_point at;
+  };
+
+
+  // Aggregates statement latencies reported by SQLITE_TRACE_PROFILE into one histogram per
+  // statement, keyed by sqlite3_normalized_sql() when SQLite is built with SQLITE_ENABLE_NORMALIZE
+  // and by the SQL text otherwise. One tracer may serve many connections, see SqliteDb::trace().
+  // Recording is lock-free: each thread caches the histogram of the statements it ran, the
+  // shared lock guarding the histograms is only taken when a thread first sees a statement.
+  // Connections without a tracer have no trace callback at all.
+  class SqliteTracer
+  {
+    protected:
+      struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+      };
+      typedef std::unordered_map<std::string, std::unique_ptr<SqliteLatencyHistogram>, Hash, std::equal_to<>> Stmts_t;
+
+      const uint64_t m_id;             // Unique per tracer, tags the per-thread cache entries
+      SqliteTraceOptions m_opts;
+      mutable std::shared_mutex m_mtx; // Guards m_stmts
+      Stmts_t m_stmts;
+      std::atomic<uint64_t> m_slowSeen{0};
+      mutable std::mutex m_slowMtx;   // Guards m_slow
+      std::deque<SqliteSlowQuery> m_slow;
+
+    public:
+      // CREATORS
+      explicit SqliteTracer(SqliteTraceOptions opts = {});
+
+      SqliteTracer(const SqliteTracer&) = delete;
+      SqliteTracer& operator=(const SqliteTracer&) = delete;
+
+      // ACCESSORS
+      const SqliteTraceOptions& options() const { return m_opts; }
+      // Latencies per statement, slowest total first
+      std::vector<SqliteStatementLatency> snapshot() const;
+      // Slow-query log, oldest first
+      std::vector<SqliteSlowQuery> slowQueries() const;
+      // snapshot() and slowQueries() as a JSON object, latencies in microseconds
+      std::string json() const;
+
+      // MODIFIERS
+      // Record one run of stmt that took ns
+      void record(sqlite3_stmt* stmt, uint64_t ns);
+      // Clear all histograms and the slow-query log
+      void reset();
+
+      // STATIC MEMBERS
+      // sqlite3_trace_v2() callback, ctx is the SqliteTracer
+      static int Callback(unsigned type, void* ctx, void* p, void* x);
+
+    private:
+      // Entry of sql in m_stmts, created on first use
+      const Stmts_t::value_type& histogram(std::string_view sql);
+      void slow(sqlite3_stmt* stmt, std::string_view sql, uint64_t ns);
+
+  }; // class
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
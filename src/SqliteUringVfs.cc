@@ -0,0 +1,772 @@
+
+#include "SqliteUringVfs.hh"
+// Std
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__GNUC__) && (__GNUC__ < 13)
+# define FMT_HEADER_ONLY
+# include <fmt/core.h>
+using namespace fmt;
+#else
+# include <format>
+#endif
+// Posix
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// Prj
+#include <absl/log/log.h>
+
+
+using namespace std;
+
+namespace MP {
+
+
+namespace {
+
+constexpr unsigned SeqRun = 2;            // Sequential reads before readahead starts
+constexpr uint64_t ReadTag = ~0ull;       // user_data of a synchronous read
+constexpr uint64_t AheadTag = ~0ull - 1;  // user_data of the readahead window
+constexpr uint64_t FsyncTag = ~0ull - 2;  // user_data of a checkpoint fsync
+                                          // Any other user_data is a write slot
+
+struct Counters
+{
+  atomic<uint64_t> files{0};
+  atomic<uint64_t> fallbackFiles{0};
+  atomic<uint64_t> reads{0};
+  atomic<uint64_t> readaheads{0};
+  atomic<uint64_t> readaheadHits{0};
+  atomic<uint64_t> writes{0};
+  atomic<uint64_t> syncs{0};
+};
+
+// One registered VFS, lives as long as the process
+struct Vfs
+{
+  sqlite3_vfs base;    // Registered with SQLite, must be first
+  sqlite3_vfs* root;   // VFS delegated to
+  SqliteUringVfsOptions opts;
+  bool uring;          // Files get an io_uring
+  Counters stats;
+};
+
+
+// Minimal io_uring over the raw system calls. No SQPOLL, the kernel reads the submission
+// queue in io_uring_enter only.
+class Ring
+{
+  public:
+    ~Ring()
+    {
+      if(m_sqes != MAP_FAILED) munmap(m_sqes, m_sqesLen);
+      if(m_cq != MAP_FAILED && m_cq != m_sq) munmap(m_cq, m_cqLen);
+      if(m_sq != MAP_FAILED) munmap(m_sq, m_sqLen);
+      if(m_fd >= 0) close(m_fd);
+    }
+
+    bool init(unsigned depth)
+    {
+      io_uring_params p{};
+      m_fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &p));
+      if(m_fd < 0) return false;
+      if(!(p.features & IORING_FEAT_RW_CUR_POS)) return false; // Pre 5.6, no IORING_OP_READ/WRITE
+
+      m_sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      m_cqLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+      bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+      if(single) m_sqLen = m_cqLen = max(m_sqLen, m_cqLen);
+      m_sq = mmap(nullptr, m_sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+      if(m_sq == MAP_FAILED) return false;
+      m_cq = single ? m_sq : mmap(nullptr, m_cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  m_fd, IORING_OFF_CQ_RING);
+      if(m_cq == MAP_FAILED) return false;
+      m_sqesLen = p.sq_entries * sizeof(io_uring_sqe);
+      m_sqes = mmap(nullptr, m_sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+      if(m_sqes == MAP_FAILED) return false;
+
+      auto sq = static_cast<uint8_t*>(m_sq);
+      auto cq = static_cast<uint8_t*>(m_cq);
+      m_sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+      m_sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+      m_sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+      m_cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+      m_cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+      m_cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+      m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+      m_entries = p.sq_entries;
+      return true;
+    }
+
+    // Entries prepared or in flight, at most entries() so the completion queue never overflows
+    unsigned busy() const { return m_queued + m_inflight; }
+    unsigned queued() const { return m_queued; }
+    unsigned entries() const { return m_entries; }
+
+    // Prepare the next entry, busy() must be below entries()
+    io_uring_sqe* next()
+    {
+      unsigned tail = *m_sqTail;
+      unsigned idx = tail & m_sqMask;
+      io_uring_sqe* sqe = static_cast<io_uring_sqe*>(m_sqes) + idx;
+      memset(sqe, 0, sizeof(*sqe));
+      m_sqArray[idx] = idx;
+      atomic_ref<unsigned>(*m_sqTail).store(tail + 1, memory_order_release);
+      m_queued++;
+      return sqe;
+    }
+
+    // Submit the prepared entries and wait for wait completions, -errno on failure
+    int enter(unsigned wait)
+    {
+      for(;;) {
+        unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        long r = syscall(__NR_io_uring_enter, m_fd, m_queued, wait, flags, nullptr, 0);
+        if(r < 0) {
+          if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+          return -errno;
+        }
+        m_queued -= static_cast<unsigned>(r);
+        m_inflight += static_cast<unsigned>(r);
+        if(!m_queued) return 0;
+      }
+    }
+
+    // Pop a completion
+    bool peek(io_uring_cqe& cqe)
+    {
+      unsigned head = *m_cqHead;
+      if(head == atomic_ref<unsigned>(*m_cqTail).load(memory_order_acquire)) return false;
+      cqe = m_cqes[head & m_cqMask];
+      atomic_ref<unsigned>(*m_cqHead).store(head + 1, memory_order_release);
+      m_inflight--;
+      return true;
+    }
+
+    // Withdraw the prepared entries after a failed enter(), returns their user_data
+    vector<uint64_t> discard()
+    {
+      vector<uint64_t> out;
+      unsigned tail = *m_sqTail;
+      for(unsigned i = m_queued; i > 0; --i) {
+        out.push_back(static_cast<io_uring_sqe*>(m_sqes)[(tail - i) & m_sqMask].user_data);
+      }
+      atomic_ref<unsigned>(*m_sqTail).store(tail - m_queued, memory_order_release);
+      m_queued = 0;
+      return out;
+    }
+
+  private:
+    int m_fd{-1};
+    void* m_sq{MAP_FAILED};
+    void* m_cq{MAP_FAILED};
+    void* m_sqes{MAP_FAILED};
+    size_t m_sqLen{0};
+    size_t m_cqLen{0};
+    size_t m_sqesLen{0};
+    unsigned* m_sqTail{nullptr};
+    unsigned* m_sqArray{nullptr};
+    unsigned* m_cqHead{nullptr};
+    unsigned* m_cqTail{nullptr};
+    io_uring_cqe* m_cqes{nullptr};
+    unsigned m_sqMask{0};
+    unsigned m_cqMask{0};
+    unsigned m_entries{0};
+    unsigned m_queued{0};
+    unsigned m_inflight{0};
+};
+
+
+// Checkpoint write waiting for its completion, owns a copy of the page
+struct WriteSlot
+{
+  unique_ptr<uint8_t[]> buf;
+  size_t cap{0};
+  int64_t off{0};
+  unsigned len{0};
+};
+
+
+// io_uring state of one main database file. Used by one connection at a time.
+struct FileState
+{
+  Vfs* vfs;
+  int fd;              // Owned by the unix VFS
+  Ring ring;
+  // Synchronous read
+  int readRes{0};
+  bool readDone{true};
+  // Readahead window
+  vector<uint8_t> window;
+  int64_t winOff{-1};
+  size_t winReq{0};    // Bytes requested
+  size_t winLen{0};    // Bytes read
+  bool winPending{false};
+  int64_t nextOff{-1}; // End of the previous read
+  unsigned seqRun{0};  // Sequential reads in a row
+  // Checkpoint writes
+  bool ckpt{false};
+  bool ckptSync{false}; // The next xSync completes the checkpoint
+  bool ckptFailed{false}; // A page write returned the checkpoint's write error
+  vector<WriteSlot> slots;
+  vector<unsigned> freeSlots;
+  unsigned writesInflight{0};
+  int writeErr{0};     // First failed write, errno
+  int fsyncRes{0};
+  bool fsyncDone{true};
+
+  bool inWindow(int64_t off, int amt, size_t len) const
+  {
+    return winOff >= 0 && off >= winOff && off + amt <= winOff + static_cast<int64_t>(len);
+  }
+
+  void complete(uint64_t tag, int res)
+  {
+    if(tag == ReadTag) {
+      readRes = res;
+      readDone = true;
+    }
+    else if(tag == AheadTag) {
+      winLen = res > 0 ? static_cast<size_t>(res) : 0;
+      winPending = false;
+    }
+    else if(tag == FsyncTag) {
+      fsyncRes = res;
+      fsyncDone = true;
+    }
+    else {
+      WriteSlot& w = slots[tag];
+      // Finish a short write and retry a failed one here, synchronously
+      size_t done = res > 0 ? static_cast<size_t>(res) : 0;
+      int err = 0;
+      while(done < w.len) {
+        ssize_t n = pwrite(fd, w.buf.get() + done, w.len - done, w.off + done);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+          err = n < 0 ? errno : EIO;
+          break;
+        }
+        done += static_cast<size_t>(n);
+      }
+      if(err && !writeErr) writeErr = err;
+      freeSlots.push_back(static_cast<unsigned>(tag));
+      writesInflight--;
+    }
+  }
+
+  // Submit and wait for wait completions, failed submissions complete with -ECANCELED
+  int submit(unsigned wait)
+  {
+    int r = ring.enter(wait);
+    if(r < 0) {
+      LOG(ERROR) << format("SqliteUringVfs io_uring_enter failed errno={}", -r);
+      for(uint64_t tag : ring.discard()) complete(tag, -ECANCELED);
+    }
+    return r;
+  }
+
+  void reap()
+  {
+    io_uring_cqe cqe;
+    while(ring.peek(cqe)) complete(cqe.user_data, cqe.res);
+  }
+
+  // Reap completions until done() holds
+  template <typename Done>
+  int waitUntil(Done done)
+  {
+    reap();
+    while(!done()) {
+      if(int r = submit(1); r < 0) return r;
+      reap();
+    }
+    return 0;
+  }
+
+  // Make room for one more entry
+  int reserve()
+  {
+    reap();
+    while(ring.busy() >= ring.entries()) {
+      if(int r = submit(1); r < 0) return r;
+      reap();
+    }
+    return 0;
+  }
+
+  // Read through the ring, bytes read or -errno
+  int read(void* buf, int amt, int64_t off)
+  {
+    if(int r = reserve(); r < 0) return r;
+    io_uring_sqe* sqe = ring.next();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<unsigned>(amt);
+    sqe->off = static_cast<uint64_t>(off);
+    sqe->user_data = ReadTag;
+    readDone = false;
+    vfs->stats.reads.fetch_add(1, memory_order_relaxed);
+    if(int r = waitUntil([this] { return readDone; }); r < 0) return r;
+    return readRes;
+  }
+
+  void readahead(int64_t off, int amt)
+  {
+    size_t len = static_cast<size_t>(amt) * vfs->opts.readaheadPages;
+    if(window.size() < len) window.resize(len);
+    if(reserve() < 0) return;
+    io_uring_sqe* sqe = ring.next();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(window.data());
+    sqe->len = static_cast<unsigned>(len);
+    sqe->off = static_cast<uint64_t>(off);
+    sqe->user_data = AheadTag;
+    winOff = off;
+    winReq = len;
+    winLen = 0;
+    winPending = true;
+    vfs->stats.readaheads.fetch_add(1, memory_order_relaxed);
+    submit(0);
+  }
+
+  // Forget the window, the file may have changed underneath it
+  void dropWindow()
+  {
+    if(winPending) waitUntil([this] { return !winPending; });
+    winOff = -1;
+    winLen = 0;
+    seqRun = 0;
+  }
+
+  int write(const void* buf, int amt, int64_t off)
+  {
+    if(int r = reserve(); r < 0) return r;
+    unsigned slot = freeSlots.back();
+    freeSlots.pop_back();
+    WriteSlot& w = slots[slot];
+    if(w.cap < static_cast<size_t>(amt)) {
+      w.buf = make_unique<uint8_t[]>(amt);
+      w.cap = static_cast<size_t>(amt);
+    }
+    memcpy(w.buf.get(), buf, amt);
+    w.off = off;
+    w.len = static_cast<unsigned>(amt);
+    io_uring_sqe* sqe = ring.next();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(w.buf.get());
+    sqe->len = w.len;
+    sqe->off = static_cast<uint64_t>(off);
+    sqe->user_data = slot;
+    writesInflight++;
+    vfs->stats.writes.fetch_add(1, memory_order_relaxed);
+    // The device works on half a queue while SQLite copies the next half
+    if(ring.queued() >= max(1u, ring.entries() / 2)) submit(0);
+    return 0;
+  }
+
+  // Wait for the queued writes, first write errno or 0
+  int drainWrites()
+  {
+    int r = waitUntil([this] { return writesInflight == 0; });
+    int err = writeErr ? writeErr : -r;
+    writeErr = 0;
+    return err;
+  }
+
+  int fsync(bool dataOnly)
+  {
+    if(int r = reserve(); r < 0) return -r;
+    io_uring_sqe* sqe = ring.next();
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->flags = IOSQE_IO_DRAIN; // Runs after every write before it
+    sqe->fd = fd;
+    sqe->fsync_flags = dataOnly ? IORING_FSYNC_DATASYNC : 0;
+    sqe->user_data = FsyncTag;
+    fsyncDone = false;
+    vfs->stats.syncs.fetch_add(1, memory_order_relaxed);
+    int r = waitUntil([this] { return fsyncDone && writesInflight == 0; });
+    if(int err = drainWrites()) return err;
+    if(r < 0) return -r;
+    return fsyncRes < 0 ? -fsyncRes : 0;
+  }
+
+  // Before any other I/O: wait for the queued writes, errno of a failed one
+  int settle() { return writesInflight || writeErr ? drainWrites() : 0; }
+};
+
+
+// sqlite3_file of the VFS, followed by the file of the delegated VFS
+struct UringFile
+{
+  sqlite3_file base;   // Must be first
+  sqlite3_file* real;
+  FileState* st;       // nullptr: plain delegation
+};
+
+
+// Descriptor of a file opened by the unix VFS, from the head of its unixFile
+int UnixFd(sqlite3_file* real, const char* zName)
+{
+  struct UnixFileHead
+  {
+    const sqlite3_io_methods* pMethod;
+    sqlite3_vfs* pVfs;
+    void* pInode;
+    int h;
+  };
+  int fd = reinterpret_cast<UnixFileHead*>(real)->h;
+  struct stat a, b;
+  if(fd < 0 || fstat(fd, &a) != 0 || stat(zName, &b) != 0) return -1;
+  return a.st_dev == b.st_dev && a.st_ino == b.st_ino ? fd : -1;
+}
+
+
+int IoErr(int err, int rc)
+{
+  return err == ENOSPC ? SQLITE_FULL : rc;
+}
+
+
+#define REAL(f) reinterpret_cast<UringFile*>(f)->real
+#define STATE(f) reinterpret_cast<UringFile*>(f)->st
+
+int FileClose(sqlite3_file* f)
+{
+  if(FileState* st = STATE(f)) {
+    st->settle();
+    st->dropWindow();
+    delete st;
+    STATE(f) = nullptr;
+  }
+  return REAL(f)->pMethods->xClose(REAL(f));
+}
+
+
+int FileRead(sqlite3_file* f, void* buf, int amt, sqlite3_int64 off)
+{
+  FileState* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xRead(REAL(f), buf, amt, off);
+  if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+
+  st->seqRun = off == st->nextOff ? st->seqRun + 1 : 0;
+  st->nextOff = off + amt;
+  if(st->winPending && st->inWindow(off, amt, st->winReq)) {
+    st->waitUntil([st] { return !st->winPending; });
+  }
+  if(!st->winPending && st->inWindow(off, amt, st->winLen)) {
+    memcpy(buf, st->window.data() + (off - st->winOff), amt);
+    st->vfs->stats.readaheadHits.fetch_add(1, memory_order_relaxed);
+  }
+  else {
+    int n = st->read(buf, amt, off);
+    if(n < 0) return SQLITE_IOERR_READ;
+    if(n < amt) {
+      memset(static_cast<uint8_t*>(buf) + n, 0, amt - n); // SQLite requires the zero fill
+      return SQLITE_IOERR_SHORT_READ;
+    }
+  }
+  if(st->vfs->opts.readaheadPages && st->seqRun >= SeqRun && !st->winPending &&
+     !st->inWindow(off + amt, amt, st->winLen)) {
+    st->readahead(off + amt, amt);
+  }
+  return SQLITE_OK;
+}
+
+
+int FileWrite(sqlite3_file* f, const void* buf, int amt, sqlite3_int64 off)
+{
+  FileState* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xWrite(REAL(f), buf, amt, off);
+  st->dropWindow();
+  if(st->ckpt) {
+    int err = -st->write(buf, amt, off);
+    // A reaped write failed its retry too, fail the checkpoint before it publishes the backfill
+    if(!err) err = st->writeErr;
+    if(!err) return SQLITE_OK;
+    st->ckptFailed = true;
+    return IoErr(err, SQLITE_IOERR_WRITE);
+  }
+  return REAL(f)->pMethods->xWrite(REAL(f), buf, amt, off);
+}
+
+
+int FileTruncate(sqlite3_file* f, sqlite3_int64 size)
+{
+  if(FileState* st = STATE(f)) {
+    if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+    st->dropWindow();
+  }
+  return REAL(f)->pMethods->xTruncate(REAL(f), size);
+}
+
+
+int FileSync(sqlite3_file* f, int flags)
+{
+  FileState* st = STATE(f);
+  if(!st) return REAL(f)->pMethods->xSync(REAL(f), flags);
+  // The unix VFS syncs the directory for new journals and WAL files only, never main databases
+  if(st->ckpt || st->ckptSync) {
+    st->ckptSync = false;
+    int err = st->fsync((flags & SQLITE_SYNC_DATAONLY) != 0);
+    return err ? IoErr(err, SQLITE_IOERR_FSYNC) : SQLITE_OK;
+  }
+  if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+  return REAL(f)->pMethods->xSync(REAL(f), flags);
+}
+
+
+int FileSize(sqlite3_file* f, sqlite3_int64* size)
+{
+  if(FileState* st = STATE(f)) {
+    if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+  }
+  return REAL(f)->pMethods->xFileSize(REAL(f), size);
+}
+
+
+// Other connections may write the file once a lock changes hands
+int FileLock(sqlite3_file* f, int lock)
+{
+  if(FileState* st = STATE(f)) st->dropWindow();
+  return REAL(f)->pMethods->xLock(REAL(f), lock);
+}
+
+
+int FileUnlock(sqlite3_file* f, int lock)
+{
+  if(FileState* st = STATE(f)) {
+    if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+    st->dropWindow();
+  }
+  return REAL(f)->pMethods->xUnlock(REAL(f), lock);
+}
+
+
+int FileCheckReservedLock(sqlite3_file* f, int* out)
+{
+  return REAL(f)->pMethods->xCheckReservedLock(REAL(f), out);
+}
+
+
+int FileControl(sqlite3_file* f, int op, void* arg)
+{
+  if(FileState* st = STATE(f)) {
+    if(op == SQLITE_FCNTL_CKPT_START) {
+      st->settle();
+      st->ckpt = true;
+      st->ckptFailed = false;
+    }
+    else if(op == SQLITE_FCNTL_CKPT_DONE) {
+      // SQLite publishes the backfill next, with synchronous=OFF or a partial checkpoint no
+      // xSync or xTruncate follows. The last writes complete here and a failed one was
+      // retried synchronously. The hint cannot fail the checkpoint, should the retry fail too
+      // the error stays pending for the next xSync or xTruncate.
+      st->ckpt = false;
+      st->ckptSync = true;
+      if(int err = st->settle(); err && !st->ckptFailed) {
+        LOG(ERROR) << format("SqliteUringVfs checkpoint write failed errno={}", err);
+        st->writeErr = err;
+      }
+    }
+    else if(int err = st->settle()) {
+      return IoErr(err, SQLITE_IOERR_WRITE);
+    }
+  }
+  return REAL(f)->pMethods->xFileControl(REAL(f), op, arg);
+}
+
+
+int FileSectorSize(sqlite3_file* f)
+{
+  return REAL(f)->pMethods->xSectorSize(REAL(f));
+}
+
+
+int FileDeviceCharacteristics(sqlite3_file* f)
+{
+  return REAL(f)->pMethods->xDeviceCharacteristics(REAL(f));
+}
+
+
+int FileShmMap(sqlite3_file* f, int region, int size, int extend, void volatile** out)
+{
+  return REAL(f)->pMethods->xShmMap(REAL(f), region, size, extend, out);
+}
+
+
+// A WAL read transaction starts with a shared memory lock, pages may have been checkpointed
+int FileShmLock(sqlite3_file* f, int offset, int n, int flags)
+{
+  if(FileState* st = STATE(f)) {
+    // Other connections read the database once a checkpoint drops its lock
+    if(flags & SQLITE_SHM_UNLOCK) {
+      if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+    }
+    st->dropWindow();
+  }
+  return REAL(f)->pMethods->xShmLock(REAL(f), offset, n, flags);
+}
+
+
+void FileShmBarrier(sqlite3_file* f)
+{
+  REAL(f)->pMethods->xShmBarrier(REAL(f));
+}
+
+
+int FileShmUnmap(sqlite3_file* f, int deleteFlag)
+{
+  return REAL(f)->pMethods->xShmUnmap(REAL(f), deleteFlag);
+}
+
+
+int FileFetch(sqlite3_file* f, sqlite3_int64 off, int amt, void** out)
+{
+  if(FileState* st = STATE(f)) {
+    if(int err = st->settle()) return IoErr(err, SQLITE_IOERR_WRITE);
+  }
+  return REAL(f)->pMethods->xFetch(REAL(f), off, amt, out);
+}
+
+
+int FileUnfetch(sqlite3_file* f, sqlite3_int64 off, void* p)
+{
+  return REAL(f)->pMethods->xUnfetch(REAL(f), off, p);
+}
+
+#undef REAL
+#undef STATE
+
+
+// By iVersion of the delegated file, SQLite checks it before calling the later methods
+const sqlite3_io_methods s_io[3] = {
+  {1, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+  {2, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   FileShmMap, FileShmLock, FileShmBarrier, FileShmUnmap, nullptr, nullptr},
+  {3, FileClose, FileRead, FileWrite, FileTruncate, FileSync, FileSize, FileLock, FileUnlock,
+   FileCheckReservedLock, FileControl, FileSectorSize, FileDeviceCharacteristics,
+   FileShmMap, FileShmLock, FileShmBarrier, FileShmUnmap, FileFetch, FileUnfetch},
+};
+
+
+FileState* NewState(Vfs* vfs, sqlite3_file* real, const char* zName)
+{
+  int fd = UnixFd(real, zName);
+  if(fd < 0) return nullptr;
+  auto st = make_unique<FileState>();
+  st->vfs = vfs;
+  st->fd = fd;
+  if(!st->ring.init(vfs->opts.queueDepth)) return nullptr;
+  st->slots.resize(st->ring.entries());
+  for(unsigned i = st->ring.entries(); i > 0; --i) st->freeSlots.push_back(i - 1);
+  return st.release();
+}
+
+
+int VfsOpen(sqlite3_vfs* pVfs, const char* zName, sqlite3_file* file, int flags, int* outFlags)
+{
+  Vfs* vfs = reinterpret_cast<Vfs*>(pVfs);
+  UringFile* f = reinterpret_cast<UringFile*>(file);
+  f->real = reinterpret_cast<sqlite3_file*>(f + 1);
+  f->st = nullptr;
+  file->pMethods = nullptr;
+  int rc = vfs->root->xOpen(vfs->root, zName, f->real, flags, outFlags);
+  if(rc != SQLITE_OK) {
+    if(f->real->pMethods) f->real->pMethods->xClose(f->real);
+    return rc;
+  }
+  if((flags & SQLITE_OPEN_MAIN_DB) && zName) {
+    if(vfs->uring) f->st = NewState(vfs, f->real, zName);
+    (f->st ? vfs->stats.files : vfs->stats.fallbackFiles).fetch_add(1, memory_order_relaxed);
+  }
+  file->pMethods = &s_io[std::clamp(f->real->pMethods->iVersion, 1, 3) - 1];
+  return SQLITE_OK;
+}
+
+
+mutex s_mtx;
+deque<Vfs> s_vfs; // Stable addresses, registered VFSes are never unregistered
+
+Vfs* FindVfs(std::string_view name)
+{
+  for(auto& v : s_vfs) if(v.opts.name == name) return &v;
+  return nullptr;
+}
+
+} // namespace
+
+
+bool SqliteUringVfs::Available()
+{
+  static const bool available = [] {
+    Ring ring;
+    return ring.init(1);
+  }();
+  return available;
+}
+
+
+int SqliteUringVfs::Register(const SqliteUringVfsOptions& opts)
+{
+  lock_guard<mutex> lock(s_mtx);
+  if(FindVfs(opts.name)) return SQLITE_OK;
+  sqlite3_vfs* root = sqlite3_vfs_find(nullptr);
+  if(!root) return SQLITE_ERROR;
+
+  Vfs& v = s_vfs.emplace_back();
+  v.opts = opts;
+  v.root = root;
+  // The descriptor is only known for files of the unix VFS
+  v.uring = opts.queueDepth > 0 && std::string_view(root->zName).starts_with("unix") && Available();
+  if(opts.queueDepth > 0 && !v.uring) {
+    LOG(WARNING) << format("SqliteUringVfs {}: io_uring unavailable, delegating to {}", opts.name, root->zName);
+  }
+  // Apart from xOpen the unix methods only use mxPathname of the VFS, which is copied
+  v.base = *root;
+  v.base.pNext = nullptr;
+  v.base.szOsFile = static_cast<int>(sizeof(UringFile)) + root->szOsFile;
+  v.base.zName = v.opts.name.c_str();
+  v.base.pAppData = root;
+  v.base.xOpen = VfsOpen;
+  int rc = sqlite3_vfs_register(&v.base, opts.makeDefault ? 1 : 0);
+  if(rc != SQLITE_OK) s_vfs.pop_back();
+  VLOG(1) << format("SqliteUringVfs {} registered over {} uring={} rc={}", opts.name, root->zName, v.uring, rc);
+  return rc;
+}
+
+
+SqliteUringVfsStats SqliteUringVfs::Stats(std::string_view name)
+{
+  SqliteUringVfsStats st;
+  lock_guard<mutex> lock(s_mtx);
+  Vfs* v = FindVfs(name);
+  if(!v) return st;
+  st.uring = v->uring;
+  st.files = v->stats.files.load(memory_order_relaxed);
+  st.fallbackFiles = v->stats.fallbackFiles.load(memory_order_relaxed);
+  st.reads = v->stats.reads.load(memory_order_relaxed);
+  st.readaheads = v->stats.readaheads.load(memory_order_relaxed);
+  st.readaheadHits = v->stats.readaheadHits.load(memory_order_relaxed);
+  st.writes = v->stats.writes.load(memory_order_relaxed);
+  st.syncs = v->stats.syncs.load(memory_order_relaxed);
+  return st;
+}
+
+
+} // end namespace
@@ -0,0 +1,80 @@
+#ifndef MP_SQLITEURINGVFS_HH
+#define MP_SQLITEURINGVFS_HH
+#pragma once
+
+/** \file SqliteUringVfs.hh
+ * Declarations SQLite io_uring VFS
+ *
+ * (c) Copyright  Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+
+// Std
+#include <cstdint>
+#include <string>
+#include <string_view>
+// Prj
+#include <sqlite3.h>
+
+
+namespace MP {
+
+
+  // Options of one registered SqliteUringVfs
+  struct SqliteUringVfsOptions
+  {
+    std::string name{"uring"};  // VFS name, pass it to SqliteDb to select the VFS
+    unsigned queueDepth{64};    // Submission queue entries per database file, 0 disables io_uring
+    unsigned readaheadPages{32}; // Pages read ahead of a sequential scan, 0 disables readahead
+    bool makeDefault{false};    // Register as the default VFS of the process
+  };
+
+
+  // Counters of one registered SqliteUringVfs
+  struct SqliteUringVfsStats
+  {
+    bool uring{false};          // io_uring is in use, otherwise every file delegates
+    uint64_t files{0};          // Main database files opened with an io_uring
+    uint64_t fallbackFiles{0};  // Main database files delegating to the default VFS
+    uint64_t reads{0};          // Reads submitted through io_uring
+    uint64_t readaheads{0};     // Readahead windows submitted
+    uint64_t readaheadHits{0};  // Reads served from a readahead window
+    uint64_t writes{0};         // Checkpoint writes batched through io_uring
+    uint64_t syncs{0};          // Checkpoint fsyncs submitted behind their writes
+  };
+
+
+  // VFS layered over the default unix VFS doing main database I/O through a per file io_uring.
+  // Reads are submitted to the ring. Once a scan reads three pages in a row the next
+  // readaheadPages pages are read in one request while SQLite works on the current one.
+  // Between SQLITE_FCNTL_CKPT_START and CKPT_DONE page writes are copied and queued, half a
+  // queue goes to the kernel per submit. A write failing in the ring is retried synchronously,
+  // if that fails too the next page write fails the checkpoint. CKPT_DONE and shared memory
+  // unlocks wait for the writes before other connections can read the backfilled pages, and
+  // the checkpoint fsync follows through the ring. Locking, shared memory, journals and WAL files stay with the unix VFS,
+  // which also keeps owning the file descriptor so its POSIX locks are never dropped.
+  // Files delegate entirely when io_uring is unavailable (old kernel, seccomp,
+  // io_uring_disabled) or its descriptor cannot be verified.
+  class SqliteUringVfs
+  {
+    public:
+      // Register a VFS named opts.name over the current default VFS. Registering a name
+      // again keeps the first options. Call after SqliteEngine::configure(), this
+      // initializes SQLite.
+      static int Register(const SqliteUringVfsOptions& opts = {});
+
+      // io_uring can be set up in this process
+      static bool Available();
+
+      static SqliteUringVfsStats Stats(std::string_view name = "uring");
+  };
+
+
+} // namespace
+
+
+
+#endif /* Include guard */
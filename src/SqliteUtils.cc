@@ -1,6 +1,9 @@
 
 #include "SqliteUtils.hh"
 // Std
+#include <array>
+#include <atomic>
+#include <cctype>
 #include <string>
 #include <exception>
 #include <filesystem>
@@ -52,6 +55,153 @@ int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags)
 
 
 
+static const SqliteTuning s_tunings[] = {
+  // Default: SQLite defaults
+  {},
+  // ReadHeavy: WAL so readers never block on the writer, large mmap and page cache
+  { "WAL", 1, 256ll << 20, -65536, 0, 2, -1, 5000 },
+  // WriteHeavy: WAL with synchronous=NORMAL, fsync only at checkpoints
+  { "WAL", 1, 64ll << 20, -32768, 4096, 2, -1, 5000 },
+  // BulkLoad: no rollback journal and no fsync, the load is redone if it fails
+  { "OFF", 0, 0, -262144, 4096, 2, -1, 5000 },
+  // Analytics: large pages and cache, sorter helper threads
+  { "WAL", 1, 1ll << 30, -262144, 16384, 2, 4, 5000 },
+};
+
+static constexpr std::string_view s_profileNames[] = { "Default", "ReadHeavy", "WriteHeavy", "BulkLoad", "Analytics" };
+
+
+std::string_view SqliteProfileName(SqliteProfile profile)
+{
+  return s_profileNames[static_cast<size_t>(profile)];
+}
+
+
+const SqliteTuning& SqliteProfileTuning(SqliteProfile profile)
+{
+  return s_tunings[static_cast<size_t>(profile)];
+}
+
+
+// Run "PRAGMA name=value" then read the value back
+static int SetPragma(SqliteDb& db, std::string_view name, int64_t value, int64_t& readBack)
+{
+  int rc = db.exec(format("PRAGMA {}={}", name, value));
+  if(rc != SQLITE_OK) return rc;
+  SqliteStmt stmt = db.stmt(format("PRAGMA {}", name));
+  if(!stmt++) return SQLITE_ERROR;
+  stmt.column(0, readBack);
+  return SQLITE_OK;
+}
+
+
+int ApplySqliteTuning(SqliteDb& db, const SqliteTuning& t, bool newDb)
+{
+  int rv = 0;
+  try {
+    const char* file = sqlite3_db_filename(db.get(), "main");
+    bool inMemory = !file || !*file;
+    bool readOnly = sqlite3_db_readonly(db.get(), "main") == 1;
+
+    auto check = [&](std::string_view name, int64_t want, int64_t got, bool exact) {
+      if(got == want || (!exact && got < want)) return;
+      LOG(ERROR) << format("PRAGMA {} is {}, wanted {}", name, got, want);
+      rv = 1;
+    };
+
+    int64_t got = 0;
+    // page_size must come first, before anything is written or the journal mode changes
+    if(t.pageSize > 0 && newDb && !readOnly) {
+      if(SetPragma(db, "page_size", t.pageSize, got) != SQLITE_OK) return 1;
+      check("page_size", t.pageSize, got, true);
+    }
+    if(!t.journalMode.empty() && !readOnly && !inMemory) {
+      string mode;
+      SqliteStmt stmt = db.stmt(format("PRAGMA journal_mode={}", t.journalMode));
+      if(stmt++) stmt.column(0, mode);
+      string want = t.journalMode;
+      for(auto& c : want) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+      if(mode != want) {
+        LOG(ERROR) << format("PRAGMA journal_mode is {}, wanted {}", mode, want);
+        rv = 1;
+      }
+    }
+    if(t.synchronous >= 0) {
+      if(SetPragma(db, "synchronous", t.synchronous, got) != SQLITE_OK) return 1;
+      check("synchronous", t.synchronous, got, true);
+    }
+    if(t.mmapSize >= 0 && !inMemory) {
+      if(SetPragma(db, "mmap_size", t.mmapSize, got) != SQLITE_OK) return 1;
+      check("mmap_size", t.mmapSize, got, false); // Capped at compile time
+    }
+    if(t.cacheSize != 0) {
+      if(SetPragma(db, "cache_size", t.cacheSize, got) != SQLITE_OK) return 1;
+      check("cache_size", t.cacheSize, got, true);
+    }
+    if(t.tempStore >= 0) {
+      if(SetPragma(db, "temp_store", t.tempStore, got) != SQLITE_OK) return 1;
+      check("temp_store", t.tempStore, got, true);
+    }
+    if(t.threads >= 0) {
+      if(SetPragma(db, "threads", t.threads, got) != SQLITE_OK) return 1;
+      check("threads", t.threads, got, false); // Capped at compile time
+    }
+    if(t.busyTimeoutMs >= 0) {
+      if(SetPragma(db, "busy_timeout", t.busyTimeoutMs, got) != SQLITE_OK) return 1;
+      check("busy_timeout", t.busyTimeoutMs, got, true);
+    }
+  }
+  catch(const std::exception& e) {
+    LOG(ERROR) << e.what();
+    rv = 1;
+  }
+
+  return rv;
+}
+
+
+static int OpenTuned(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags, const SqliteTuning& tuning,
+                     std::string_view profile)
+{
+  std::error_code fsec;
+  bool newDb = dbf.empty() || dbf == ":memory:" || !fs::exists(fs::path(dbf), fsec) || fs::file_size(fs::path(dbf), fsec) == 0;
+
+  // Open into a temporary so sqlDb is only replaced by a fully configured connection
+  SqliteDb db;
+  if(OpenSQLiteDB(dbf, db, dbOpenFlags) != 0 || !db.get()) return 1;
+  if(ApplySqliteTuning(db, tuning, newDb) != 0) {
+    LOG(ERROR) << format("DB file {} could not be configured with profile {}", dbf, profile);
+    return 1;
+  }
+  sqlDb = std::move(db);
+  return 0;
+}
+
+
+int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags, SqliteProfile profile)
+{
+  int rv = OpenTuned(dbf, sqlDb, dbOpenFlags, SqliteProfileTuning(profile), SqliteProfileName(profile));
+
+  // Log the choice once per profile
+  static std::array<std::atomic<bool>, std::size(s_profileNames)> logged{};
+  if(rv == 0 && !logged[static_cast<size_t>(profile)].exchange(true)) {
+    const SqliteTuning& t = SqliteProfileTuning(profile);
+    LOG(INFO) << format("Sqlite profile {}: journal_mode={} synchronous={} mmap_size={} cache_size={} "
+                        "page_size={} temp_store={} threads={} busy_timeout={}",
+                        SqliteProfileName(profile), t.journalMode.empty() ? "default" : t.journalMode,
+                        t.synchronous, t.mmapSize, t.cacheSize, t.pageSize, t.tempStore, t.threads, t.busyTimeoutMs);
+  }
+  return rv;
+}
+
+
+int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags, const SqliteTuning& tuning)
+{
+  return OpenTuned(dbf, sqlDb, dbOpenFlags, tuning, "custom");
+}
+
+
+
 bool TableExists(SqliteDb& db, std::string_view table) {
   int rc{0};
   bool rv{false};
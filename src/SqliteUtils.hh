@@ -13,6 +13,7 @@
 
 
 // Std
+#include <cstdint>
 #include <set>
 #include <string>
 #include <string_view>
@@ -23,9 +24,39 @@
 namespace MP {
 
 
+  // Named connection tuning profiles, see SqliteProfileTuning()
+  enum class SqliteProfile { Default, ReadHeavy, WriteHeavy, BulkLoad, Analytics };
+
+  // Connection settings applied by OpenSQLiteDB(). Negative, zero or empty values leave
+  // the SQLite default in place.
+  struct SqliteTuning
+  {
+    std::string journalMode;  // journal_mode, e.g. "WAL"; not applied to read-only or in-memory DBs
+    int synchronous{-1};      // synchronous: 0 OFF, 1 NORMAL, 2 FULL, 3 EXTRA
+    int64_t mmapSize{-1};     // mmap_size in bytes, capped by SQLITE_MAX_MMAP_SIZE
+    int cacheSize{0};         // cache_size: pages if positive, KiB if negative
+    int pageSize{0};          // page_size, only takes effect on new databases
+    int tempStore{-1};        // temp_store: 0 DEFAULT, 1 FILE, 2 MEMORY
+    int threads{-1};          // threads (sorter helper threads), capped by SQLITE_MAX_WORKER_THREADS
+    int busyTimeoutMs{-1};    // busy_timeout in milliseconds
+  };
+
+  // Name and settings of a profile
+  std::string_view SqliteProfileName(SqliteProfile profile);
+  const SqliteTuning& SqliteProfileTuning(SqliteProfile profile);
+
+  // Apply tuning to an open connection and verify it by reading the values back.
+  // newDb enables page_size. Returns 0 on success.
+  int ApplySqliteTuning(SqliteDb& db, const SqliteTuning& tuning, bool newDb);
+
   // Open an SQLite DB from a given file name
   int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags = SQLITE_OPEN_READONLY);
 
+  // Open an SQLite DB and apply a tuning profile. sqlDb is only assigned once all
+  // settings are applied and verified; the profile used is logged once per process.
+  int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags, SqliteProfile profile);
+  int OpenSQLiteDB(const std::string& dbf, SqliteDb& sqlDb, int dbOpenFlags, const SqliteTuning& tuning);
+
   // Is the given table name exist in the database?
   bool TableExists(SqliteDb& db, std::string_view table);
 
@@ -0,0 +1,102 @@
+
+/** \file SqliteAlloc_t.cc
+ * Test definitions for the SQLite pool memory allocator.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteAlloc.hh"
+// Std includes
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+#include "SqliteEngine.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteAlloc_test, Methods)
+{
+  const sqlite3_mem_methods* m = SqlitePoolAllocator::Methods();
+  EXPECT_EQ(m->xRoundup(1), 16);
+  EXPECT_EQ(m->xRoundup(100), 128);
+  EXPECT_EQ(m->xRoundup(4096), 4096);
+  EXPECT_EQ(m->xRoundup(5000), 5008);
+
+  void* p = m->xMalloc(40);
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 16, 0u);
+  EXPECT_EQ(m->xSize(p), 48);
+  memset(p, 'a', 40);
+
+  // Growing within the block keeps the pointer, beyond it moves the data
+  EXPECT_EQ(m->xRealloc(p, 48), p);
+  void* q = m->xRealloc(p, 1000);
+  ASSERT_NE(q, nullptr);
+  EXPECT_EQ(m->xSize(q), 1024);
+  EXPECT_EQ(static_cast<char*>(q)[39], 'a');
+  q = m->xRealloc(q, 10000);
+  EXPECT_EQ(m->xSize(q), 10000);
+  EXPECT_EQ(static_cast<char*>(q)[0], 'a');
+  m->xFree(q);
+
+  // Blocks freed by another thread are reused
+  vector<void*> blocks;
+  for(int i = 0; i < 1000; ++i) blocks.push_back(m->xMalloc(64));
+  thread([&] { for(void* b : blocks) m->xFree(b); }).join();
+  for(int i = 0; i < 1000; ++i) m->xFree(m->xMalloc(64));
+
+  auto st = SqlitePoolAllocator::Stats();
+  ASSERT_FALSE(st.classes.empty());
+  EXPECT_EQ(st.classes[3].size, 64u);
+  EXPECT_GE(st.classes[3].allocs, 2000u);
+  EXPECT_GE(st.classes[3].frees, 2000u);
+  EXPECT_GT(st.classes[3].hitRate(), 0.5);
+  EXPECT_GT(st.slabBytes, 0u);
+  EXPECT_NE(st.dump().find("    64"), string::npos);
+}
+
+
+// Install the allocator in a fresh process, run some SQL and exit 0 on success
+static void InstallAndExit()
+{
+  SqliteEngineConfig cfg;
+  cfg.memMethods = SqlitePoolAllocator::Methods();
+  cfg.lookasideSize = cfg.lookasideCount = 0; // Every allocation reaches the allocator
+  if(SqliteEngine::configure(cfg) != SQLITE_OK) exit(1);
+  if(SqliteEngine::effective().memMethods != cfg.memMethods) exit(2);
+  {
+    SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+    db.exec("CREATE TABLE M1 (id INTEGER PRIMARY KEY, t TEXT)");
+    db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<10000) "
+            "INSERT INTO M1 SELECT i, printf('%.*c', i % 300, 'x') FROM s");
+    SqliteStmt s = db.stmt("SELECT sum(length(t)) FROM M1");
+    if(!s++) exit(3);
+    auto ms = db.memoryStats();
+    if(ms.cacheUsed <= 0 || ms.lookasideHit != 0) exit(4);
+  }
+  auto st = SqlitePoolAllocator::Stats();
+  uint64_t allocs = 0;
+  for(auto& c : st.classes) allocs += c.allocs;
+  // Without lookaside the workload allocates tens of thousands of blocks, pages go above 4 KiB
+  if(allocs < 10000) exit(5);
+  if(st.classes.back().size != 0 || st.classes.back().allocs == 0) exit(6);
+  exit(0);
+}
+
+
+TEST(SqliteAlloc_test, Install)
+{
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_EXIT(InstallAndExit(), ::testing::ExitedWithCode(0), "");
+}
@@ -0,0 +1,213 @@
+
+/** \file SqliteAsync_t.cc
+ * Test definitions for the SQLite asynchronous executor.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteAsync.hh"
+// Std includes
+#include <chrono>
+#include <coroutine>
+#include <filesystem>
+#include <future>
+#include <thread>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+// Minimal fire-and-forget coroutine, done is set when the body finishes
+struct Task
+{
+  struct promise_type
+  {
+    Task get_return_object() { return {}; }
+    suspend_never initial_suspend() noexcept { return {}; }
+    suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+  };
+};
+
+
+static Task Queries(AsyncSqliteDb& adb, promise<void>& done)
+{
+  co_await adb.exec("CREATE TABLE A1 (id INTEGER PRIMARY KEY, name TEXT)");
+  co_await adb.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<1000) "
+                    "INSERT INTO A1 SELECT i, 'n'||i FROM s");
+
+  auto rows = co_await adb.query<int64_t, string>("SELECT id, name FROM A1 WHERE id > ? ORDER BY id", 995);
+  EXPECT_EQ(rows.size(), 5u);
+  EXPECT_EQ(get<0>(rows[0]), 996);
+  EXPECT_EQ(get<1>(rows[4]), "n1000");
+
+  // Batched cursor
+  auto cur = co_await adb.cursor<int64_t>(SqliteCancelToken{}, "SELECT id FROM A1 WHERE name LIKE ?", string("n%"));
+  size_t total = 0, batches = 0;
+  for(;;) {
+    auto batch = co_await cur.next();
+    if(batch.empty()) break;
+    EXPECT_LE(batch.size(), adb.options().batchRows);
+    total += batch.size();
+    batches++;
+  }
+  EXPECT_EQ(total, 1000u);
+  EXPECT_EQ(batches, 4u);
+
+  // A transaction runs on one connection and is rolled back when its body throws
+  int64_t id = co_await adb.transaction([](SqliteDb& db) {
+    db.exec("INSERT INTO A1 VALUES (1001, 'n1001')");
+    db.exec("INSERT INTO A1 VALUES (1002, 'n1002')");
+    return sqlite3_last_insert_rowid(db.get());
+  });
+  EXPECT_EQ(id, 1002);
+  bool threw = false;
+  try {
+    co_await adb.transaction([](SqliteDb& db) {
+      db.exec("DELETE FROM A1 WHERE id > 1000");
+      throw runtime_error("abort");
+    });
+  }
+  catch(const exception&) { threw = true; }
+  EXPECT_TRUE(threw);
+  rows = co_await adb.query<int64_t, string>("SELECT count(*), '' FROM A1 WHERE id > 1000");
+  EXPECT_EQ(get<0>(rows.at(0)), 2);
+
+  // Views are copied with the text they refer to, not only the view
+  auto echo = [&adb] {
+    string text(100, 'v');
+    return adb.query<string>("SELECT ?", string_view(text));
+  }();
+  auto echoed = co_await echo;
+  EXPECT_EQ(get<0>(echoed.at(0)), string(100, 'v'));
+
+  // Errors surface at co_await
+  threw = false;
+  try { co_await adb.exec("SELECT * FROM NoSuchTable"); }
+  catch(const exception&) { threw = true; }
+  EXPECT_TRUE(threw);
+
+  // So do bind errors, the query does not run with missing parameters
+  threw = false;
+  try { co_await adb.query<int64_t>("SELECT id FROM A1 WHERE id > ?", 1, 2); }
+  catch(const exception&) { threw = true; }
+  EXPECT_TRUE(threw);
+
+  done.set_value();
+}
+
+
+static Task Cancelled(AsyncSqliteDb& adb, SqliteCancelToken tok, promise<bool>& done)
+{
+  bool threw = false;
+  try {
+    co_await adb.query<int64_t>(tok, "WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s) "
+                                     "SELECT count(*) FROM s");
+  }
+  catch(const exception&) { threw = true; }
+  done.set_value(threw);
+}
+
+
+// Cancels a query while a cursor of another token is open on the same worker
+static Task CursorSurvivesCancel(AsyncSqliteDb& adb, promise<void>& done)
+{
+  co_await adb.exec("CREATE TABLE A2 (id INTEGER PRIMARY KEY)");
+  co_await adb.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<100) "
+                    "INSERT INTO A2 SELECT i FROM s");
+
+  auto cur = co_await adb.cursor<int64_t>(SqliteCancelToken{}, "SELECT id FROM A2 ORDER BY id");
+  auto batch = co_await cur.next();
+  EXPECT_EQ(batch.size(), adb.options().batchRows);
+
+  SqliteCancelToken tok;
+  bool threw = false;
+  auto stop = jthread([tok]() mutable { this_thread::sleep_for(50ms); tok.cancel(); });
+  try {
+    co_await adb.query<int64_t>(tok, "WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s) "
+                                     "SELECT count(*) FROM s");
+  }
+  catch(const exception&) { threw = true; }
+  EXPECT_TRUE(threw);
+
+  // Neither the open cursor nor later work sees the other token's cancellation
+  size_t total = batch.size();
+  try {
+    for(;;) {
+      batch = co_await cur.next();
+      if(batch.empty()) break;
+      total += batch.size();
+    }
+  }
+  catch(const exception& ex) { ADD_FAILURE() << ex.what(); }
+  EXPECT_EQ(total, 100u);
+
+  try {
+    auto rows = co_await adb.query<int64_t>("SELECT count(*) FROM A2");
+    EXPECT_EQ(get<0>(rows.at(0)), 100);
+  }
+  catch(const exception& ex) { ADD_FAILURE() << ex.what(); }
+
+  done.set_value();
+}
+
+
+TEST(SqliteAsync_test, Basic)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteAsync_t.db";
+  filesystem::remove(path);
+  {
+    AsyncSqliteDb adb(path.string());
+    EXPECT_EQ(adb.threads(), 2u);
+
+    promise<void> done;
+    auto f = done.get_future();
+    Queries(adb, done);
+    ASSERT_EQ(f.wait_for(10s), future_status::ready);
+
+    // Cancelled before running
+    SqliteCancelToken pre;
+    pre.cancel();
+    promise<bool> p1;
+    Cancelled(adb, pre, p1);
+    EXPECT_TRUE(p1.get_future().get());
+
+    // Interrupted while running
+    SqliteCancelToken tok;
+    promise<bool> p2;
+    auto f2 = p2.get_future();
+    Cancelled(adb, tok, p2);
+    this_thread::sleep_for(50ms);
+    tok.cancel();
+    ASSERT_EQ(f2.wait_for(10s), future_status::ready);
+    EXPECT_TRUE(f2.get());
+  }
+  filesystem::remove(path);
+}
+
+
+TEST(SqliteAsync_test, CancelWithOpenCursor)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteAsync_cancel_t.db";
+  filesystem::remove(path);
+  {
+    // One worker so that the cursor and the cancelled query share a connection
+    SqliteAsyncOptions opts;
+    opts.threads = 1;
+    opts.batchRows = 10;
+    AsyncSqliteDb adb(path.string(), opts);
+    promise<void> done;
+    auto f = done.get_future();
+    CursorSurvivesCancel(adb, done);
+    ASSERT_EQ(f.wait_for(10s), future_status::ready);
+  }
+  filesystem::remove(path);
+}
@@ -0,0 +1,111 @@
+
+/** \file SqliteBatch_t.cc
+ * Test definitions for the SQLite columnar batches.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteBatch.hh"
+// Std includes
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteBatch_test, Fetch)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE C1 (id INTEGER, v REAL, t TEXT, b BLOB)");
+  db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<150) "
+          "INSERT INTO C1 SELECT i, i*0.5, CASE WHEN i%10 THEN 'v'||i END, zeroblob(i%3) FROM s");
+
+  SqliteStmt stmt = db.stmt("SELECT id, v, t, b FROM C1 ORDER BY id");
+  SqliteColumnBatch batch; // Types derived from the declarations
+  size_t total = 0, nullTexts = 0;
+  int64_t idSum = 0;
+  size_t n;
+  while((n = stmt.fetchBatch(batch, 64)) > 0) {
+    ASSERT_EQ(batch.columns(), 4u);
+    EXPECT_EQ(batch[0].type, SQLITE_INTEGER);
+    EXPECT_EQ(batch[1].type, SQLITE_FLOAT);
+    EXPECT_EQ(batch[2].type, SQLITE_TEXT);
+    EXPECT_EQ(batch[3].type, SQLITE_BLOB);
+    for(size_t r = 0; r < n; ++r) {
+      idSum += batch[0].ints[r];
+      EXPECT_EQ(batch[1].reals[r], batch[0].ints[r] * 0.5);
+      EXPECT_EQ(batch[3].blob(r).size(), size_t(batch[0].ints[r] % 3));
+      if(batch[2].isNull(r)) ++nullTexts;
+      else EXPECT_EQ(batch[2].text(r), "v" + to_string(batch[0].ints[r]));
+    }
+    EXPECT_EQ(batch[2].nulls, size_t(count_if(batch[0].ints.begin(), batch[0].ints.end(), [](int64_t i) { return i % 10 == 0; })));
+    total += n;
+  }
+  EXPECT_EQ(total, 150u);
+  EXPECT_EQ(idSum, 150 * 151 / 2);
+  EXPECT_EQ(nullTexts, 15u);
+  EXPECT_EQ(stmt.rc(), SQLITE_DONE);
+  EXPECT_EQ(stmt.fetchBatch(batch, 64), 0u); // Done until reset
+  stmt.reset();
+  EXPECT_EQ(stmt.fetchBatch(batch, 200), 150u);
+
+  // Explicit column types, reused across statements
+  SqliteColumnBatch sums{SQLITE_FLOAT};
+  SqliteStmt agg = db.stmt("SELECT sum(id) FROM C1");
+  EXPECT_EQ(agg.fetchBatch(sums, 10), 1u);
+  EXPECT_EQ(sums[0].reals[0], 150.0 * 151 / 2);
+}
+
+
+// NUMERIC affinity columns take the storage class of the first row
+TEST(SqliteBatch_test, Affinity)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE C2 (d DATE, n DECIMAL(10,2), f BOOLEAN, r DOUBLE)");
+  db.exec("INSERT INTO C2 VALUES ('2024-01-31', 9007199254740993, 1, 1)");
+
+  SqliteStmt stmt = db.stmt("SELECT d, n, f, r FROM C2");
+  SqliteColumnBatch batch;
+  ASSERT_EQ(stmt.fetchBatch(batch, 10), 1u);
+  EXPECT_EQ(batch[0].type, SQLITE_TEXT);
+  EXPECT_EQ(batch[0].text(0), "2024-01-31");
+  EXPECT_EQ(batch[1].type, SQLITE_INTEGER);
+  EXPECT_EQ(batch[1].ints[0], 9007199254740993);
+  EXPECT_EQ(batch[2].type, SQLITE_INTEGER);
+  EXPECT_EQ(batch[3].type, SQLITE_FLOAT);
+  EXPECT_EQ(batch[3].reals[0], 1.0);
+}
+
+
+// tryReset() clears the done state and the bind arena like reset()
+TEST(SqliteBatch_test, TryReset)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE C3 (t TEXT)");
+  db.exec("INSERT INTO C3 VALUES ('a'), ('b'), ('b')");
+
+  SqliteStmt stmt = db.stmt("SELECT t FROM C3 WHERE t = ?");
+  SqliteColumnBatch batch;
+  EXPECT_EQ(stmt.bindCopy(1, "b"), SQLITE_OK);
+  EXPECT_FALSE(stmt.arena().empty());
+  EXPECT_EQ(stmt.fetchBatch(batch, 10), 2u);
+  EXPECT_EQ(stmt.fetchBatch(batch, 10), 0u);
+
+  EXPECT_TRUE(stmt.tryReset());
+  EXPECT_TRUE(stmt.arena().empty());
+  EXPECT_TRUE(stmt.arena().params().empty());
+  EXPECT_EQ(stmt.fetchBatch(batch, 10), 0u); // Parameter is NULL now, not dangling
+  EXPECT_TRUE(stmt.tryReset());
+  EXPECT_EQ(stmt.bind(1, string("a")), SQLITE_OK);
+  EXPECT_EQ(stmt.fetchBatch(batch, 10), 1u);
+  EXPECT_EQ(batch[0].text(0), "a");
+}
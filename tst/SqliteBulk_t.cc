@@ -0,0 +1,147 @@
+
+/** \file SqliteBulk_t.cc
+ * Test definitions for the SQLite bulk inserter.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteBulk.hh"
+// Std includes
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include <absl/log/log.h>
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteBulk_test, InsertSql)
+{
+  EXPECT_EQ(SqliteBulkInsertSql("INSERT", "T", {"a", "b"}, 2, 3),
+            "INSERT INTO T (a,b) VALUES (?,?),(?,?),(?,?)");
+  EXPECT_EQ(SqliteBulkInsertSql("INSERT OR REPLACE", "T", {}, 1, 1),
+            "INSERT OR REPLACE INTO T VALUES (?)");
+}
+
+
+TEST(SqliteBulk_test, Insert)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE B1 (id INTEGER, v REAL, t TEXT)");
+
+  struct Rec { int64_t id; double v; string t; };
+  vector<Rec> recs;
+  for(int64_t i = 0; i < 1000; ++i) recs.push_back(Rec{i, i * 0.25, "r" + to_string(i)});
+
+  SqliteBulkOptions opts;
+  opts.maxRowsPerStmt = 64;
+  opts.commitRows = 300;
+  {
+    SqliteBulkInserter<int64_t, double, string> bulk(db, "B1", {"id", "v", "t"}, opts);
+    EXPECT_EQ(bulk.rowsPerStmt(), 64u);
+    EXPECT_EQ(bulk.insertRange(recs, [](const Rec& r) { return make_tuple(r.id, r.v, r.t); }), SQLITE_OK);
+    EXPECT_EQ(bulk.insert({1000, 0.0, "last"}), SQLITE_OK);
+    EXPECT_EQ(bulk.finish(), SQLITE_OK);
+
+    const auto& st = bulk.stats();
+    EXPECT_EQ(st.rows, 1001u);
+    EXPECT_EQ(st.statements, 15u + 1u); // 15 full statements and one remainder
+    EXPECT_EQ(st.commits, 4u);
+    LOG(INFO) << "Bulk insert rows/sec=" << st.rowsPerSec();
+  }
+
+  SqliteStmt stmt = db.stmt("SELECT count(*), sum(id), max(t) FROM B1");
+  for(const auto& [n, sum, mx] : stmt.rows<int64_t, int64_t, std::string_view>()) {
+    EXPECT_EQ(n, 1001);
+    EXPECT_EQ(sum, 1000 * 1001 / 2);
+    EXPECT_EQ(mx, "r999");
+  }
+}
+
+
+TEST(SqliteBulk_test, Commit)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteBulk_t.db";
+  filesystem::remove(path);
+  {
+    SqliteDb db(path.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    ASSERT_TRUE(db.get());
+    db.ex(false);
+    db.exec("CREATE TABLE B2 (id INTEGER)");
+
+    SqliteBulkOptions opts;
+    opts.commitRows = 0;
+    opts.commitInterval = 20ms;
+    SqliteBulkInserter<int64_t> bulk(db, "B2", {}, opts);
+
+    // The interval holds for a producer too slow to fill a statement
+    EXPECT_EQ(bulk.insert({1}), SQLITE_OK);
+    this_thread::sleep_for(30ms);
+    EXPECT_EQ(bulk.insert({2}), SQLITE_OK);
+    EXPECT_EQ(bulk.pending(), 0u);
+    EXPECT_EQ(bulk.stats().commits, 1u);
+
+    // A COMMIT blocked by a reader leaves the transaction open to retry
+    SqliteDb reader(path.string(), SQLITE_OPEN_READONLY);
+    reader.exec("BEGIN");
+    reader.exec("SELECT count(*) FROM B2");
+    EXPECT_EQ(bulk.insert({3}), SQLITE_OK);
+    EXPECT_EQ(bulk.commit(), SQLITE_BUSY);
+    EXPECT_FALSE(sqlite3_get_autocommit(db.get()));
+    reader.exec("COMMIT");
+    EXPECT_EQ(bulk.commit(), SQLITE_OK);
+    EXPECT_EQ(bulk.stats().commits, 2u);
+    EXPECT_TRUE(sqlite3_get_autocommit(db.get()));
+  }
+  filesystem::remove(path);
+}
+
+
+// Rows of a failing statement stay buffered for a retry
+TEST(SqliteBulk_test, Retry)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.ex(false);
+  db.exec("CREATE TABLE B3 (id INTEGER PRIMARY KEY)");
+  db.exec("INSERT INTO B3 VALUES (5)");
+
+  SqliteBulkOptions opts;
+  opts.maxRowsPerStmt = 4;
+  SqliteBulkInserter<int64_t> bulk(db, "B3", {}, opts);
+  for(int64_t i = 1; i <= 3; ++i) EXPECT_EQ(bulk.insert({i}), SQLITE_OK);
+  EXPECT_ANY_THROW(bulk.insert({5})); // Full statement fails on the duplicate
+  EXPECT_EQ(bulk.pending(), 4u);
+  EXPECT_ANY_THROW(bulk.insert({6})); // Still failing, more than a statement buffered
+  EXPECT_EQ(bulk.pending(), 5u);
+
+  db.exec("DELETE FROM B3");
+  EXPECT_EQ(bulk.flush(), SQLITE_OK);
+  EXPECT_EQ(bulk.pending(), 0u);
+  EXPECT_EQ(bulk.stats().rows, 5u);
+  EXPECT_EQ(bulk.stats().statements, 2u);
+
+  EXPECT_EQ(bulk.insert({6}), SQLITE_OK);
+  EXPECT_EQ(bulk.discard(), 1u);
+  EXPECT_EQ(bulk.commit(), SQLITE_OK);
+
+  SqliteStmt s = db.stmt("SELECT count(*), sum(id) FROM B3");
+  int64_t n = 0, sum = 0;
+  if(s++) {
+    s.column(0, n);
+    s.column(1, sum);
+  }
+  EXPECT_EQ(n, 5);
+  EXPECT_EQ(sum, 1 + 2 + 3 + 5 + 6);
+}
@@ -0,0 +1,149 @@
+
+/** \file SqliteCheckpoint_t.cc
+ * Test definitions for the SQLite background WAL checkpointer.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteCheckpoint.hh"
+// Std includes
+#include <chrono>
+#include <filesystem>
+#include <thread>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "SqliteCompressVfs.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteCheckpoint_test, Policy)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteCheckpoint_t.db";
+  filesystem::remove(path);
+  {
+    SqliteDb db(path.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    sqlite3_busy_timeout(db.get(), 5000); // Writers wait while RESTART/TRUNCATE run
+    db.exec("PRAGMA journal_mode=WAL");
+    db.exec("CREATE TABLE W1 (id INTEGER PRIMARY KEY, v BLOB)");
+
+    SqliteCheckpointOptions opts;
+    opts.passiveFrames = 20;
+    opts.restartFrames = 40;
+    opts.truncateFrames = 80;
+    opts.interval = 10ms;
+    SqliteCheckpointer ckpt(db, opts);
+
+    // A reader holding a snapshot keeps PASSIVE checkpoints from catching up
+    SqliteDb reader(path.string(), SQLITE_OPEN_READONLY);
+    SqliteStmt snap = reader.stmt("SELECT count(*) FROM W1");
+    ASSERT_TRUE(snap++);
+
+    SqliteStmt ins = db.stmt("INSERT INTO W1(v) VALUES (zeroblob(4000))");
+    for(int i = 0; i < 200; ++i) {
+      ins.step();
+      ins.reset();
+    }
+    this_thread::sleep_for(100ms);
+    auto st = ckpt.stats();
+    EXPECT_GT(st.passive, 0u);
+    EXPECT_GT(st.framesBehind, 0);
+    EXPECT_GT(st.walBytes, 0u);
+
+    // Once the reader is gone the escalated checkpoint truncates the WAL
+    snap.reset();
+    for(int i = 0; i < 50; ++i) {
+      ins.step();
+      ins.reset();
+    }
+    for(int i = 0; i < 100 && ckpt.stats().truncate == 0; ++i) this_thread::sleep_for(10ms);
+    st = ckpt.stats();
+    EXPECT_GT(st.truncate, 0u);
+    EXPECT_GE(st.maxDuration, st.lastDuration);
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
+
+
+// The attached connection gets its automatic checkpoints back
+TEST(SqliteCheckpoint_test, Restore)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteCheckpoint_t_restore.db";
+  filesystem::remove(path);
+  {
+    SqliteDb db(path.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    db.exec("PRAGMA journal_mode=WAL");
+    db.exec("PRAGMA wal_autocheckpoint=500");
+    auto autoCheckpoint = [&db] {
+      int n = -1;
+      SqliteStmt s = db.stmt("PRAGMA wal_autocheckpoint");
+      if(s++) s.column(0, n);
+      return n;
+    };
+    {
+      SqliteCheckpointer ckpt(db);
+      EXPECT_EQ(autoCheckpoint(), 0);
+    }
+    EXPECT_EQ(autoCheckpoint(), 500);
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
+
+
+// The checkpoint connection uses the VFS of the attached one
+TEST(SqliteCheckpoint_test, Vfs)
+{
+  SqliteCompressVfsOptions vopts;
+  vopts.name = "compress_ckpt";
+  vopts.codec = SqliteCompressCodec::Store;
+  ASSERT_EQ(SqliteCompressVfs::Register(vopts), SQLITE_OK);
+
+  auto path = filesystem::temp_directory_path() / "SqliteCheckpoint_t_vfs.db";
+  auto remove = [&path] {
+    for(auto ext : {"", "-pgidx", "-wal", "-shm"}) filesystem::remove(path.string() + ext);
+  };
+  remove();
+  {
+    SqliteDb db(path.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vopts.name);
+    db.exec("PRAGMA journal_mode=WAL");
+    db.exec("CREATE TABLE W2 (id INTEGER PRIMARY KEY, v BLOB)");
+
+    SqliteCheckpointOptions opts;
+    opts.passiveFrames = 20;
+    opts.interval = 10ms;
+    SqliteCheckpointer ckpt(db, opts);
+    SqliteStmt ins = db.stmt("INSERT INTO W2(v) VALUES (zeroblob(4000))");
+    for(int i = 0; i < 100; ++i) {
+      ins.step();
+      ins.reset();
+    }
+    for(int i = 0; i < 100 && ckpt.stats().passive == 0; ++i) this_thread::sleep_for(10ms);
+    auto st = ckpt.stats();
+    EXPECT_GT(st.passive, 0u);
+    EXPECT_EQ(st.busy, 0u);
+    EXPECT_LT(st.framesBehind, 20);
+  }
+  {
+    // The checkpointed pages went through the VFS
+    SqliteDb db(path.string(), SQLITE_OPEN_READONLY, vopts.name);
+    SqliteStmt s = db.stmt("SELECT count(*) FROM W2");
+    int64_t n = 0;
+    if(s++) s.column(0, n);
+    EXPECT_EQ(n, 100);
+    SqliteStmt check = db.stmt("PRAGMA integrity_check");
+    string_view ok;
+    if(check++) check.column(0, ok);
+    EXPECT_EQ(ok, "ok");
+  }
+  remove();
+}
@@ -0,0 +1,256 @@
+
+/** \file SqliteCompressVfs_t.cc
+ * Test definitions for the SQLite page compression VFS.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteCompressVfs.hh"
+// Std includes
+#include <csignal>
+#include <filesystem>
+#include <string>
+#include <tuple>
+// Posix
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+// Best codec built in, registered as "compress"
+static SqliteCompressCodec BestCodec()
+{
+  for(auto c : {SqliteCompressCodec::Zstd, SqliteCompressCodec::Lz4}) {
+    if(SqliteCompressVfs::Supported(c)) return c;
+  }
+  return SqliteCompressCodec::Store;
+}
+
+static string RegisterVfs()
+{
+  SqliteCompressVfsOptions opts;
+  opts.codec = BestCodec();
+  opts.cacheBytes = 256u << 10;
+  EXPECT_EQ(SqliteCompressVfs::Register(opts), SQLITE_OK);
+  return opts.name;
+}
+
+static void RemoveDb(const string& file)
+{
+  for(auto ext : {"", "-pgidx", "-journal", "-wal", "-shm"}) filesystem::remove(file + ext);
+}
+
+static string ExecText(SqliteDb& db, std::string_view sql)
+{
+  SqliteStmt s = db.stmt(sql);
+  string_view v;
+  if(s++) s.column(0, v);
+  return string(v);
+}
+
+// Compressible JSON rows of batch b
+static string InsertBatch(int b, int rows)
+{
+  return "WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<" + to_string(rows) + ") "
+         "INSERT INTO C1 (batch, t) SELECT " + to_string(b) + ", printf('{\"batch\":%d,\"row\":%d,\"note\":\"%s\"}', " +
+         to_string(b) + ", i, replace(hex(zeroblob(50 + (i * 37) % 900)), '00', 'ab')) FROM s";
+}
+
+// count(*), total(length(t)) and sum(id) of C1
+static tuple<int64_t, int64_t, int64_t> Totals(SqliteDb& db)
+{
+  SqliteStmt s = db.stmt("SELECT count(*), CAST(total(length(t)) AS INTEGER), sum(id) FROM C1");
+  tuple<int64_t, int64_t, int64_t> out{-1, -1, -1};
+  if(s++) {
+    s.column(0, get<0>(out));
+    s.column(1, get<1>(out));
+    s.column(2, get<2>(out));
+  }
+  return out;
+}
+
+
+TEST(SqliteCompressVfs_test, Codecs)
+{
+  EXPECT_TRUE(SqliteCompressVfs::Supported(SqliteCompressCodec::Store));
+  SqliteCompressVfsOptions opts;
+  opts.name = "compress_bad";
+  opts.codec = static_cast<SqliteCompressCodec>(99);
+  EXPECT_EQ(SqliteCompressVfs::Register(opts), SQLITE_ERROR);
+  EXPECT_EQ(sqlite3_vfs_find("compress_bad"), nullptr);
+}
+
+
+// Write, rewrite, shrink and read back a database in each journal mode
+TEST(SqliteCompressVfs_test, RoundTrip)
+{
+  string vfs = RegisterVfs();
+  for(const char* mode : {"DELETE", "WAL"}) {
+    SCOPED_TRACE(mode);
+    string file = (filesystem::temp_directory_path() / "SqliteCompressVfs_t.db").string();
+    RemoveDb(file);
+    auto before = SqliteCompressVfs::Stats(vfs);
+    tuple<int64_t, int64_t, int64_t> totals;
+    int64_t logical = 0;
+    {
+      SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
+      ASSERT_EQ(db.rc(), SQLITE_OK);
+      db.exec(string("PRAGMA journal_mode=") + mode);
+      db.exec("CREATE TABLE C1 (id INTEGER PRIMARY KEY, batch INTEGER, t TEXT)");
+      for(int b = 1; b <= 20; ++b) db.exec(InsertBatch(b, 200));
+      db.exec("UPDATE C1 SET t = t || t WHERE id % 7 = 0");    // Pages grow and move
+      db.exec("UPDATE C1 SET t = substr(t, 1, 20) WHERE id % 5 = 0"); // Pages shrink in place
+      db.exec("DELETE FROM C1 WHERE batch > 15");
+      db.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+      db.exec("VACUUM");
+      db.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+      totals = Totals(db);
+      EXPECT_EQ(get<0>(totals), 15 * 200);
+      logical = stoll(ExecText(db, "PRAGMA page_count")) * stoll(ExecText(db, "PRAGMA page_size"));
+    }
+    {
+      SqliteDb db(file, SQLITE_OPEN_READONLY, vfs);
+      ASSERT_EQ(db.rc(), SQLITE_OK);
+      EXPECT_EQ(Totals(db), totals);
+      EXPECT_EQ(ExecText(db, "PRAGMA integrity_check"), "ok");
+    }
+    auto st = SqliteCompressVfs::Stats(vfs);
+    EXPECT_GT(st.pagesWritten, before.pagesWritten);
+    EXPECT_GT(st.pagesRead, before.pagesRead);
+    EXPECT_GT(st.inPlace, before.inPlace);
+    EXPECT_GT(st.appended, before.appended);
+    if(BestCodec() != SqliteCompressCodec::Store) {
+      EXPECT_GT(st.ratio(), 2.0);
+      EXPECT_LT(static_cast<int64_t>(filesystem::file_size(file)), logical / 2);
+      EXPECT_GT(st.compressUsPerPage(), 0.0);
+    }
+    RemoveDb(file);
+  }
+}
+
+
+// Read-only connections neither create nor need write access to the index
+TEST(SqliteCompressVfs_test, ReadOnly)
+{
+  string vfs = RegisterVfs();
+  string file = (filesystem::temp_directory_path() / "SqliteCompressVfs_t_ro.db").string();
+  RemoveDb(file);
+  {
+    SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
+    ASSERT_EQ(db.rc(), SQLITE_OK);
+    db.exec("CREATE TABLE C1 (id INTEGER PRIMARY KEY, batch INTEGER, t TEXT)");
+    db.exec(InsertBatch(1, 200));
+  }
+  {
+    // A writer joining a read-only connection gets its own descriptor
+    SqliteDb ro(file, SQLITE_OPEN_READONLY, vfs);
+    ASSERT_EQ(ro.rc(), SQLITE_OK);
+    EXPECT_EQ(get<0>(Totals(ro)), 200);
+    SqliteDb rw(file, SQLITE_OPEN_READWRITE, vfs);
+    ASSERT_EQ(rw.rc(), SQLITE_OK);
+    rw.ex(false);
+    EXPECT_EQ(rw.exec(InsertBatch(2, 200)), SQLITE_OK);
+    EXPECT_EQ(get<0>(Totals(ro)), 400);
+
+    // The index stayed locked against other processes throughout
+    int fd = open((file + "-pgidx").c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    EXPECT_NE(flock(fd, LOCK_EX | LOCK_NB), 0);
+    close(fd);
+  }
+  {
+    SqliteDb db(file, SQLITE_OPEN_READONLY, vfs);
+    EXPECT_EQ(get<0>(Totals(db)), 400);
+  }
+
+  // Without its index the database does not open read-only, and no index is created
+  filesystem::remove(file + "-pgidx");
+  {
+    SqliteDb db(file, SQLITE_OPEN_READONLY, vfs);
+    db.ex(false);
+    EXPECT_NE(db.exec("SELECT count(*) FROM C1"), SQLITE_OK);
+  }
+  EXPECT_FALSE(filesystem::exists(file + "-pgidx"));
+  RemoveDb(file);
+}
+
+
+// Commit batches until killed, acknowledging each commit on fd
+[[noreturn]] static void CommitUntilKilled(const string& file, const string& vfs, const char* mode, int fd)
+{
+  SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
+  db.exec(string("PRAGMA journal_mode=") + mode);
+  db.exec("PRAGMA synchronous=NORMAL");
+  db.exec("PRAGMA wal_autocheckpoint=50");
+  db.exec("PRAGMA cache_size=20");
+  db.exec("CREATE TABLE IF NOT EXISTS C1 (id INTEGER PRIMARY KEY, batch INTEGER, t TEXT)");
+  int b = stoi(ExecText(db, "SELECT ifnull(max(batch), 0) FROM C1"));
+  for(;;) {
+    ++b;
+    db.exec("BEGIN");
+    db.exec(InsertBatch(b, 50));
+    db.exec("UPDATE C1 SET t = t || 'z' WHERE id % 31 = " + to_string(b % 31));
+    if(db.exec("COMMIT") != SQLITE_OK) _exit(1);
+    if(write(fd, &b, sizeof(b)) != sizeof(b)) _exit(2);
+  }
+}
+
+
+// SIGKILL a writer mid-transaction, every acknowledged commit survives intact.
+// The OS page cache outlives the process, so this covers the writer's own ordering of page,
+// index and journal writes, not the fsync ordering a power loss would expose.
+TEST(SqliteCompressVfs_test, Crash)
+{
+  string vfs = RegisterVfs();
+  for(const char* mode : {"DELETE", "WAL"}) {
+    SCOPED_TRACE(mode);
+    string file = (filesystem::temp_directory_path() / "SqliteCompressVfs_t_crash.db").string();
+    RemoveDb(file);
+    int acked = 0;
+    for(int round = 1; round <= 3; ++round) {
+      int fds[2];
+      ASSERT_EQ(pipe(fds), 0);
+      pid_t pid = fork();
+      ASSERT_GE(pid, 0);
+      if(pid == 0) {
+        close(fds[0]);
+        CommitUntilKilled(file, vfs, mode, fds[1]);
+      }
+      close(fds[1]);
+      int b = 0, target = acked + 15 + round * 7;
+      while(acked < target && read(fds[0], &b, sizeof(b)) == sizeof(b)) acked = b;
+      kill(pid, SIGKILL);
+      int status = 0;
+      waitpid(pid, &status, 0);
+      close(fds[0]);
+      ASSERT_EQ(acked, target) << "writer exited early, status " << status;
+
+      SqliteDb db(file, SQLITE_OPEN_READWRITE, vfs);
+      ASSERT_EQ(db.rc(), SQLITE_OK);
+      EXPECT_EQ(ExecText(db, "PRAGMA integrity_check"), "ok");
+      SqliteStmt s = db.stmt("SELECT count(*), max(batch), count(DISTINCT batch) FROM C1");
+      ASSERT_TRUE(s++);
+      int64_t rows = 0, last = 0, batches = 0;
+      s.column(0, rows);
+      s.column(1, last);
+      s.column(2, batches);
+      EXPECT_GE(last, acked);
+      EXPECT_EQ(batches, last);
+      EXPECT_EQ(rows, last * 50);
+      acked = static_cast<int>(last);
+    }
+    RemoveDb(file);
+  }
+}
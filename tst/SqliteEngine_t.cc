@@ -0,0 +1,66 @@
+
+/** \file SqliteEngine_t.cc
+ * Test definitions for the SQLite engine configuration.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteEngine.hh"
+// Std includes
+#include <cstdlib>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+// Configure a fresh process and exit with the number of the first failed check
+static void ConfigureAndExit()
+{
+  SqliteEngineConfig cfg;
+  cfg.lookasideSize = 512;
+  cfg.lookasideCount = 64;
+  cfg.workerThreads = 2;
+  cfg.mmapSize = 4096; // Leaves the hard limit in place
+  if(SqliteEngine::configure(cfg) != SQLITE_OK) exit(1);
+  auto eff = SqliteEngine::effective();
+  if(eff.threadingMode != SQLITE_CONFIG_MULTITHREAD || eff.memStatus != 0) exit(2);
+  if(eff.lookasideSize != 512 || eff.lookasideCount != 64 || eff.uri != 1) exit(3);
+  if(eff.mmapSize != 4096 || eff.mmapMaxSize <= 4096) exit(9);
+  if(SqliteEngine::configure({}) != SQLITE_MISUSE) exit(7); // Once per process
+  if(SqliteEngine::effective().lookasideSize != 512) exit(8);
+
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  if(sqlite3_limit(db.get(), SQLITE_LIMIT_WORKER_THREADS, -1) != 2) exit(4);
+  int cur = 0, hi = 0;
+  sqlite3_db_status(db.get(), SQLITE_DBSTATUS_LOOKASIDE_USED, &cur, &hi, 0);
+  if(cur > 64) exit(5);
+
+  // Too late now
+  if(SqliteEngine::configure(cfg) != SQLITE_MISUSE) exit(6);
+  exit(0);
+}
+
+
+TEST(SqliteEngine_test, Configure)
+{
+  // Runs in a freshly started process, before any connection
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_EXIT(ConfigureAndExit(), ::testing::ExitedWithCode(0), "");
+}
+
+
+TEST(SqliteEngine_test, AfterOpen)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  EXPECT_TRUE(SqliteEngine::opened());
+  EXPECT_EQ(SqliteEngine::configure({}), SQLITE_MISUSE);
+  EXPECT_GE(SqliteEngine::effective().threadsafe, 0);
+}
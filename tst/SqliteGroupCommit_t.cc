@@ -0,0 +1,156 @@
+
+/** \file SqliteGroupCommit_t.cc
+ * Test definitions for the SQLite group commit writer.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteGroupCommit.hh"
+// Std includes
+#include <filesystem>
+#include <thread>
+#include <vector>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteGroupCommit_test, Queue)
+{
+  typedef SqliteMpscQueue<int> Queue_t;
+  Queue_t q;
+  EXPECT_EQ(q.pop(), nullptr);
+
+  constexpr int Producers = 4, PerProducer = 10000;
+  vector<jthread> threads;
+  for(int p = 0; p < Producers; ++p) {
+    threads.emplace_back([&q, p] {
+      for(int i = 0; i < PerProducer; ++i) {
+        auto n = new Queue_t::Node;
+        n->value = p * PerProducer + i;
+        q.push(n);
+      }
+    });
+  }
+
+  // Per producer order is preserved
+  vector<int> last(Producers, -1);
+  int popped = 0;
+  while(popped < Producers * PerProducer) {
+    Queue_t::Node* n = q.pop();
+    if(!n) continue;
+    int p = n->value / PerProducer;
+    EXPECT_GT(n->value, last[p]);
+    last[p] = n->value;
+    delete n;
+    popped++;
+  }
+  EXPECT_EQ(q.pop(), nullptr);
+}
+
+
+TEST(SqliteGroupCommit_test, Writes)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteGroupCommit_t.db";
+  filesystem::remove(path);
+  {
+    SqliteGroupCommit gc(path.string());
+    gc.submit("CREATE TABLE G1 (id INTEGER PRIMARY KEY, t INTEGER)").get();
+
+    constexpr int Threads = 8, PerThread = 200;
+    vector<jthread> threads;
+    for(int t = 0; t < Threads; ++t) {
+      threads.emplace_back([&gc, t] {
+        vector<future<void>> done;
+        for(int i = 0; i < PerThread; ++i) {
+          int id = t * PerThread + i + 1;
+          done.push_back(gc.submit([id, t](SqliteDb& db) {
+            SqliteStmt s = db.cached("INSERT INTO G1 VALUES (?, ?)");
+            s << id << t;
+            s.step();
+          }));
+        }
+        for(auto& f : done) f.get();
+      });
+    }
+    threads.clear();
+
+    // A failing write is rolled back alone
+    auto bad = gc.submit("INSERT INTO G1 VALUES (1, 0)");
+    auto good = gc.submit("INSERT INTO G1 VALUES (100000, 0)");
+    EXPECT_THROW(bad.get(), exception);
+    EXPECT_NO_THROW(good.get());
+
+    auto st = gc.stats();
+    EXPECT_EQ(st.writes, 1u + Threads * PerThread + 1u);
+    EXPECT_EQ(st.failed, 1u);
+    EXPECT_LT(st.commits, st.writes); // Writes were grouped
+  }
+  {
+    SqliteDb db(path.string());
+    SqliteStmt s = db.stmt("SELECT count(*) FROM G1");
+    int64_t n = 0;
+    if(s++) s.column(0, n);
+    EXPECT_EQ(n, 8 * 200 + 1);
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
+
+
+// A write rolling back the whole transaction takes the earlier writes of the batch with it,
+// whether it reports the failure by throwing or not
+TEST(SqliteGroupCommit_test, Rollback)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteGroupCommit_t2.db";
+  for(bool ex : {true, false}) {
+    SCOPED_TRACE(ex ? "exceptions" : "no exceptions");
+    filesystem::remove(path);
+    {
+      SqliteDb db(path.string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+      db.exec("CREATE TABLE G2 (id INTEGER PRIMARY KEY)");
+      db.exec("INSERT INTO G2 VALUES (1)");
+    }
+    {
+      SqliteGroupCommitOptions opts;
+      opts.maxBatch = 4;
+      opts.window = chrono::seconds(10); // The four writes below share one batch
+      SqliteGroupCommit gc(path.string(), opts);
+      auto before = gc.submit("INSERT INTO G2 VALUES (2)");
+      auto bad = ex ? gc.submit("INSERT OR ROLLBACK INTO G2 VALUES (1)") : gc.submit([](SqliteDb& db) {
+        db.ex(false);
+        db.exec("INSERT OR ROLLBACK INTO G2 VALUES (1)");
+        db.ex(true);
+      });
+      auto after1 = gc.submit("INSERT INTO G2 VALUES (3)");
+      auto after2 = gc.submit("INSERT INTO G2 VALUES (4)");
+      EXPECT_THROW(before.get(), exception);
+      EXPECT_THROW(bad.get(), exception);
+      EXPECT_NO_THROW(after1.get());
+      EXPECT_NO_THROW(after2.get());
+
+      auto st = gc.stats();
+      EXPECT_EQ(st.writes, 2u);
+      EXPECT_EQ(st.failed, 2u);
+      EXPECT_EQ(st.commits, 1u);
+    }
+    {
+      SqliteDb db(path.string());
+      SqliteStmt s = db.stmt("SELECT group_concat(id) FROM (SELECT id FROM G2 ORDER BY id)");
+      string ids;
+      if(s++) s.column(0, ids);
+      EXPECT_EQ(ids, "1,3,4");
+    }
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
@@ -0,0 +1,141 @@
+
+/** \file SqlitePageCache_t.cc
+ * Test definitions for the SQLite shared budget page cache.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqlitePageCache.hh"
+// Std includes
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+#include "SqliteEngine.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqlitePageCache_test, Methods)
+{
+  const sqlite3_pcache_methods2* m = SqlitePageCache::Methods();
+  ASSERT_EQ(m->xInit(m->pArg), SQLITE_OK);
+  sqlite3_pcache* pc = m->xCreate(4096, 120, 1);
+  ASSERT_NE(pc, nullptr);
+  m->xCachesize(pc, 4);
+
+  EXPECT_EQ(m->xFetch(pc, 1, 0), nullptr);
+  sqlite3_pcache_page* pages[6]{};
+  for(unsigned k = 1; k <= 4; ++k) {
+    pages[k] = m->xFetch(pc, k, 1);
+    ASSERT_NE(pages[k], nullptr);
+    EXPECT_EQ(static_cast<char*>(pages[k]->pExtra)[0], 0);
+    memset(pages[k]->pBuf, 'a' + k, 4096);
+    m->xUnpin(pc, pages[k], 0);
+  }
+  EXPECT_EQ(m->xPagecount(pc), 4);
+
+  // Page 1 is used again, so the sweep passes it and evicts page 2
+  EXPECT_EQ(m->xFetch(pc, 1, 0), pages[1]);
+  m->xUnpin(pc, pages[1], 0);
+  pages[5] = m->xFetch(pc, 5, 1);
+  ASSERT_NE(pages[5], nullptr);
+  EXPECT_EQ(m->xPagecount(pc), 4);
+  EXPECT_EQ(m->xFetch(pc, 2, 0), nullptr);
+  auto p1 = m->xFetch(pc, 1, 0);
+  ASSERT_NE(p1, nullptr);
+  EXPECT_EQ(static_cast<char*>(p1->pBuf)[4095], 'b');
+
+  // Pinned pages are never evicted, SQLite may then insist with createFlag 2
+  auto p3 = m->xFetch(pc, 3, 0);
+  ASSERT_NE(p3, nullptr);
+  ASSERT_NE(m->xFetch(pc, 4, 0), nullptr);
+  EXPECT_EQ(m->xFetch(pc, 6, 1), nullptr);
+  EXPECT_NE(m->xFetch(pc, 6, 2), nullptr);
+  EXPECT_EQ(m->xPagecount(pc), 5);
+
+  m->xRekey(pc, pages[5], 5, 7);
+  EXPECT_EQ(m->xFetch(pc, 7, 0), pages[5]);
+  m->xTruncate(pc, 4);
+  EXPECT_EQ(m->xPagecount(pc), 2);
+  m->xUnpin(pc, p1, 0);
+  m->xShrink(pc);
+  EXPECT_EQ(m->xPagecount(pc), 1);
+  m->xUnpin(pc, p3, 1);
+  EXPECT_EQ(m->xPagecount(pc), 0);
+  m->xDestroy(pc);
+
+  auto st = SqlitePageCache::Stats();
+  EXPECT_EQ(st.usedBytes, 0u);
+  EXPECT_GE(st.slabBytes, 2u << 20);
+  ASSERT_FALSE(st.files.empty());
+  EXPECT_GE(st.files[0].evictions, 1u);
+}
+
+
+// Install the cache with a small budget in a fresh process, exit 0 on success
+static void InstallAndExit()
+{
+  SqlitePageCacheOptions opts;
+  opts.budgetBytes = 1u << 20;
+  SqliteEngineConfig cfg;
+  cfg.pcacheMethods = SqlitePageCache::Methods(opts);
+  if(SqliteEngine::configure(cfg) != SQLITE_OK) exit(1);
+  if(SqliteEngine::effective().pcacheMethods != cfg.pcacheMethods) exit(2);
+
+  string file = (filesystem::temp_directory_path() / "SqlitePageCache_t.db").string();
+  filesystem::remove(file);
+  {
+    SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    db.exec("CREATE TABLE P1 (id INTEGER PRIMARY KEY, t TEXT)");
+    db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<20000) "
+            "INSERT INTO P1 SELECT i, printf('%.*c', 200, 'x') FROM s");
+    // Concurrent readers evict each other's pages to stay within the budget
+    atomic<int> bad{0};
+    vector<jthread> threads;
+    for(int t = 0; t < 4; ++t) {
+      threads.emplace_back([&] {
+        SqliteDb reader(file, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+        for(int i = 0; i < 3; ++i) {
+          SqliteStmt s = reader.stmt("SELECT count(*), sum(length(t)) FROM P1");
+          int rows = 0, bytes = 0;
+          if(s++) {
+            s.column(0, rows);
+            s.column(1, bytes);
+          }
+          if(rows != 20000 || bytes != 20000 * 200) bad++;
+        }
+      });
+    }
+    threads.clear();
+    if(bad) exit(4);
+  }
+  filesystem::remove(file);
+
+  auto st = SqlitePageCache::Stats();
+  if(st.usedBytes > st.budgetBytes) exit(5);
+  for(const auto& f : st.files) {
+    if(f.file != file) continue;
+    exit(f.hits > 0 && f.misses > 0 && f.evictions > 0 ? 0 : 6);
+  }
+  exit(7);
+}
+
+
+TEST(SqlitePageCache_test, Install)
+{
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_EXIT(InstallAndExit(), ::testing::ExitedWithCode(0), "");
+}
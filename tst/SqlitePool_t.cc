@@ -0,0 +1,112 @@
+
+/** \file SqlitePool_t.cc
+ * Test definitions for the SQLite connection manager.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqlitePool.hh"
+// Std includes
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqlitePool_test, Routing)
+{
+  auto path = filesystem::temp_directory_path() / "SqlitePool_t.db";
+  filesystem::remove(path);
+  {
+    SqlitePoolOptions opts;
+    opts.readers = 4;
+    opts.routeCapacity = 16;
+    SqliteConnectionManager mgr(path.string(), opts);
+    EXPECT_EQ(mgr.readers(), 4u);
+
+    mgr.writer()->exec("CREATE TABLE P1 (id INTEGER PRIMARY KEY, v INTEGER)");
+    EXPECT_FALSE(mgr.isReadOnly("INSERT INTO P1 VALUES (?, ?)"));
+    EXPECT_FALSE(mgr.isReadOnly("BEGIN"));
+    EXPECT_FALSE(mgr.isReadOnly("BEGIN IMMEDIATE"));
+    EXPECT_FALSE(mgr.isReadOnly("/* batch */ begin exclusive"));
+    EXPECT_FALSE(mgr.isReadOnly("-- end\n  COMMIT"));
+    EXPECT_TRUE(mgr.route("BEGIN IMMEDIATE").isWriter());
+    EXPECT_TRUE(mgr.isReadOnly("SELECT sum(v) FROM P1"));
+    EXPECT_TRUE(mgr.route("SELECT count(*) FROM P1").isWriter() == false);
+    EXPECT_TRUE(mgr.route("DELETE FROM P1").isWriter());
+
+    for(int i = 1; i <= 100; ++i) {
+      mgr.run("INSERT INTO P1 VALUES (?, ?)", [&](SqliteStmt& s) { s << i << i; return s.step(); });
+    }
+
+    // Readers run concurrently while the writer keeps writing
+    atomic<int> bad{0};
+    vector<jthread> threads;
+    for(int t = 0; t < 8; ++t) {
+      threads.emplace_back([&] {
+        for(int k = 0; k < 50; ++k) {
+          int64_t n = mgr.run("SELECT count(*) FROM P1", [](SqliteStmt& s) {
+            int64_t n = 0;
+            if(s++) s.column(0, n);
+            return n;
+          });
+          if(n < 100) bad++;
+        }
+      });
+    }
+    threads.emplace_back([&] {
+      for(int i = 101; i <= 200; ++i) {
+        mgr.run("INSERT INTO P1 VALUES (?, ?)", [&](SqliteStmt& s) { s << i << i; return s.step(); });
+      }
+    });
+    threads.clear();
+    EXPECT_EQ(bad, 0);
+
+    // A nested writer request on the same thread fails instead of deadlocking,
+    // a lease released on another thread frees the writer
+    {
+      auto w = mgr.writer();
+      EXPECT_THROW(mgr.run("DELETE FROM P1 WHERE id > 1000", [](SqliteStmt& s) { return s.step(); }), runtime_error);
+      jthread([l = std::move(w)] {}).join();
+    }
+    EXPECT_TRUE(mgr.writer().isWriter());
+
+    // Unseen SQL is classified while this thread holds readers,
+    // SQL failing to prepare is classified again later
+    {
+      vector<SqliteConnectionManager::Lease> held;
+      for(size_t i = 0; i < mgr.readers(); ++i) held.push_back(mgr.reader());
+      EXPECT_TRUE(mgr.isReadOnly("SELECT max(v) FROM P1"));
+      EXPECT_FALSE(mgr.isReadOnly("SELECT * FROM P2"));
+    }
+    mgr.writer()->exec("CREATE TABLE P2 (id INTEGER PRIMARY KEY)");
+    EXPECT_TRUE(mgr.isReadOnly("SELECT * FROM P2"));
+
+    // SQL built dynamically does not grow the routing memo beyond its capacity
+    for(int i = 0; i < 100; ++i) {
+      EXPECT_TRUE(mgr.isReadOnly("SELECT v FROM P1 WHERE id = " + to_string(i)));
+      EXPECT_FALSE(mgr.isReadOnly("DELETE FROM P1 WHERE id = " + to_string(1000 + i)));
+    }
+    EXPECT_LE(mgr.routes(), 16u);
+
+    int64_t n = 0;
+    auto r = mgr.reader();
+    SqliteStmt s = r->stmt("SELECT count(*) FROM P1");
+    if(s++) s.column(0, n);
+    EXPECT_EQ(n, 200);
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
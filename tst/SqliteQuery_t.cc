@@ -0,0 +1,78 @@
+
+/** \file SqliteQuery_t.cc
+ * Test definitions for the SQLite typed queries.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteQuery.hh"
+// Std includes
+#include <string>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+// Compile time host parameter counting
+static_assert(SqliteCountParams("SELECT 1") == 0);
+static_assert(SqliteCountParams("INSERT INTO T VALUES (?, ?, ?)") == 3);
+static_assert(SqliteCountParams("SELECT '?', \"a?\", [b?] /* ? */ FROM T WHERE a=? -- ?\n AND b=?") == 2);
+static_assert(SqliteCountParams("SELECT 'it''s?' WHERE a=?2 AND b=?") == 3);
+
+
+TEST(SqliteQuery_test, Execute)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE Q1 (id INTEGER PRIMARY KEY, v REAL, t TEXT)");
+
+  SqliteQuery<SqliteParams<int64_t, double, std::string_view>> ins(db, "INSERT INTO Q1 VALUES (?, ?, ?)");
+  for(int64_t i = 1; i <= 10; ++i) {
+    EXPECT_EQ(ins.execute(i, i * 1.5, "row"), SQLITE_DONE);
+  }
+
+  SqliteQuery<SqliteParams<int64_t>, SqliteRow<double, std::string_view>> get(db, "SELECT v, t FROM Q1 WHERE id=?");
+  auto row = get.one(4);
+  ASSERT_TRUE(row.has_value());
+  EXPECT_EQ(std::get<0>(*row), 6.0);
+  EXPECT_EQ(std::get<1>(*row), "row");
+  EXPECT_EQ(sqlite3_stmt_busy(get.stmt().get()), 0); // No read transaction left open
+  EXPECT_FALSE(get.one(42).has_value());
+  EXPECT_EQ(std::get<1>(*row), "row"); // The row owns its text
+
+  SqliteQuery<SqliteParams<int64_t>, SqliteRow<int64_t>> scan(db, "SELECT id FROM Q1 WHERE id > ?");
+  int64_t n = 0;
+  for(const auto& [id] : scan.rows(7)) n += id;
+  EXPECT_EQ(n, 8 + 9 + 10);
+
+  // A temporary string argument outlives the call, rows() binds a copy
+  SqliteQuery<SqliteParams<std::string_view>, SqliteRow<int64_t>> byText(db, "SELECT id FROM Q1 WHERE t = ?");
+  n = 0;
+  for(const auto& [id] : byText.rows(std::string("r") + "ow")) n += id;
+  EXPECT_EQ(n, 55);
+  n = 0;
+  for(const auto& [id] : byText.rows("none")) n += id;
+  EXPECT_EQ(n, 0);
+
+  // So do owning string and blob parameters, too long for the small string buffer
+  const std::string longText(64, 'x');
+  db.exec("INSERT INTO Q1 VALUES (11, 0, '" + longText + "')");
+  SqliteQuery<SqliteParams<std::string>, SqliteRow<int64_t>> byString(db, "SELECT id FROM Q1 WHERE t = ?");
+  n = 0;
+  for(const auto& [id] : byString.rows(longText.substr(0, 32) + longText.substr(32))) n += id;
+  EXPECT_EQ(n, 11);
+  SqliteQuery<SqliteParams<Blob_t>, SqliteRow<int64_t>> byBlob(db, "SELECT id FROM Q1 WHERE CAST(t AS BLOB) = ?");
+  n = 0;
+  for(const auto& [id] : byBlob.rows(Blob_t(longText.begin(), longText.end()))) n += id;
+  EXPECT_EQ(n, 11);
+
+  // Does not compile: one placeholder for two parameters
+  // SqliteQuery<SqliteParams<int64_t, double>> bad(db, "SELECT ?");
+}
@@ -0,0 +1,157 @@
+
+/** \file SqliteTrace_t.cc
+ * Test definitions for SQLite statement latency tracing.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteTrace.hh"
+// Std includes
+#include <memory>
+#include <optional>
+#include <string>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+TEST(SqliteTrace_test, Histogram)
+{
+  for(uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull}) {
+    int b = SqliteLatencyHistogram::BucketOf(v);
+    ASSERT_LT(b, SqliteLatencyHistogram::Buckets);
+    EXPECT_LE(SqliteLatencyHistogram::BucketFloor(b), v);
+    if(b + 1 < SqliteLatencyHistogram::Buckets) {
+      EXPECT_GT(SqliteLatencyHistogram::BucketFloor(b + 1), v);
+    }
+  }
+
+  auto h = make_unique<SqliteLatencyHistogram>();
+  EXPECT_EQ(h->percentile(0.5), 0u);
+  for(uint64_t i = 1; i <= 1000; ++i) h->record(i * 1000); // 1us .. 1ms
+  EXPECT_EQ(h->count(), 1000u);
+  EXPECT_EQ(h->max(), 1000000u);
+  EXPECT_EQ(h->percentile(1.0), 1000000u);
+  EXPECT_NEAR(double(h->percentile(0.5)), 500000.0, 500000 * 0.0625);
+  EXPECT_NEAR(double(h->percentile(0.99)), 990000.0, 990000 * 0.0625);
+  h->reset();
+  EXPECT_EQ(h->count(), 0u);
+}
+
+
+TEST(SqliteTrace_test, Tracer)
+{
+  SqliteTraceOptions opts;
+  opts.slowThreshold = chrono::nanoseconds(0); // Everything is slow
+  opts.sampleRate = 0.5;
+  opts.slowLogSize = 8;
+  opts.logSlow = false;
+  auto tracer = make_shared<SqliteTracer>(opts);
+
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  EXPECT_EQ(db.tracer(), nullptr);
+  db.exec("CREATE TABLE T1 (id INTEGER PRIMARY KEY, t TEXT)");
+  EXPECT_EQ(db.trace(tracer), SQLITE_OK);
+  EXPECT_EQ(db.tracer(), tracer);
+
+  SqliteStmt ins = db.stmt("INSERT INTO T1 (id, t) VALUES (?, 'a\"b')");
+  for(int i = 1; i <= 10; ++i) {
+    ins.bind(1, i);
+    ins++;
+    ins.reset();
+  }
+
+  auto snap = tracer->snapshot();
+  ASSERT_EQ(snap.size(), 1u);
+  EXPECT_NE(snap[0].sql.find("INSERT INTO T1"), string::npos);
+  EXPECT_EQ(snap[0].count, 10u);
+  EXPECT_LE(snap[0].p50Ns, snap[0].p99Ns);
+  EXPECT_LE(snap[0].p99Ns, snap[0].maxNs);
+
+  // Half the slow queries carry their bound values, the log keeps the most recent ones
+  auto slow = tracer->slowQueries();
+  ASSERT_EQ(slow.size(), 8u);
+  int expanded = 0;
+  for(auto& q : slow) if(!q.expanded.empty()) ++expanded;
+  EXPECT_EQ(expanded, 4);
+  EXPECT_EQ(slow.back().expanded, "INSERT INTO T1 (id, t) VALUES (10, 'a\"b')");
+
+  string json = tracer->json();
+  EXPECT_EQ(json.rfind("{\"statements\":[{\"sql\":\"INSERT INTO T1", 0), 0u);
+  EXPECT_NE(json.find("\\\"b"), string::npos);
+  EXPECT_NE(json.find("\"count\":10,"), string::npos);
+  EXPECT_NE(json.find("\"slow\":[{"), string::npos);
+
+  // Off again, nothing more is recorded
+  EXPECT_EQ(db.trace(nullptr), SQLITE_OK);
+  db.exec("SELECT count(*) FROM T1");
+  EXPECT_EQ(tracer->snapshot().size(), 1u);
+
+  tracer->reset();
+  EXPECT_TRUE(tracer->snapshot().empty());
+  EXPECT_TRUE(tracer->slowQueries().empty());
+}
+
+
+// Statements recreated at the address of a finalized one and new tracers in place of a
+// destroyed one record into their own histograms
+TEST(SqliteTrace_test, Reuse)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  for(int round = 0; round < 2; ++round) {
+    auto tracer = make_shared<SqliteTracer>();
+    EXPECT_EQ(db.trace(tracer), SQLITE_OK);
+    for(int i = 0; i < 3; ++i) {
+      {
+        SqliteStmt a = db.stmt("SELECT 1");
+        a++;
+      }
+      SqliteStmt b = db.stmt("SELECT 1, 2"); // Most likely where a was
+      b++;
+    }
+    auto snap = tracer->snapshot();
+    ASSERT_EQ(snap.size(), 2u);
+    EXPECT_EQ(snap[0].count, 3u);
+    EXPECT_EQ(snap[1].count, 3u);
+    EXPECT_EQ(db.trace(nullptr), SQLITE_OK);
+  }
+}
+
+
+// Assigning over a traced connection closes it before its tracer goes
+TEST(SqliteTrace_test, MoveAssign)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  EXPECT_EQ(db.trace(make_shared<SqliteTracer>()), SQLITE_OK); // db holds the only reference
+  db.exec("CREATE TABLE T2 (id INTEGER PRIMARY KEY)");
+  db.exec("INSERT INTO T2 VALUES (1), (2)");
+  {
+    SqliteStmt sel = db.cached("SELECT id FROM T2");
+    EXPECT_TRUE(sel++); // Returned to the cache mid-run
+  }
+  db = SqliteDb(":memory:", SQLITE_OPEN_READWRITE);
+  EXPECT_EQ(db.tracer(), nullptr);
+  EXPECT_EQ(db.exec("SELECT 1"), SQLITE_OK);
+}
+
+
+// A statement finalized after its traced connection is gone reports to no tracer
+TEST(SqliteTrace_test, StmtOutlivesDb)
+{
+  optional<SqliteStmt> stmt;
+  {
+    SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+    EXPECT_EQ(db.trace(make_shared<SqliteTracer>()), SQLITE_OK); // db holds the only reference
+    stmt.emplace(db.stmt("SELECT 1"));
+    EXPECT_TRUE((*stmt)++); // Mid-run, finalizing it reports a profile
+  }
+  stmt.reset();
+}
@@ -0,0 +1,180 @@
+
+/** \file SqliteUringVfs_t.cc
+ * Test definitions for the SQLite io_uring VFS.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteUringVfs.hh"
+// Std includes
+#include <csignal>
+#include <filesystem>
+#include <string>
+// Posix
+#include <sys/resource.h>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+#include "Sqlite.hh"
+
+
+using namespace std;
+using namespace MP;
+
+
+// Row count and total text length of U1
+static pair<int64_t, int64_t> Totals(SqliteDb& db)
+{
+  SqliteStmt s = db.stmt("SELECT count(*), sum(length(t)) FROM U1");
+  pair<int64_t, int64_t> out{-1, -1};
+  if(s++) {
+    s.column(0, out.first);
+    s.column(1, out.second);
+  }
+  return out;
+}
+
+
+// Load, checkpoint and scan a WAL database through vfs
+static void Workload(const string& vfs)
+{
+  string file = (filesystem::temp_directory_path() / ("SqliteUringVfs_t_" + vfs + ".db")).string();
+  for(auto ext : {"", "-wal", "-shm"}) filesystem::remove(file + ext);
+  {
+    SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
+    ASSERT_EQ(db.rc(), SQLITE_OK);
+    db.exec("PRAGMA journal_mode=WAL");
+    db.exec("PRAGMA wal_autocheckpoint=0");
+    db.exec("CREATE TABLE U1 (id INTEGER PRIMARY KEY, t TEXT)");
+    db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<20000) "
+            "INSERT INTO U1 SELECT i, printf('%.*c', 200, 'x') FROM s");
+    EXPECT_EQ(db.exec("PRAGMA wal_checkpoint(TRUNCATE)"), SQLITE_OK);
+  }
+  {
+    // A small cache makes the scans read the file
+    SqliteDb db(file, SQLITE_OPEN_READWRITE, vfs);
+    db.exec("PRAGMA cache_size=16");
+    EXPECT_EQ(Totals(db), make_pair(int64_t{20000}, int64_t{20000 * 200}));
+
+    // Writes of another connection are seen, the readahead window is dropped
+    SqliteDb other(file, SQLITE_OPEN_READWRITE);
+    other.exec("UPDATE U1 SET t = 'y' WHERE id % 2 = 0");
+    EXPECT_EQ(Totals(db), make_pair(int64_t{20000}, int64_t{10000 * 201}));
+    EXPECT_EQ(db.exec("PRAGMA wal_checkpoint(TRUNCATE)"), SQLITE_OK);
+    EXPECT_EQ(Totals(db), make_pair(int64_t{20000}, int64_t{10000 * 201}));
+
+    SqliteStmt check = db.stmt("PRAGMA integrity_check");
+    ASSERT_TRUE(check++);
+    string_view ok;
+    check.column(0, ok);
+    EXPECT_EQ(ok, "ok");
+  }
+  for(auto ext : {"", "-wal", "-shm"}) filesystem::remove(file + ext);
+}
+
+
+TEST(SqliteUringVfs_test, Uring)
+{
+  ASSERT_EQ(SqliteUringVfs::Register(), SQLITE_OK);
+  ASSERT_NE(sqlite3_vfs_find("uring"), nullptr);
+  EXPECT_NE(sqlite3_vfs_find(nullptr), sqlite3_vfs_find("uring"));
+  Workload("uring");
+
+  auto st = SqliteUringVfs::Stats();
+  EXPECT_EQ(st.uring, SqliteUringVfs::Available());
+  if(!st.uring) GTEST_SKIP() << "io_uring unavailable, files delegated";
+  EXPECT_GE(st.files, 2u);
+  EXPECT_GT(st.reads, 0u);
+  EXPECT_GT(st.readaheads, 0u);
+  EXPECT_GT(st.readaheadHits, st.reads);
+  EXPECT_GT(st.writes, 0u);
+  EXPECT_GT(st.syncs, 0u);
+}
+
+
+// A checkpoint without sync or truncate, other connections read the backfilled pages at once
+TEST(SqliteUringVfs_test, SyncOff)
+{
+  ASSERT_EQ(SqliteUringVfs::Register(), SQLITE_OK);
+  string file = (filesystem::temp_directory_path() / "SqliteUringVfs_t_syncoff.db").string();
+  for(auto ext : {"", "-wal", "-shm"}) filesystem::remove(file + ext);
+  {
+    SqliteDb db(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, "uring");
+    ASSERT_EQ(db.rc(), SQLITE_OK);
+    db.exec("PRAGMA journal_mode=WAL");
+    db.exec("PRAGMA synchronous=OFF");
+    db.exec("PRAGMA wal_autocheckpoint=0");
+    db.exec("CREATE TABLE U1 (id INTEGER PRIMARY KEY, t TEXT)");
+    db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<20000) "
+            "INSERT INTO U1 SELECT i, printf('%.*c', 200, 'x') FROM s");
+
+    // A reader keeps the later frames in the WAL, the checkpoint stays partial
+    SqliteDb reader(file, SQLITE_OPEN_READONLY);
+    reader.exec("BEGIN");
+    EXPECT_EQ(Totals(reader), make_pair(int64_t{20000}, int64_t{20000 * 200}));
+    db.exec("UPDATE U1 SET t = 'y' WHERE id % 100 = 0");
+    EXPECT_EQ(db.exec("PRAGMA wal_checkpoint(PASSIVE)"), SQLITE_OK);
+    reader.exec("COMMIT");
+
+    SqliteDb other(file, SQLITE_OPEN_READONLY);
+    other.exec("PRAGMA cache_size=16");
+    EXPECT_EQ(Totals(other), make_pair(int64_t{20000}, int64_t{19800 * 200 + 200}));
+    SqliteStmt check = other.stmt("PRAGMA integrity_check");
+    ASSERT_TRUE(check++);
+    string_view ok;
+    check.column(0, ok);
+    EXPECT_EQ(ok, "ok");
+  }
+  {
+    // Writes past the file size limit fail, through the ring and when retried synchronously.
+    // The partial checkpoint fails and readers keep reading the frames from the WAL.
+    SqliteDb db(file, SQLITE_OPEN_READWRITE, "uring");
+    db.exec("PRAGMA synchronous=OFF");
+    db.exec("PRAGMA wal_autocheckpoint=0");
+    db.exec("WITH RECURSIVE s(i) AS (SELECT 20001 UNION ALL SELECT i+1 FROM s WHERE i<25000) "
+            "INSERT INTO U1 SELECT i, printf('%.*c', 200, 'x') FROM s");
+    SqliteDb reader(file, SQLITE_OPEN_READONLY);
+    reader.exec("BEGIN");
+    EXPECT_EQ(Totals(reader), make_pair(int64_t{25000}, int64_t{24800 * 200 + 200}));
+    db.exec("UPDATE U1 SET t = 'z' WHERE id % 100 = 1");
+
+    rlimit saved, limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &saved), 0);
+    limit = saved;
+    limit.rlim_cur = filesystem::file_size(file);
+    auto handler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    int rc = sqlite3_wal_checkpoint_v2(db.get(), nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, handler);
+    EXPECT_NE(rc, SQLITE_OK);
+    reader.exec("COMMIT");
+
+    SqliteDb other(file, SQLITE_OPEN_READONLY);
+    other.exec("PRAGMA cache_size=16");
+    EXPECT_EQ(Totals(other), make_pair(int64_t{25000}, int64_t{24550 * 200 + 450}));
+    EXPECT_EQ(Totals(db), Totals(other));
+    EXPECT_EQ(db.exec("PRAGMA wal_checkpoint(TRUNCATE)"), SQLITE_OK);
+    EXPECT_EQ(Totals(other), make_pair(int64_t{25000}, int64_t{24550 * 200 + 450}));
+  }
+  for(auto ext : {"", "-wal", "-shm"}) filesystem::remove(file + ext);
+}
+
+
+TEST(SqliteUringVfs_test, Fallback)
+{
+  SqliteUringVfsOptions opts;
+  opts.name = "uring_off";
+  opts.queueDepth = 0;
+  ASSERT_EQ(SqliteUringVfs::Register(opts), SQLITE_OK);
+  Workload("uring_off");
+
+  auto st = SqliteUringVfs::Stats("uring_off");
+  EXPECT_FALSE(st.uring);
+  EXPECT_EQ(st.files, 0u);
+  EXPECT_GE(st.fallbackFiles, 2u);
+  EXPECT_EQ(st.reads, 0u);
+}
@@ -0,0 +1,74 @@
+
+/** \file SqliteUtils_t.cc
+ * Test definitions for the SQLite utilities.
+ *
+ * (c) Copyright by Semih Cemiloglu
+ * All rights reserved, see COPYRIGHT file for details.
+ *
+ *
+ */
+
+#include "SqliteUtils.hh"
+// Std includes
+#include <filesystem>
+// Google Test
+#include <gtest/gtest.h>
+// Prj includes
+
+
+using namespace std;
+using namespace MP;
+
+
+static int64_t PragmaValue(SqliteDb& db, std::string_view name)
+{
+  int64_t v = -1;
+  SqliteStmt s = db.stmt(string("PRAGMA ") + string(name));
+  if(s++) s.column(0, v);
+  return v;
+}
+
+
+TEST(SqliteUtils_test, Profiles)
+{
+  auto path = filesystem::temp_directory_path() / "SqliteUtils_t.db";
+  filesystem::remove(path);
+  {
+    SqliteDb db;
+    ASSERT_EQ(OpenSQLiteDB(path.string(), db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, SqliteProfile::Analytics), 0);
+    ASSERT_TRUE(db.get());
+    EXPECT_EQ(PragmaValue(db, "page_size"), 16384);
+    EXPECT_EQ(PragmaValue(db, "synchronous"), 1);
+    EXPECT_EQ(PragmaValue(db, "cache_size"), -262144);
+    EXPECT_EQ(PragmaValue(db, "temp_store"), 2);
+    EXPECT_EQ(PragmaValue(db, "busy_timeout"), 5000);
+    string mode;
+    SqliteStmt s = db.stmt("PRAGMA journal_mode");
+    if(s++) s.column(0, mode);
+    EXPECT_EQ(mode, "wal");
+    db.exec("CREATE TABLE U1 (id INTEGER)");
+  }
+  {
+    // Read-only connections skip journal_mode and page_size
+    SqliteDb db;
+    ASSERT_EQ(OpenSQLiteDB(path.string(), db, SQLITE_OPEN_READONLY, SqliteProfile::ReadHeavy), 0);
+    EXPECT_EQ(PragmaValue(db, "cache_size"), -65536);
+    EXPECT_TRUE(TableExists(db, "U1"));
+  }
+  {
+    // A failed verification leaves the target untouched
+    SqliteDb db;
+    SqliteTuning bad;
+    bad.synchronous = 7;
+    EXPECT_NE(OpenSQLiteDB(path.string(), db, SQLITE_OPEN_READWRITE, bad), 0);
+    EXPECT_EQ(db.get(), nullptr);
+  }
+  {
+    SqliteDb db;
+    EXPECT_EQ(OpenSQLiteDB(":memory:", db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, SqliteProfile::BulkLoad), 0);
+    EXPECT_EQ(PragmaValue(db, "synchronous"), 0);
+  }
+  filesystem::remove(path);
+  filesystem::remove(path.string() + "-wal");
+  filesystem::remove(path.string() + "-shm");
+}
@@ -77,7 +77,7 @@ TEST(Sqlite_test, Base)
       int ival{};
       double dval{};
       string sval;
-      any a;
+      SqliteValue a;
       sstmt.column(col, ival);
       a = sstmt.column(col);
       LOG(INFO) << format( "Row {} Col {} = {} ({} ~ {})", row, col, ival, sizeof(ival), sizeof(a));
@@ -188,3 +188,292 @@ TEST(Sqlite_test, Transactions) {
         LOG(ERROR) << "Rollback failed. Rows found in T2.";
     }
 }
+
+
+TEST(Sqlite_test, StmtCache) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE T3 (id INTEGER PRIMARY KEY, v REAL)");
+  db.cacheCapacity(2);
+
+  for(int i=0; i<10; ++i) {
+    SqliteStmt ins = db.cached("INSERT INTO T3 VALUES (?, ?)");
+    ins << i << i * 0.5;
+    EXPECT_EQ(ins.step(), SQLITE_DONE);
+  }
+  auto st = db.cacheStats();
+  EXPECT_EQ(st.misses, 1u);
+  EXPECT_EQ(st.hits, 9u);
+  EXPECT_EQ(st.size, 1u);
+
+  {
+    // Same SQL checked out twice at the same time gets two distinct statements
+    SqliteStmt s1 = db.cached("SELECT v FROM T3 WHERE id=?");
+    SqliteStmt s2 = db.cached("SELECT v FROM T3 WHERE id=?");
+    EXPECT_NE(s1.get(), s2.get());
+    s1 << 4;
+    ASSERT_TRUE(s1++);
+    double v{};
+    s1 >> v;
+    EXPECT_EQ(v, 2.0);
+  }
+  EXPECT_EQ(db.cacheStats().evictions, 1u); // Duplicate was dropped on checkin
+
+  {
+    // Returned statements are reset with cleared bindings
+    SqliteStmt s3 = db.cached("SELECT v FROM T3 WHERE id=?");
+    EXPECT_EQ(s3.step(), SQLITE_DONE); // NULL id matches nothing
+  }
+
+  db.cached("SELECT 1");
+  db.cached("SELECT 2");
+  st = db.cacheStats();
+  EXPECT_EQ(st.size, 2u);
+  EXPECT_EQ(st.evictions, 3u);
+}
+
+
+TEST(Sqlite_test, ColumnViews) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE T4 (t text, b blob)");
+  db.exec("INSERT INTO T4 VALUES (CAST(x'77697468006e756c' AS TEXT), x'00010203'), (null, null)"); // 'with\0nul'
+
+  SqliteStmt stmt = db.stmt("SELECT t, b FROM T4");
+  ASSERT_TRUE(stmt++);
+  std::string_view sv;
+  span<const uint8_t> sp;
+  stmt >> sv >> sp;
+  ASSERT_EQ(sv.size(), 8u); // Length from sqlite3_column_bytes(), not up to the NUL
+  EXPECT_EQ(sv[4], '\0');
+  EXPECT_EQ(sv, std::string_view("with\0nul", 8));
+  ASSERT_EQ(sp.size(), 4u);
+  EXPECT_EQ(sp[3], 3);
+  EXPECT_EQ(stmt.columnText(0).data(), sv.data()); // Points into the row buffer
+
+  Blob_t blob;
+  stmt.column(1, blob);
+  EXPECT_EQ(blob, (Blob_t{0, 1, 2, 3}));
+
+  ASSERT_TRUE(stmt++);
+  EXPECT_TRUE(stmt.columnText(0).empty());
+  EXPECT_TRUE(stmt.columnBlob(1).empty());
+  string s{"stale"};
+  stmt.column(0, s);
+  EXPECT_TRUE(s.empty());
+}
+
+
+TEST(Sqlite_test, Rows) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE T5 (id INTEGER, v REAL, t TEXT)");
+  db.exec("INSERT INTO T5 VALUES (1, 0.5, 'a'), (2, 1.5, 'bb'), (3, 2.5, 'ccc')");
+
+  SqliteStmt stmt = db.stmt("SELECT id, v, t FROM T5 WHERE id >= ? ORDER BY id");
+  stmt << 1;
+  auto rows = stmt.rows<int64_t, double, std::string_view>();
+  static_assert(std::ranges::input_range<decltype(rows)>);
+  static_assert(std::ranges::view<decltype(rows)>);
+
+  double sum = 0;
+  size_t len = 0;
+  std::ranges::for_each(rows, [&](const auto& row) {
+    sum += std::get<1>(row);
+    len += std::get<2>(row).size();
+  });
+  EXPECT_EQ(sum, 4.5);
+  EXPECT_EQ(len, 6u);
+  EXPECT_EQ(stmt.rc(), SQLITE_DONE);
+
+  stmt.reset();
+  stmt << 2;
+  int64_t ids = 0;
+  for(int64_t id : stmt.rows<int64_t>()
+                   | std::views::transform([](const auto& row) { return std::get<0>(row); })
+                   | std::views::filter([](int64_t id) { return id % 2; })) {
+    ids += id;
+  }
+  EXPECT_EQ(ids, 3);
+}
+
+
+TEST(Sqlite_test, Ownership) {
+  static_assert(!std::is_copy_constructible_v<SqliteStmt> && std::is_move_constructible_v<SqliteStmt>);
+  static_assert(!std::is_copy_constructible_v<SqliteDb> && std::is_move_constructible_v<SqliteDb>);
+
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  SqliteStmt s1 = db.stmt("SELECT 7");
+  sqlite3_stmt* h = s1.get();
+  SqliteStmt s2 = std::move(s1);
+  EXPECT_EQ(s1.get(), nullptr);
+  EXPECT_EQ(s2.get(), h);
+
+  SqliteSharedStmt shared = std::move(s2).share();
+  SqliteSharedStmt other = shared;
+  EXPECT_EQ(other->get(), h);
+  int v{};
+  ASSERT_TRUE((*other)++);
+  *other >> v;
+  EXPECT_EQ(v, 7);
+}
+
+
+TEST(Sqlite_test, Value) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  SqliteStmt stmt = db.stmt("SELECT 5000000000, 2.5, 'txt', x'0102', null");
+  ASSERT_TRUE(stmt++);
+
+  SqliteValue v0 = stmt.column(0);
+  EXPECT_EQ(v0.type(), SQLITE_INTEGER);
+  EXPECT_EQ(v0.get<int64_t>(), 5000000000); // No truncation to int
+  EXPECT_EQ(stmt.column(1).get<double>(), 2.5);
+  EXPECT_EQ(stmt.column(2).get<std::string_view>(), "txt");
+  EXPECT_EQ(stmt.column(3).get<span<const uint8_t>>().size(), 2u);
+  EXPECT_TRUE(stmt.column(4).isNull());
+  EXPECT_EQ(stmt.column(4).type(), SQLITE_NULL);
+  EXPECT_EQ(stmt.column(2).getIf<int64_t>(), nullptr);
+
+  size_t bytes = 0;
+  for(int c = 0; c < stmt.columnCount(); ++c) {
+    stmt.column(c).visit([&](const auto& v) {
+      using T = decay_t<decltype(v)>;
+      if constexpr (is_same_v<T, std::string_view> || is_same_v<T, span<const uint8_t>>) bytes += v.size();
+    });
+  }
+  EXPECT_EQ(bytes, 5u);
+
+  SqliteOwnedValue owned = stmt.column(2).owned();
+  EXPECT_FALSE(stmt++); // Row buffer is gone
+  EXPECT_EQ(owned.get<string>(), "txt");
+  EXPECT_EQ(owned.type(), SQLITE_TEXT);
+  EXPECT_EQ(owned.view().get<std::string_view>(), "txt");
+}
+
+
+TEST(Sqlite_test, OwningBinds) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  db.exec("CREATE TABLE T6 (t text, b blob, c text)");
+
+  SqliteStmt ins = db.stmt("INSERT INTO T6 VALUES (?, ?, ?)");
+  string big(10000, 'x');
+  ins << std::move(big) << Blob_t{1, 2, 3};
+  {
+    string tmp{"copied"};
+    ins.bindCopy(3, tmp);
+  } // tmp is gone, the arena keeps a copy
+  EXPECT_EQ(ins.step(), SQLITE_DONE);
+  EXPECT_FALSE(ins.arena().empty());
+  EXPECT_EQ(ins.reset(), SQLITE_OK);
+  EXPECT_TRUE(ins.arena().empty());
+  EXPECT_EQ(ins.step(), SQLITE_DONE); // Bindings were cleared with the arena: all nulls
+
+  SqliteStmt sel = db.stmt("SELECT t, b, c FROM T6");
+  ASSERT_TRUE(sel++);
+  EXPECT_EQ(sel.columnText(0).size(), 10000u);
+  EXPECT_EQ(sel.columnBlob(1).size(), 3u);
+  EXPECT_EQ(sel.columnText(2), "copied");
+  ASSERT_TRUE(sel++);
+  EXPECT_TRUE(sel.column(0).isNull());
+
+  // Bindings not backed by the arena survive reset()
+  SqliteStmt mix = db.stmt("SELECT ?1 IS NULL, ?2");
+  mix.bind(1, string("owned"));
+  mix.bind(2, int64_t{7});
+  EXPECT_EQ(mix.reset(), SQLITE_OK);
+  ASSERT_TRUE(mix++);
+  int64_t isNull = 0, kept = 0;
+  mix.column(0, isNull);
+  mix.column(1, kept);
+  EXPECT_EQ(isNull, 1);
+  EXPECT_EQ(kept, 7);
+
+  // Assigning over a stepped statement releases it before its arena
+  SqliteStmt run = db.stmt("SELECT t FROM T6 WHERE c = ?");
+  run.bindCopy(1, string("copied"));
+  ASSERT_TRUE(run++);
+  run = db.stmt("SELECT count(*) FROM T6");
+  ASSERT_TRUE(run++);
+  int64_t rows = 0;
+  run.column(0, rows);
+  EXPECT_EQ(rows, 2);
+}
+
+
+TEST(Sqlite_test, TryApi) {
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_TRUE(db.get());
+  static_assert(std::is_trivially_copyable_v<SqliteError>);
+
+  auto bad = db.tryPrepare("SELEKT 1");
+  ASSERT_FALSE(bad.has_value());
+  EXPECT_EQ(bad.error().primary(), SQLITE_ERROR);
+
+  auto stmt = db.tryPrepare("SELECT value FROM json_each(?)");
+  ASSERT_TRUE(stmt.has_value());
+  EXPECT_TRUE(stmt->tryBind(1, "[1,2,3]"));
+  EXPECT_FALSE(stmt->tryBind(5, 1.0)); // Out of range
+  EXPECT_EQ(stmt->tryBind(5, 1.0).error().rc, SQLITE_RANGE);
+
+  int64_t sum = 0;
+  SqliteResult<bool> r;
+  while((r = stmt->tryStep()) && *r) sum += stmt->columnText(0)[0] - '0';
+  ASSERT_TRUE(r.has_value());
+  EXPECT_EQ(sum, 6);
+  EXPECT_TRUE(stmt->tryReset());
+}
+
+
+TEST(Sqlite_test, MemoryStats)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  db.exec("CREATE TABLE MS1 (id INTEGER PRIMARY KEY, v TEXT)");
+  db.exec("INSERT INTO MS1 VALUES (1, 'a'), (2, 'b')");
+  SqliteStmt s = db.stmt("SELECT v FROM MS1 WHERE id = 2");
+  ASSERT_TRUE(s++);
+
+  auto ms = db.memoryStats();
+  EXPECT_GT(ms.cacheUsed, 0);
+  EXPECT_GT(ms.schemaUsed, 0);
+  EXPECT_GT(ms.stmtUsed, 0);
+  EXPECT_GE(ms.cacheHit + ms.cacheMiss, 1);
+  EXPECT_EQ(SqliteDb().memoryStats().cacheUsed, 0);
+}
+
+
+TEST(Sqlite_test, Profile)
+{
+  SqliteDb db(":memory:", SQLITE_OPEN_READWRITE);
+  db.exec("CREATE TABLE PR1 (a INTEGER, b INTEGER)");
+  db.exec("CREATE TABLE PR2 (a INTEGER, c INTEGER)");
+  db.exec("WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM s WHERE i<500) "
+          "INSERT INTO PR1 SELECT i, i % 7 FROM s");
+  db.exec("INSERT INTO PR2 SELECT a, b FROM PR1");
+
+  // No index on PR2.a: SQLite builds an automatic one on each run, and sorts for ORDER BY
+  SqliteStmt s = db.stmt("SELECT PR1.a, PR2.c FROM PR1, PR2 WHERE PR1.a = PR2.a ORDER BY PR1.b");
+  int rows = 0;
+  while(s++) ++rows;
+  EXPECT_EQ(rows, 500);
+
+  auto p = s.profile();
+  EXPECT_NE(p.sql.find("FROM PR1, PR2"), string::npos);
+  EXPECT_EQ(p.runs, 1);
+  EXPECT_GT(p.fullscanSteps, 0);
+  EXPECT_GT(p.autoindexes, 0);
+  EXPECT_EQ(p.sorts, 1);
+  EXPECT_GT(p.vmSteps, p.fullscanSteps);
+  EXPECT_GT(p.memUsed, 0);
+  EXPECT_NE(p.dump().find("autoindex rows="), string::npos);
+
+  s.resetProfile();
+  p = s.profile();
+  EXPECT_EQ(p.runs, 0);
+  EXPECT_EQ(p.vmSteps, 0);
+  EXPECT_EQ(p.autoindexes, 0);
+  EXPECT_GT(p.memUsed, 0);
+  EXPECT_EQ(SqliteStmt().profile().runs, 0);
+}